@@ -0,0 +1,133 @@
+#include "tl/vm.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+// Counts every node the tree-walker dispatches to.
+class CountingVM : public tl::VM {
+public:
+    std::size_t dispatches = 0;
+
+    tl::Value visit_literal_expr(tl::LiteralExpr& expr) override {
+        ++dispatches;
+        return VM::visit_literal_expr(expr);
+    }
+    tl::Value visit_variable_expr(tl::VariableExpr& expr) override {
+        ++dispatches;
+        return VM::visit_variable_expr(expr);
+    }
+    tl::Value visit_unary_expr(tl::UnaryExpr& expr) override {
+        ++dispatches;
+        return VM::visit_unary_expr(expr);
+    }
+    tl::Value visit_binary_expr(tl::BinaryExpr& expr) override {
+        ++dispatches;
+        return VM::visit_binary_expr(expr);
+    }
+    tl::Value visit_assign_expr(tl::AssignExpr& expr) override {
+        ++dispatches;
+        return VM::visit_assign_expr(expr);
+    }
+    tl::Value visit_call_expr(tl::CallExpr& expr) override {
+        ++dispatches;
+        return VM::visit_call_expr(expr);
+    }
+    tl::Value visit_temp_store_expr(tl::TempStoreExpr& expr) override {
+        ++dispatches;
+        return VM::visit_temp_store_expr(expr);
+    }
+    tl::Value visit_temp_load_expr(tl::TempLoadExpr& expr) override {
+        ++dispatches;
+        return VM::visit_temp_load_expr(expr);
+    }
+    tl::Value visit_fused_binary_expr(tl::FusedBinaryExpr& expr) override {
+        ++dispatches;
+        return VM::visit_fused_binary_expr(expr);
+    }
+    tl::Value visit_fused_assign_expr(tl::FusedAssignExpr& expr) override {
+        ++dispatches;
+        return VM::visit_fused_assign_expr(expr);
+    }
+
+    void visit_expression_stmt(tl::ExpressionStmt& stmt) override {
+        ++dispatches;
+        VM::visit_expression_stmt(stmt);
+    }
+    void visit_print_stmt(tl::PrintStmt& stmt) override {
+        ++dispatches;
+        VM::visit_print_stmt(stmt);
+    }
+    void visit_let_stmt(tl::LetStmt& stmt) override {
+        ++dispatches;
+        VM::visit_let_stmt(stmt);
+    }
+    void visit_block_stmt(tl::BlockStmt& stmt) override {
+        ++dispatches;
+        VM::visit_block_stmt(stmt);
+    }
+    void visit_if_stmt(tl::IfStmt& stmt) override {
+        ++dispatches;
+        VM::visit_if_stmt(stmt);
+    }
+    void visit_while_stmt(tl::WhileStmt& stmt) override {
+        ++dispatches;
+        VM::visit_while_stmt(stmt);
+    }
+    void visit_fused_while_stmt(tl::FusedWhileStmt& stmt) override {
+        ++dispatches;
+        VM::visit_fused_while_stmt(stmt);
+    }
+    void visit_counted_loop_stmt(tl::CountedLoopStmt& stmt) override {
+        ++dispatches;
+        VM::visit_counted_loop_stmt(stmt);
+    }
+};
+
+// A counting loop, the shape every fused node comes from.
+std::string counter(std::size_t iterations) {
+    return "{ let i = 0; let sum = 0; while (i < " + std::to_string(iterations) +
+           ") { sum = sum + i; i = i + 1; } print sum; }";
+}
+
+// Branches, a temporary and a global keep part of the work unfused.
+std::string mixed(std::size_t iterations) {
+    return "let total = 0; { let i = 0; let a = 0; while (i < " + std::to_string(iterations) +
+           ") { if (i > 100) a = a + 2; else a = a - 1; let t = i * 2; a = a + t; total = total + a; "
+           "i = i + 1; } print a; } print total;";
+}
+
+void run(const char* name, const std::string& source, int rounds) {
+    std::size_t dispatches[2] = {0, 0};
+    double best[2] = {1e100, 1e100};
+    for (int fused = 0; fused < 2; ++fused) {
+        for (int round = 0; round < rounds; ++round) {
+            CountingVM vm;
+            vm.set_superinstructions(fused != 0);
+            auto start = std::chrono::steady_clock::now();
+            vm.interpret(source);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (elapsed.count() < best[fused]) best[fused] = elapsed.count();
+            dispatches[fused] = vm.dispatches;
+        }
+    }
+
+    std::printf("dispatch/%s\n", name);
+    std::printf("  plain: %zu dispatches, best of %d: %.3f ms\n", dispatches[0], rounds, best[0] * 1e3);
+    std::printf("  fused: %zu dispatches, best of %d: %.3f ms\n", dispatches[1], rounds, best[1] * 1e3);
+    std::printf("  %.2fx fewer dispatches, %.2fx faster\n",
+                static_cast<double>(dispatches[0]) / static_cast<double>(dispatches[1]), best[0] / best[1]);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    const int rounds = 5;
+    run("counter", counter(iterations), rounds);
+    run("mixed", mixed(iterations), rounds);
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include "tl/document.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+std::string program(std::size_t statements) {
+    std::string source;
+    for (std::size_t i = 0; i < statements; ++i) {
+        std::string name = "v" + std::to_string(i);
+        source += "let " + name + " = " + std::to_string(i) + ";\n";
+        source += "if (" + name + " > 10) {\n    print " + name + " * 2;\n} else {\n    print \"small\";\n}\n";
+    }
+    return source;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::size_t statements = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    const int edits = 2000;
+    std::string source = program(statements);
+
+    auto start = std::chrono::steady_clock::now();
+    tl::Document document(source);
+    std::chrono::duration<double> full = std::chrono::steady_clock::now() - start;
+
+    // Type a digit into a literal and delete it again, walking through the file.
+    std::size_t touched = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < edits; ++i) {
+        std::size_t index = (static_cast<std::size_t>(i) * 7919) % (document.statement_count() - 1);
+        std::size_t offset = document.statement_offset(index) + 1;
+        auto result = document.edit(offset, 0, "1");
+        touched += result.removed;
+        document.edit(offset, 1, "");
+    }
+    std::chrono::duration<double> incremental = std::chrono::steady_clock::now() - start;
+
+    std::printf("document: %zu top-level statements, %.2f MB\n",
+                document.statement_count(), static_cast<double>(source.size()) / 1e6);
+    std::printf("  full lex+parse: %.3f ms\n", full.count() * 1e3);
+    std::printf("  incremental edit: %.2f us/edit, %.2f statements re-parsed/edit\n",
+                incremental.count() * 1e6 / (2 * edits),
+                static_cast<double>(touched) / edits);
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "tl/lexer.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Generated data-table style script: every statement is mostly literals.
+std::string literal_corpus(std::size_t lines) {
+    std::string source;
+    source.reserve(lines * 64);
+    for (std::size_t i = 0; i < lines; ++i) {
+        source += "let v" + std::to_string(i % 1000) + " = ";
+        source += std::to_string(i) + ".25 + ";
+        source += std::to_string(i * 7919 % 100000) + "e-3 * ";
+        source += "1_000_000 - 0x" + std::to_string(i % 9 + 1) + "F + 0b1011;\n";
+    }
+    return source;
+}
+
+void report(const char* name, const std::string& source,
+            const std::function<std::size_t(tl::Lexer&)>& tokenize) {
+    const int rounds = 5;
+    double best = 1e100;
+    std::size_t tokens = 0;
+    for (int round = 0; round < rounds; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        tl::Lexer lexer(source);
+        tokens = tokenize(lexer);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() < best) best = elapsed.count();
+    }
+    std::printf("  %-10s best of %d: %.3f ms, %.1f Mtok/s, %.1f MB/s (%zu tokens)\n",
+                name, rounds, best * 1e3, static_cast<double>(tokens) / best / 1e6,
+                static_cast<double>(source.size()) / best / 1e6, tokens);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::size_t lines = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    std::string source = literal_corpus(lines);
+    tl::ThreadPool pool;
+
+    std::printf("lexer/literals: %zu lines, %.2f MB, %zu threads\n",
+                lines, static_cast<double>(source.size()) / 1e6, pool.size());
+    report("serial", source, [](tl::Lexer& lexer) { return lexer.tokenize().size(); });
+    report("parallel", source, [&pool](tl::Lexer& lexer) { return lexer.tokenize_parallel(pool).size(); });
+    report("compact", source, [](tl::Lexer& lexer) { return lexer.tokenize_compact().size(); });
+
+    std::size_t vector_bytes = 0;
+    for (const auto& token : tl::Lexer(source).tokenize()) {
+        vector_bytes += sizeof(token);
+        if (token.lexeme.capacity() > 15) vector_bytes += token.lexeme.capacity() + 1;
+    }
+    std::size_t compact_bytes = tl::Lexer(source).tokenize_compact().memory_usage();
+    std::printf("  token memory: vector<Token> %.1f MB, TokenBuffer %.1f MB (%.1fx smaller)\n",
+                static_cast<double>(vector_bytes) / 1e6, static_cast<double>(compact_bytes) / 1e6,
+                static_cast<double>(vector_bytes) / static_cast<double>(compact_bytes));
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "tl/lexer.hpp"
+#include "tl/parser.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+// Expression-heavy script exercising every precedence level.
+std::string expression_corpus(std::size_t lines) {
+    std::string source;
+    for (std::size_t i = 0; i < lines; ++i) {
+        std::string n = std::to_string(i % 97);
+        source += "let e" + n + " = (a + " + n + ") * b - c / 2 < d and !(x == " + n +
+                  ") or -y >= z + 1 * 2 - 3;\n";
+    }
+    return source;
+}
+
+// Lint-style input where three statements in four have a syntax error.
+std::string error_corpus(std::size_t lines) {
+    std::string source;
+    for (std::size_t i = 0; i < lines; ++i) {
+        std::string n = std::to_string(i % 97);
+        switch (i % 4) {
+            case 0: source += "let = " + n + " + a;\n"; break;
+            case 1: source += "print (a + " + n + " * b;\n"; break;
+            case 3: source += "a + " + n + " = b;\n"; break;
+            default: source += "let e" + n + " = a * " + n + ";\n"; break;
+        }
+    }
+    return source;
+}
+
+// Best time of `rounds` parses of `tokens`; a null pool means parse().
+double run(const char* name, const tl::TokenBuffer& tokens, tl::ThreadPool* pool, int rounds) {
+    double best = 1e100;
+    std::size_t statements = 0;
+    std::size_t errors = 0;
+    for (int round = 0; round < rounds; ++round) {
+        tl::TokenBuffer copy = tokens;
+        auto start = std::chrono::steady_clock::now();
+        tl::Parser parser(std::move(copy));
+        statements = (pool ? parser.parse_parallel(*pool) : parser.parse()).size();
+        errors = parser.diagnostics().size();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() < best) best = elapsed.count();
+    }
+
+    std::printf("parser/%s: %zu statements, %zu errors, %zu tokens\n", name, statements, errors, tokens.size());
+    std::printf("  best of %d: %.3f ms, %.1f Mtok/s\n",
+                rounds, best * 1e3, static_cast<double>(tokens.size()) / best / 1e6);
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::size_t lines = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    const int rounds = 5;
+    tl::TokenBuffer expressions = tl::Lexer(expression_corpus(lines)).tokenize_compact();
+    double serial = run("expressions", expressions, nullptr, rounds);
+
+    tl::ThreadPool pool;
+    double parallel = run("expressions-parallel", expressions, &pool, rounds);
+    std::printf("  %zu threads: %.2fx\n", pool.size(), serial / parallel);
+
+    run("errors", tl::Lexer(error_corpus(lines)).tokenize_compact(), nullptr, rounds);
+    return 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "ast.hpp"
+
+#include <string>
+#include <vector>
+
+namespace tl {
+
+// Translates a program without syntax errors into a C++ translation unit
+// whose main() runs it, printing the same output and errors as `tl`. The
+// result includes "tl/runtime.hpp" and links against tinylang_runtime.
+// Block locals become C++ locals, so `program` is resolved first.
+std::string compile_to_cpp(std::vector<StmtPtr>& program);
+
+} // namespace tl
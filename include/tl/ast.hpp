@@ -1,8 +1,11 @@
 #pragma once
 
+#include "builtins.hpp"
+#include "ops.hpp"
 #include "token.hpp"
 #include "value.hpp"
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -12,6 +15,17 @@ namespace tl {
 class ExprVisitor;
 class StmtVisitor;
 
+// Slot of a variable in its unit's frame, assigned by the Resolver to
+// block-local variables; globals keep no_frame_slot.
+constexpr std::uint32_t no_frame_slot = ~0u;
+
+// The VM's last lookup of a global at one access site: its storage, or null
+// if it was undefined. Valid while the VM's global version is `version`.
+struct GlobalCache {
+    Value* value = nullptr;
+    std::uint64_t version = 0;
+};
+
 class Expr {
 public:
     virtual ~Expr() = default;
@@ -34,6 +48,8 @@ public:
     Value accept(ExprVisitor& visitor) override;
 
     std::string name;
+    std::uint32_t slot = no_frame_slot;
+    GlobalCache global;
 };
 
 class UnaryExpr : public Expr {
@@ -65,6 +81,88 @@ public:
 
     std::string name;
     std::unique_ptr<Expr> value;
+    std::uint32_t slot = no_frame_slot;
+    GlobalCache global;
+};
+
+// A call of a builtin, with its arguments evaluated left to right.
+class CallExpr : public Expr {
+public:
+    CallExpr(Builtin builtin, std::vector<std::unique_ptr<Expr>> arguments);
+
+    Value accept(ExprVisitor& visitor) override;
+
+    Builtin builtin;
+    std::vector<std::unique_ptr<Expr>> arguments;
+};
+
+// Evaluates `value` and keeps the result in temporary `slot` for later
+// TempLoadExprs; inserted by common-subexpression elimination.
+class TempStoreExpr : public Expr {
+public:
+    TempStoreExpr(std::unique_ptr<Expr> value, std::size_t slot);
+
+    Value accept(ExprVisitor& visitor) override;
+
+    std::unique_ptr<Expr> value;
+    std::size_t slot;
+};
+
+// Reads temporary `slot` instead of re-evaluating an expression equal to
+// `source`, which the matching TempStoreExpr owns.
+class TempLoadExpr : public Expr {
+public:
+    TempLoadExpr(std::size_t slot, const Expr* source);
+
+    Value accept(ExprVisitor& visitor) override;
+
+    std::size_t slot;
+    const Expr* source;
+};
+
+// An operand of a fused node: local `slot`, or `constant` if the slot is
+// no_frame_slot. Neither can fail to read.
+struct FusedOperand {
+    std::uint32_t slot = no_frame_slot;
+    Value constant;
+};
+
+// Superinstructions, built by SuperinstructionFuser after resolution.
+
+// A binary operator whose operands are locals or literals.
+class FusedBinaryExpr : public Expr {
+public:
+    FusedBinaryExpr(BinaryOp op, FusedOperand left, FusedOperand right);
+
+    Value accept(ExprVisitor& visitor) override;
+
+    BinaryOp op;
+    FusedOperand left;
+    FusedOperand right;
+};
+
+// `x = x op operand` on local `slot`, updating it in place; op is
+// arithmetic.
+class FusedAssignExpr : public Expr {
+public:
+    FusedAssignExpr(std::uint32_t slot, BinaryOp op, FusedOperand right);
+
+    Value accept(ExprVisitor& visitor) override;
+
+    std::uint32_t slot;
+    BinaryOp op;
+    FusedOperand right;
+};
+
+// Stands in for an expression that failed to parse; `diagnostic` indexes
+// the parser's diagnostics.
+class ErrorExpr : public Expr {
+public:
+    explicit ErrorExpr(std::size_t diagnostic);
+
+    Value accept(ExprVisitor& visitor) override;
+
+    std::size_t diagnostic;
 };
 
 class Stmt {
@@ -99,6 +197,7 @@ public:
 
     std::string name;
     std::unique_ptr<Expr> initializer;
+    std::uint32_t slot = no_frame_slot;
 };
 
 class BlockStmt : public Stmt {
@@ -133,6 +232,50 @@ public:
     std::unique_ptr<Stmt> body;
 };
 
+// A loop whose condition is a comparison, tested without producing a Value.
+class FusedWhileStmt : public Stmt {
+public:
+    FusedWhileStmt(std::unique_ptr<FusedBinaryExpr> condition, std::unique_ptr<Stmt> body);
+
+    void accept(StmtVisitor& visitor) override;
+
+    std::unique_ptr<FusedBinaryExpr> condition;
+    std::unique_ptr<Stmt> body;
+};
+
+// A fused loop `while (i < n) { ... }` whose body only adds to or subtracts
+// from locals: the counter `i` a constant, every other local an amount the
+// loop does not change, or the counter itself. When the operands are
+// integers small enough for every sum to be exact, the VM applies all
+// iterations at once; otherwise it runs `loop`.
+class CountedLoopStmt : public Stmt {
+public:
+    struct Step {
+        std::uint32_t slot;
+        BinaryOp op;         // ADD or SUBTRACT
+        FusedOperand amount; // the counter's slot, or loop-invariant
+        bool after_counter;  // whether it runs after the counter steps
+    };
+
+    CountedLoopStmt(std::unique_ptr<FusedWhileStmt> loop, double stride, std::vector<Step> steps);
+
+    void accept(StmtVisitor& visitor) override;
+
+    std::unique_ptr<FusedWhileStmt> loop;
+    double stride; // what the counter changes by per iteration
+    std::vector<Step> steps;
+};
+
+// A statement the parser skipped while recovering from a syntax error.
+class ErrorStmt : public Stmt {
+public:
+    explicit ErrorStmt(std::size_t diagnostic);
+
+    void accept(StmtVisitor& visitor) override;
+
+    std::size_t diagnostic;
+};
+
 class ExprVisitor {
 public:
     virtual ~ExprVisitor() = default;
@@ -141,6 +284,12 @@ public:
     virtual Value visit_unary_expr(UnaryExpr& expr) = 0;
     virtual Value visit_binary_expr(BinaryExpr& expr) = 0;
     virtual Value visit_assign_expr(AssignExpr& expr) = 0;
+    virtual Value visit_call_expr(CallExpr& expr) = 0;
+    virtual Value visit_temp_store_expr(TempStoreExpr& expr) = 0;
+    virtual Value visit_temp_load_expr(TempLoadExpr& expr) = 0;
+    virtual Value visit_fused_binary_expr(FusedBinaryExpr& expr) = 0;
+    virtual Value visit_fused_assign_expr(FusedAssignExpr& expr) = 0;
+    virtual Value visit_error_expr(ErrorExpr& expr) = 0;
 };
 
 class StmtVisitor {
@@ -152,10 +301,17 @@ public:
     virtual void visit_block_stmt(BlockStmt& stmt) = 0;
     virtual void visit_if_stmt(IfStmt& stmt) = 0;
     virtual void visit_while_stmt(WhileStmt& stmt) = 0;
+    virtual void visit_fused_while_stmt(FusedWhileStmt& stmt) = 0;
+    virtual void visit_counted_loop_stmt(CountedLoopStmt& stmt) = 0;
+    virtual void visit_error_stmt(ErrorStmt& stmt) = 0;
 };
 
 using StmtPtr = std::unique_ptr<Stmt>;
 using ExprPtr = std::unique_ptr<Expr>;
 
+// Source text that parses back to `program`, one statement per line.
+// Nodes that only passes create, such as fused ones, are not supported.
+std::string to_source(const std::vector<StmtPtr>& program);
+
 } // namespace tl
 
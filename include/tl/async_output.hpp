@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+
+namespace tl {
+
+// A stream buffer whose bytes a dedicated thread passes on to `sink`, so
+// the thread printing does not wait on a slow reader. The put area is a
+// chunk of a fixed ring with one producer, the thread writing to this
+// buffer, and one consumer, the writer; the ring itself takes no lock.
+// When it is full the producer waits for room. sync() returns once every
+// byte put so far has reached the sink and the sink has been synced, and
+// the destructor drains the ring before joining the writer.
+class AsyncOutputBuffer : public std::streambuf {
+public:
+    static constexpr std::size_t ring_size = std::size_t{1} << 20;
+    // Bytes the producer fills before the writer sees them.
+    static constexpr std::size_t chunk_size = std::size_t{1} << 16;
+
+    explicit AsyncOutputBuffer(std::streambuf* sink);
+    ~AsyncOutputBuffer() override;
+
+    AsyncOutputBuffer(const AsyncOutputBuffer&) = delete;
+    AsyncOutputBuffer& operator=(const AsyncOutputBuffer&) = delete;
+
+    std::streambuf* sink() const;
+
+protected:
+    int_type overflow(int_type ch) override;
+    int sync() override;
+
+private:
+    std::streambuf* sink_;
+    std::unique_ptr<char[]> ring_;
+    // Bytes ever published and ever written; ring positions are these
+    // modulo ring_size.
+    std::atomic<std::size_t> head_{0};
+    std::atomic<std::size_t> tail_{0};
+    std::atomic<bool> failed_{false};
+    // Only for sleeping while the ring is empty or full.
+    std::mutex mutex_;
+    std::condition_variable writer_wake_;
+    std::condition_variable producer_wake_;
+    std::atomic<bool> writer_waiting_{false};
+    std::atomic<bool> producer_waiting_{false};
+    bool stopping_ = false;
+    std::thread writer_;
+
+    void publish();
+    void claim();
+    void run();
+};
+
+} // namespace tl
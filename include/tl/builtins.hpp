@@ -0,0 +1,38 @@
+#pragma once
+
+#include "value.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace tl {
+
+// The functions a call can name; there are no user-defined ones.
+enum class Builtin : std::uint8_t {
+    READLINE, // readline([path]): the next line, without its '\n'; nil at the end
+    LINES,    // lines([path]): how many lines readline has returned from that input
+    READFILE  // readfile(path): the whole file as one string
+};
+
+// No builtin takes more arguments than this.
+constexpr std::size_t max_builtin_arguments = 1;
+
+struct BuiltinInfo {
+    const char* name;
+    std::size_t min_arguments;
+    std::size_t max_arguments;
+};
+
+const BuiltinInfo& builtin_info(Builtin builtin);
+
+// The builtin called `name`, if there is one.
+bool find_builtin(std::string_view name, Builtin& builtin);
+
+// Runs `builtin` on `count` arguments, which the parser has checked
+// against its arity. Without a path, input is stdin. readline reads every
+// input through one large buffer that stays open for later calls; readfile
+// reads the file straight into the string it returns.
+Value call_builtin(Builtin builtin, const Value* arguments, std::size_t count);
+
+} // namespace tl
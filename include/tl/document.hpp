@@ -0,0 +1,72 @@
+#pragma once
+
+#include "ast.hpp"
+#include "parser.hpp"
+#include "token.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tl {
+
+// Top-level statements replaced by an edit: statements [first, first + removed)
+// of the old document became [first, first + inserted) of the new one. Every
+// statement outside that range kept its tokens and AST.
+struct EditResult {
+    std::size_t first;
+    std::size_t removed;
+    std::size_t inserted;
+};
+
+// A source buffer kept lexed and parsed across edits. The text is split into
+// one segment per top-level statement (leading whitespace and comments
+// included), plus a final segment holding whatever follows the last complete
+// statement. An edit only re-lexes and re-parses the segments it touches,
+// growing the region when the edit leaves brackets or a string unbalanced.
+class Document {
+public:
+    explicit Document(std::string source = "");
+
+    // Replaces `length` bytes at `offset` with `replacement`.
+    EditResult edit(std::size_t offset, std::size_t length, std::string_view replacement);
+
+    std::string text() const;
+    std::size_t size() const;
+
+    // The last statement is the trailing segment and may be unfinished.
+    // Token and diagnostic lines count from the statement's first line, and
+    // columns on that line from the statement's offset.
+    std::size_t statement_count() const;
+    const std::vector<StmtPtr>& statements(std::size_t index) const;
+    const std::vector<Token>& tokens(std::size_t index) const;
+    const std::vector<Diagnostic>& diagnostics(std::size_t index) const;
+    std::size_t statement_offset(std::size_t index) const;
+    int statement_line(std::size_t index) const;
+
+    // Lexer error for the trailing segment, empty when it lexed cleanly.
+    const std::string& error() const;
+
+private:
+    struct Segment {
+        int newlines;
+        std::string text;
+        std::vector<Token> tokens; // lines relative to the segment
+        std::vector<StmtPtr> statements;
+        std::vector<Diagnostic> diagnostics;
+        std::string error;
+    };
+
+    // Positions are kept apart from the segments so that shifting everything
+    // after an edit only walks two flat arrays.
+    std::vector<Segment> segments_;
+    std::vector<std::size_t> offsets_;
+    std::vector<int> lines_;
+
+    std::size_t segment_at(std::size_t offset) const;
+    bool relex(const std::string& text, int line, bool at_end, const Segment* next,
+               std::vector<Segment>& out) const;
+    static Segment make_segment(std::string text, std::vector<Token> tokens);
+};
+
+} // namespace tl
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "ast.hpp"
+#include "ops.hpp"
+#include "value.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tl {
+
+enum class ExprKind : std::uint8_t {
+    LITERAL,
+    VARIABLE,
+    UNARY,
+    BINARY,
+    ASSIGN,
+    CALL
+};
+
+enum class StmtKind : std::uint8_t {
+    EXPRESSION,
+    PRINT,
+    LET,
+    BLOCK,
+    IF,
+    WHILE
+};
+
+// A 32-bit node reference: the node kind in the top bits and the index into
+// that kind's pool below. An all-ones value means "no node".
+template <typename Kind>
+struct NodeRef {
+    static constexpr unsigned index_bits = 29;
+    static constexpr std::uint32_t index_mask = (1u << index_bits) - 1;
+
+    std::uint32_t bits = ~0u;
+
+    NodeRef() = default;
+    NodeRef(Kind kind, std::uint32_t index)
+        : bits((static_cast<std::uint32_t>(kind) << index_bits) | index) {}
+
+    bool empty() const { return bits == ~0u; }
+    Kind kind() const { return static_cast<Kind>(bits >> index_bits); }
+    std::uint32_t index() const { return bits & index_mask; }
+    bool operator==(NodeRef other) const { return bits == other.bits; }
+};
+
+using ExprRef = NodeRef<ExprKind>;
+using StmtRef = NodeRef<StmtKind>;
+
+struct FlatUnary {
+    ExprRef operand;
+    UnaryOp op;
+};
+
+struct FlatBinary {
+    ExprRef left;
+    ExprRef right;
+    BinaryOp op;
+};
+
+struct FlatAssign {
+    std::uint32_t name;
+    ExprRef value;
+};
+
+struct FlatCall {
+    std::uint32_t first; // into FlatAst::call_arguments
+    std::uint32_t count;
+    Builtin builtin;
+};
+
+struct FlatLet {
+    std::uint32_t name;
+    ExprRef initializer;
+};
+
+struct FlatBlock {
+    std::uint32_t first; // into FlatAst::block_items
+    std::uint32_t count;
+};
+
+struct FlatIf {
+    ExprRef condition;
+    StmtRef then_branch;
+    StmtRef else_branch;
+};
+
+struct FlatWhile {
+    ExprRef condition;
+    StmtRef body;
+};
+
+// The AST as typed, contiguous node pools. Children are referenced by index,
+// variable names are interned once and operators are stored as bytes, so a
+// program is a handful of flat arrays: walking a pool touches memory
+// sequentially, serializing needs no pointer fix-ups and freeing the tree is
+// freeing the vectors.
+struct FlatAst {
+    std::vector<std::string> names;
+
+    std::vector<Value> literals;
+    std::vector<std::uint32_t> variables; // name index per VARIABLE node
+    std::vector<FlatUnary> unaries;
+    std::vector<FlatBinary> binaries;
+    std::vector<FlatAssign> assigns;
+    std::vector<FlatCall> calls;
+
+    std::vector<ExprRef> expression_stmts;
+    std::vector<ExprRef> print_stmts;
+    std::vector<FlatLet> lets;
+    std::vector<FlatBlock> blocks;
+    std::vector<FlatIf> ifs;
+    std::vector<FlatWhile> whiles;
+
+    std::vector<ExprRef> call_arguments;
+    std::vector<StmtRef> block_items;
+    std::vector<StmtRef> program; // top-level statements
+
+    std::size_t node_count() const;
+};
+
+// Error nodes left by a failed parse become empty references.
+FlatAst flatten(const std::vector<StmtPtr>& program);
+std::vector<StmtPtr> unflatten(const FlatAst& ast);
+
+// Compact little-endian binary form. deserialize() validates every reference
+// and throws std::runtime_error on malformed input.
+std::string serialize(const FlatAst& ast);
+FlatAst deserialize(std::string_view bytes);
+
+} // namespace tl
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "ast.hpp"
+#include "ops.hpp"
+#include "value.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace tl {
+
+// SSA intermediate representation. A unit of top-level statements lowers to
+// one IrFunction: a control-flow graph of basic blocks whose instructions
+// each define at most one value, named by its index in `values`.
+//
+// Locals are pure SSA values. Globals outlive the unit, so every write to
+// one is also stored through to the global table; reads of a global that
+// is known to exist use the SSA value, and the rest load from the table,
+// which reports undefined variables exactly as the tree-walker does.
+
+using ValueId = std::uint32_t;
+using BlockId = std::uint32_t;
+
+constexpr ValueId no_value = ~0u;
+constexpr BlockId no_block = ~0u;
+constexpr std::uint32_t no_name = ~0u;
+
+// What a value holds whenever the instruction defining it completes. NONE
+// is "not known yet" while inference runs.
+enum class IrType : std::uint8_t {
+    NONE,
+    NIL,
+    NUMBER,
+    BOOL,
+    STRING,
+    ANY
+};
+
+IrType type_of(const Value& value);
+const char* to_string(IrType type);
+
+enum class IrOpcode : std::uint8_t {
+    CONST,         // constants[index]
+    PHI,           // one operand per predecessor, in predecessor order
+    UNARY,         // op is a UnaryOp
+    BINARY,        // op is a BinaryOp
+    NUMBER_UNARY,  // UNARY on a number, unchecked
+    NUMBER_BINARY, // BINARY on two numbers, unchecked but for division by zero
+    CONCAT,        // ADD on two strings, unchecked
+    LOAD_GLOBAL,   // globals[index]; op is 1 if it may be undefined
+    STORE_GLOBAL,  // globals[index] = operand; op is 1 if it may be undefined
+    DEFINE_GLOBAL, // globals[index] = operand, creating it if needed
+    PRINT,
+    CALL,          // builtin op on the operands
+    JUMP,          // to successors[0]
+    BRANCH,        // to successors[0] if the operand is truthy, else successors[1]
+    RETURN
+};
+
+struct IrInstruction {
+    IrOpcode opcode;
+    std::uint8_t op = 0;
+    BlockId block = 0;
+    std::uint32_t index = 0;
+    std::vector<ValueId> operands;
+    // Set when the instruction is removed; uses then read this value.
+    ValueId replacement = no_value;
+    // Set by TypeSpecialization; lowering sets it for loads of globals that
+    // exist, from their value at that time.
+    IrType type = IrType::ANY;
+    // The variable first assigned this value, as an index into names.
+    std::uint32_t name = no_name;
+};
+
+struct IrBlock {
+    std::vector<ValueId> phis;
+    std::vector<ValueId> instructions; // the last one is the terminator
+    std::vector<BlockId> predecessors;
+    std::vector<BlockId> successors;
+};
+
+struct IrFunction {
+    std::vector<IrInstruction> values;
+    std::vector<IrBlock> blocks; // blocks[0] is the entry
+    std::vector<Value> constants;
+    std::vector<std::string> globals;
+    std::vector<std::string> names;
+
+    ValueId add(BlockId block, IrOpcode opcode, std::vector<ValueId> operands = {}, std::uint8_t op = 0,
+                std::uint32_t index = 0);
+    BlockId add_block();
+    void add_edge(BlockId from, BlockId to);
+
+    // Removes the edge's entry in `to`'s predecessors and phis.
+    void remove_edge(BlockId from, BlockId to);
+
+    // Redirects every use of `from` to `to`; operands are rewritten lazily,
+    // so passes read them through resolve().
+    void replace(ValueId from, ValueId to);
+    ValueId resolve(ValueId id) const;
+    void canonicalize();
+
+    // Blocks reachable from the entry, in reverse post-order.
+    std::vector<BlockId> reverse_post_order() const;
+
+    // Immediate dominator of every block, given reverse_post_order(). The
+    // entry is its own dominator; unreachable blocks get no_block.
+    std::vector<BlockId> dominators(const std::vector<BlockId>& order) const;
+};
+
+// Lowers a parsed program. `globals` is the global table the program will
+// run against, right away: names already defined there are known to exist,
+// with the types of their current values.
+IrFunction lower_to_ir(const std::vector<StmtPtr>& program,
+                       const std::unordered_map<std::string, Value>& globals);
+
+// Runs `function` against `globals`. Operands must be canonical.
+void execute(const IrFunction& function, std::unordered_map<std::string, Value>& globals);
+
+// Textual form for debugging, one instruction per line.
+std::string to_string(const IrFunction& function);
+
+} // namespace tl
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "ir.hpp"
+
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+namespace tl {
+
+// The type of every value. Each assignment to a variable is its own SSA
+// value, so a variable can be a number in one place and a string in another.
+std::vector<IrType> infer_types(const IrFunction& function);
+
+// Whether `instruction` can raise a runtime error given operand types.
+bool may_throw(const IrFunction& function, const IrInstruction& instruction, const std::vector<IrType>& types);
+
+class IrPass {
+public:
+    virtual ~IrPass() = default;
+    virtual const char* name() const = 0;
+    virtual void run(IrFunction& function) = 0;
+};
+
+// Folds operators on constants, removes trivial phis, turns branches on
+// constants into jumps and drops the blocks that become unreachable.
+class ConstantPropagation : public IrPass {
+public:
+    const char* name() const override { return "constprop"; }
+    void run(IrFunction& function) override;
+};
+
+// Removes instructions whose values are unused and that cannot fail.
+class DeadCodeElimination : public IrPass {
+public:
+    const char* name() const override { return "dce"; }
+    void run(IrFunction& function) override;
+};
+
+// Replaces an instruction with an equal one that dominates it.
+class GlobalValueNumbering : public IrPass {
+public:
+    const char* name() const override { return "gvn"; }
+    void run(IrFunction& function) override;
+};
+
+// Moves constants and operators that cannot fail out of loops whose
+// operands are all defined outside them.
+class LoopInvariantCodeMotion : public IrPass {
+public:
+    const char* name() const override { return "licm"; }
+    void run(IrFunction& function) override;
+};
+
+// Records inferred types on instructions and turns operators whose
+// operand types are proven into their unchecked forms.
+class TypeSpecialization : public IrPass {
+public:
+    const char* name() const override { return "types"; }
+    void run(IrFunction& function) override;
+};
+
+// Runs passes in order and keeps the time spent in each across runs.
+class PassManager {
+public:
+    void add(std::unique_ptr<IrPass> pass);
+    void run(IrFunction& function);
+
+    void report(std::ostream& out) const;
+
+private:
+    struct Entry {
+        std::unique_ptr<IrPass> pass;
+        std::chrono::steady_clock::duration time{};
+        std::size_t runs = 0;
+    };
+
+    std::vector<Entry> passes_;
+};
+
+// constprop, gvn, licm, dce, types.
+PassManager default_pipeline();
+
+// Lists every value assigned to a variable with its type and the reason
+// for it, e.g. which phi operands made it `any`. Reads the types recorded
+// by TypeSpecialization.
+std::string explain_types(const IrFunction& function);
+
+} // namespace tl
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "reg.hpp"
+#include "value.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace tl {
+
+// Whether this build can compile traces to native code (x86-64 Linux).
+bool jit_supported();
+
+// A tracing JIT for register code. Every backward jump counts against its
+// target, a loop header; once a header is hot, the instructions of the
+// next iteration are recorded, and if they only compute on numbers and
+// booleans the trace is compiled to x86-64. Later iterations enter the
+// native loop instead, with the registers and globals it touches unboxed
+// into doubles. A branch that goes the other way than it did while
+// recording, or a division by zero, leaves through a side exit that boxes
+// the values again and resumes the interpreter at that instruction.
+//
+// Loops whose iteration prints, nests another loop, or touches strings or
+// nil are left to the interpreter.
+class TraceJit {
+public:
+    explicit TraceJit(RegProgram& program);
+    ~TraceJit();
+
+    TraceJit(const TraceJit&) = delete;
+    TraceJit& operator=(const TraceJit&) = delete;
+
+    bool recording() const { return recording_ != no_pc; }
+
+    // Called while recording, before the instruction at `pc` runs.
+    void record(std::uint32_t pc, const Value* registers, std::unordered_map<std::string, Value>& globals);
+
+    // Called on every backward jump to `header`, before it is taken.
+    // Returns the pc to continue at: `header`, or where a trace left off.
+    std::uint32_t back_edge(std::uint32_t header, Value* registers);
+
+private:
+    static constexpr std::uint32_t no_pc = ~0u;
+    static constexpr std::uint32_t hot_loop = 40;
+    static constexpr std::size_t max_trace = 256;
+
+    // One recorded instruction, with globals as registers past the end
+    // of the register file.
+    struct TraceOp {
+        RegOpcode opcode; // JUMP_IF_FALSE is a guard on `left`
+        std::uint32_t dest;
+        std::uint32_t left;
+        std::uint32_t right;
+        std::uint32_t exit_pc; // where a side exit taken here resumes
+        bool truthy;           // the guard's direction while recording
+    };
+
+    struct Trace;
+
+    struct Loop {
+        std::uint32_t count = 0;
+        bool blacklisted = false;
+        std::unique_ptr<Trace> trace;
+    };
+
+    RegProgram& program_;
+    std::vector<Loop> loops_; // by header pc
+
+    std::uint32_t recording_ = no_pc;
+    std::vector<TraceOp> ops_;
+    // Kind of the value each register read before any write held when
+    // recording began; globals also keep their storage.
+    std::unordered_map<std::uint32_t, bool> entry_is_number_;
+    std::unordered_map<std::uint32_t, Value*> global_storage_;
+    std::vector<bool> written_;
+
+    void abort();
+    bool capture(std::uint32_t reg, const Value& value);
+    std::unique_ptr<Trace> compile();
+};
+
+} // namespace tl
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "thread_pool.hpp"
 #include "token.hpp"
+#include "token_buffer.hpp"
 
+#include <istream>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -10,31 +13,84 @@ namespace tl {
 
 class Lexer {
 public:
-    explicit Lexer(std::string source);
+    // `line` and `column` locate the first character of `source`.
+    explicit Lexer(std::string source, int line = 1, int column = 1);
+
+    // Streaming mode: source text is pulled from `input` in chunks of
+    // `chunk_size` bytes, so only the unconsumed tail of the current chunk
+    // and the token being scanned are held in memory.
+    explicit Lexer(std::istream& input, std::size_t chunk_size = 64 * 1024);
 
     std::vector<Token> tokenize();
 
+    // Tokenizes into the compact struct-of-arrays form. The source text is
+    // moved into the returned buffer, so the lexer is spent afterwards.
+    TokenBuffer tokenize_compact();
+
+    // Same result as tokenize_compact(), but the source is cut at line breaks
+    // into chunks of roughly `chunk_size` bytes that are lexed on `pool`.
+    // Falls back to tokenize_compact() for small or streamed input.
+    TokenBuffer tokenize_parallel(ThreadPool& pool, std::size_t chunk_size = 256 * 1024);
+
+    // Scans and returns the next token; END_OF_FILE once input is exhausted.
+    Token next_token();
+
+    // Byte offset in the input just past the most recently scanned token.
+    std::size_t position() const;
+
+    // Hands back the source text, e.g. to lex it again from the start after
+    // tokenize_parallel() failed. The lexer is spent afterwards.
+    std::string release_source();
+
 private:
     std::string source_;
     std::size_t start_;
     std::size_t current_;
     int line_;
+    std::size_t consumed_;
+    std::ptrdiff_t line_start_; // input offset of the current line's first byte
+    int column_;                // column of the token being scanned
+
+    std::istream* input_;
+    std::size_t chunk_size_;
 
     std::vector<Token> tokens_;
+    TokenBuffer* compact_;
+    std::string error_;
+
+    struct Chunk {
+        std::size_t begin = 0; // where in source_ lexing started
+        TokenBuffer tokens;    // offsets and lines relative to begin
+        int newlines = 0;
+        std::size_t open_string = std::string::npos; // unterminated '"' at chunk end
+        std::string error;
+        int error_line = 0;
+    };
+    Chunk lex_chunk(std::size_t begin, std::size_t end, int line, int column = 1) const;
 
-    bool is_at_end() const;
+    bool is_at_end();
+    bool refill();
     char advance();
-    char peek() const;
-    char peek_next() const;
+    char peek();
+    char peek_next();
+    char peek_at(std::size_t ahead);
     bool match(char expected);
 
     void scan_token();
     void string();
     void number();
+    void radix_number(int radix);
+    bool digits(bool (Lexer::*is_valid)(char) const);
     void identifier();
     void add_token(TokenType type, Literal literal = {});
+    void newline();
+    int column_of(std::size_t index) const;
+    int column_at(std::size_t offset) const;
+    [[noreturn]] void error(const std::string& message);
 
     bool is_digit(char c) const;
+    bool is_hex_digit(char c) const;
+    bool is_binary_digit(char c) const;
     bool is_alpha(char c) const;
     bool is_alphanumeric(char c) const;
 
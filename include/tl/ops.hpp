@@ -0,0 +1,127 @@
+#pragma once
+
+#include "token.hpp"
+#include "value.hpp"
+
+#include <cstdint>
+
+namespace tl {
+
+// Operators as single bytes, for representations that do not keep Tokens.
+enum class UnaryOp : std::uint8_t {
+    NEGATE,
+    NOT
+};
+
+enum class BinaryOp : std::uint8_t {
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    GREATER,
+    GREATER_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    EQUAL,
+    NOT_EQUAL,
+    AND,
+    OR
+};
+
+inline UnaryOp to_unary_op(TokenType type) {
+    return type == TokenType::MINUS ? UnaryOp::NEGATE : UnaryOp::NOT;
+}
+
+inline BinaryOp to_binary_op(TokenType type) {
+    switch (type) {
+        case TokenType::PLUS: return BinaryOp::ADD;
+        case TokenType::MINUS: return BinaryOp::SUBTRACT;
+        case TokenType::STAR: return BinaryOp::MULTIPLY;
+        case TokenType::SLASH: return BinaryOp::DIVIDE;
+        case TokenType::GREATER: return BinaryOp::GREATER;
+        case TokenType::GREATER_EQUAL: return BinaryOp::GREATER_EQUAL;
+        case TokenType::LESS: return BinaryOp::LESS;
+        case TokenType::LESS_EQUAL: return BinaryOp::LESS_EQUAL;
+        case TokenType::EQUAL_EQUAL: return BinaryOp::EQUAL;
+        case TokenType::BANG_EQUAL: return BinaryOp::NOT_EQUAL;
+        case TokenType::AND: return BinaryOp::AND;
+        default: return BinaryOp::OR;
+    }
+}
+
+inline TokenType to_token_type(UnaryOp op) {
+    return op == UnaryOp::NEGATE ? TokenType::MINUS : TokenType::BANG;
+}
+
+inline TokenType to_token_type(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::ADD: return TokenType::PLUS;
+        case BinaryOp::SUBTRACT: return TokenType::MINUS;
+        case BinaryOp::MULTIPLY: return TokenType::STAR;
+        case BinaryOp::DIVIDE: return TokenType::SLASH;
+        case BinaryOp::GREATER: return TokenType::GREATER;
+        case BinaryOp::GREATER_EQUAL: return TokenType::GREATER_EQUAL;
+        case BinaryOp::LESS: return TokenType::LESS;
+        case BinaryOp::LESS_EQUAL: return TokenType::LESS_EQUAL;
+        case BinaryOp::EQUAL: return TokenType::EQUAL_EQUAL;
+        case BinaryOp::NOT_EQUAL: return TokenType::BANG_EQUAL;
+        case BinaryOp::AND: return TokenType::AND;
+        case BinaryOp::OR: return TokenType::OR;
+    }
+    return TokenType::OR;
+}
+
+// Operator semantics shared by every execution tier and by constant folding.
+inline Value apply_unary(UnaryOp op, const Value& right) {
+    if (op == UnaryOp::NOT) {
+        return Value{!is_truthy(right)};
+    }
+    if (!std::holds_alternative<double>(right)) {
+        throw RuntimeError("Operand must be a number.");
+    }
+    return Value{-std::get<double>(right)};
+}
+
+inline Value apply_binary(BinaryOp op, const Value& left, const Value& right) {
+    const double* a = std::get_if<double>(&left);
+    const double* b = std::get_if<double>(&right);
+
+    switch (op) {
+        case BinaryOp::ADD:
+            if (a && b) return Value{*a + *b};
+            if (std::holds_alternative<std::string>(left) && std::holds_alternative<std::string>(right)) {
+                return Value{std::get<std::string>(left) + std::get<std::string>(right)};
+            }
+            throw RuntimeError("Operands must be two numbers or two strings.");
+        case BinaryOp::EQUAL:
+            return Value{values_equal(left, right)};
+        case BinaryOp::NOT_EQUAL:
+            return Value{!values_equal(left, right)};
+        case BinaryOp::AND:
+            return Value{is_truthy(left) && is_truthy(right)};
+        case BinaryOp::OR:
+            return Value{is_truthy(left) || is_truthy(right)};
+        default:
+            break;
+    }
+
+    if (!a || !b) {
+        throw RuntimeError("Operands must be numbers.");
+    }
+    switch (op) {
+        case BinaryOp::SUBTRACT: return Value{*a - *b};
+        case BinaryOp::MULTIPLY: return Value{*a * *b};
+        case BinaryOp::DIVIDE:
+            if (*b == 0.0) {
+                throw RuntimeError("Division by zero.");
+            }
+            return Value{*a / *b};
+        case BinaryOp::GREATER: return Value{*a > *b};
+        case BinaryOp::GREATER_EQUAL: return Value{*a >= *b};
+        case BinaryOp::LESS: return Value{*a < *b};
+        case BinaryOp::LESS_EQUAL: return Value{*a <= *b};
+        default: return Value{};
+    }
+}
+
+} // namespace tl
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "ast.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace tl {
+
+// Common-subexpression elimination. Within straight-line code (a run of
+// statements up to the next block, branch or loop), a unary or binary
+// expression structurally equal to one already evaluated, with no
+// assignment or `let` of a variable it reads in between, is replaced by a
+// TempLoadExpr of the first occurrence's value.
+//
+// An instance can be reused so that its tables keep their storage, which
+// matters when it runs once per statement.
+class CommonSubexpressionEliminator {
+public:
+    // Returns the number of expressions replaced.
+    std::size_t run(std::vector<StmtPtr>& program);
+
+private:
+    static constexpr std::size_t no_slot = static_cast<std::size_t>(-1);
+
+    // An expression evaluated earlier in the current region.
+    struct Available {
+        std::size_t hash;
+        const Expr* node;
+        std::size_t slot; // no_slot until a repeat is found
+    };
+
+    struct Def {
+        const Expr* node;
+        std::size_t slot;
+        std::size_t entry; // index into available_ when created
+    };
+
+    struct Use {
+        const Expr* node;
+        std::size_t slot;
+        const Expr* source;
+    };
+
+    std::vector<Available> available_;
+    std::vector<Def> defs_;
+    std::vector<Use> uses_;
+    std::size_t next_slot_ = 0;
+
+    void reset();
+    void kill(const std::string& name);
+    bool visit(const Expr* node, std::size_t& hash);
+    void visit(const Stmt* node);
+    void rewrite(ExprPtr& node);
+    void rewrite(Stmt* node);
+};
+
+// Runs a fresh CommonSubexpressionEliminator over `program`.
+std::size_t eliminate_common_subexpressions(std::vector<StmtPtr>& program);
+
+// A store removed by DeadStoreEliminator.
+struct DeadStore {
+    enum class Kind : std::uint8_t {
+        UNUSED_BINDING,   // a local `let` whose variable is never read
+        DEAD_INITIALIZER, // a `let` initializer overwritten before any read
+        DEAD_ASSIGNMENT   // an assignment to a local that is never read
+    };
+
+    Kind kind;
+    std::string name;
+};
+
+std::string to_string(const DeadStore& store);
+
+// Removes stores to locals that no later read can observe, found by a
+// backward liveness analysis over blocks, branches and loops. Globals are
+// left alone: other statements, and later REPL input, may read them.
+// Assignments lose only the store, their value is still computed; `let`s
+// go entirely when their variable is never read, keeping the initializer
+// as a statement if it may fail or have effects.
+class DeadStoreEliminator {
+public:
+    // Returns the number of stores removed; removed() lists them.
+    std::size_t run(std::vector<StmtPtr>& program);
+    const std::vector<DeadStore>& removed() const { return removed_; }
+
+private:
+    using Live = std::vector<bool>;
+
+    std::vector<DeadStore> removed_;
+    std::vector<std::unordered_map<std::string, std::uint32_t>> scopes_;
+    // Local binding of each VariableExpr, AssignExpr and LetStmt.
+    std::unordered_map<const void*, std::uint32_t> bindings_;
+    std::vector<std::string> names_;
+    std::vector<std::size_t> reads_;
+    std::unordered_set<const void*> dead_;
+    bool recording_ = false;
+
+    void resolve(const Expr* node);
+    void resolve(const Stmt* node);
+    void live(const Expr* node, Live& out);
+    void live(const Stmt* node, Live& out);
+    bool dead(const void* node) const;
+    void rewrite(ExprPtr& node);
+    void rewrite(StmtPtr& node);
+    void rewrite(std::vector<StmtPtr>& statements);
+};
+
+// Runs a fresh DeadStoreEliminator over `program`.
+std::size_t eliminate_dead_stores(std::vector<StmtPtr>& program);
+
+// Replaces common node shapes with superinstructions that the tree-walker
+// dispatches once: a binary operator on locals and literals, `x = x op y`
+// on a local, a loop whose condition is such a comparison, and a counted
+// loop of additive updates, which can run in closed form. Reads
+// frame slots, so it runs after the Resolver, and last: other passes do
+// not know the fused nodes.
+class SuperinstructionFuser {
+public:
+    // Returns the number of nodes fused away.
+    std::size_t run(std::vector<StmtPtr>& program);
+
+private:
+    std::size_t fused_ = 0;
+
+    void fuse(ExprPtr& node);
+    void fuse(StmtPtr& node);
+};
+
+} // namespace tl
@@ -2,37 +2,87 @@
 
 #include "ast.hpp"
 #include "lexer.hpp"
+#include "thread_pool.hpp"
 #include "token.hpp"
+#include "token_buffer.hpp"
 
-#include <stdexcept>
+#include <string>
 #include <vector>
 
 namespace tl {
 
-class ParseError : public std::runtime_error {
-public:
-    explicit ParseError(const std::string& message)
-        : std::runtime_error(message) {}
+// A syntax error and the source span of the token it was reported at.
+struct Diagnostic {
+    std::string message;
+    int line;
+    int column; // 1-based, 0 if the tokens carried no columns
+    int length; // bytes; 0 at end of input
+};
+
+// "line 3, column 7: Expected ';' after value."
+std::string to_string(const Diagnostic& diagnostic);
+
+// Operator binding power, weakest first.
+enum class Precedence {
+    NONE,
+    ASSIGNMENT,
+    OR,
+    AND,
+    EQUALITY,
+    COMPARISON,
+    TERM,
+    FACTOR,
+    UNARY
 };
 
 class Parser {
 public:
     explicit Parser(std::vector<Token> tokens);
+    explicit Parser(TokenBuffer tokens);
+
+    // Pulls tokens from `lexer` on demand instead of taking a full vector.
+    explicit Parser(Lexer& lexer);
 
+    // Never throws on bad syntax: every error is recorded in diagnostics()
+    // and the statement it occurred in is replaced by an ErrorStmt (or, for
+    // an invalid assignment target, the expression by an ErrorExpr).
     std::vector<StmtPtr> parse();
 
+    const std::vector<Diagnostic>& diagnostics() const;
+
+    // Same result as parse(), but the remaining tokens are cut at top-level
+    // statement boundaries into ranges of about `chunk_tokens` tokens that
+    // are parsed on `pool` and concatenated in order. Input with syntax
+    // errors is parsed again serially, so recovery and diagnostics match
+    // parse() exactly. Streaming parsers and small inputs use parse().
+    std::vector<StmtPtr> parse_parallel(ThreadPool& pool, std::size_t chunk_tokens = 64 * 1024);
+
+    // Incremental interface: parses one top-level declaration per call.
+    // With a streaming lexer, tokens of finished declarations are released
+    // so memory stays bounded by the size of the largest statement.
+    bool has_next() const;
+    StmtPtr next();
+
 private:
-    std::vector<Token> tokens_;
+    TokenBuffer tokens_;
     std::size_t current_;
+    Lexer* lexer_;
 
-    const Token& peek() const;
-    const Token& previous() const;
+    // After an error the rest of the statement is parsed in panic mode,
+    // reporting nothing, until declaration() resynchronizes.
+    std::vector<Diagnostic> diagnostics_;
+    bool panic_;
+
+    // Tokens are addressed by index into tokens_.
+    TokenType peek() const;
+    std::size_t previous() const;
     bool is_at_end() const;
 
-    const Token& advance();
+    std::size_t advance();
     bool check(TokenType type) const;
-    bool match(std::initializer_list<TokenType> types);
-    const Token& consume(TokenType type, const std::string& message);
+    bool match(TokenType type);
+    std::size_t consume(TokenType type, const char* message);
+    std::size_t error_at(std::size_t token, const char* message);
 
     // Grammar rules
     StmtPtr declaration();
@@ -45,18 +95,19 @@ private:
     StmtPtr while_statement();
 
     ExprPtr expression();
-    ExprPtr assignment();
-    ExprPtr or_expression();
-    ExprPtr and_expression();
-    ExprPtr equality();
-    ExprPtr comparison();
-    ExprPtr term();
-    ExprPtr factor();
-    ExprPtr unary();
-    ExprPtr primary();
+    ExprPtr parse_precedence(Precedence minimum);
+    ExprPtr prefix();
+    ExprPtr call(std::size_t name);
 
     void synchronize();
 };
 
+// Returns, for every complete top-level statement in `tokens`, the index one
+// past its last token. Statements end at a ';' or a closing '}' outside any
+// brackets, unless an 'else' continues them. Tokens after the last boundary
+// belong to an unfinished statement.
+std::vector<std::size_t> statement_boundaries(const std::vector<Token>& tokens);
+std::vector<std::size_t> statement_boundaries(const TokenBuffer& tokens);
+
 } // namespace tl
 
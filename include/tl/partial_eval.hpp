@@ -0,0 +1,71 @@
+#pragma once
+
+#include "ast.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace tl {
+
+// Specializes a program for globals whose values are given up front.
+// Reads of variables whose value is known become literals, operators on
+// literals are folded, branches on known conditions lose the side not
+// taken, and loops whose condition stays known are unrolled while the
+// residual code stays within max_unrolled statements and
+// max_unrolled_bytes of literals. Folds that would make a string longer
+// than max_literal_bytes are left to run time. Stores are kept, so the
+// residual program leaves every variable as the original would;
+// dead-store elimination removes the ones nothing reads any more.
+//
+// Once an operator that is certain to run is found to fail, say `nil + 1`
+// outside any branch, nothing after it runs: the rest is left as written.
+//
+// Top-level statements can be given one batch at a time, as the VM streams
+// them: what is known carries over from one run to the next.
+class PartialEvaluator {
+public:
+    static constexpr std::size_t max_unrolled = 256;
+    static constexpr std::size_t max_unrolled_bytes = 64 * 1024;
+    static constexpr std::size_t max_literal_bytes = 4096;
+
+    // Binds global `name` to `value`. A top-level `let` of it binds this
+    // value instead of evaluating its initializer.
+    void define(const std::string& name, Value value);
+
+    // Replaces program[first..] with its residual.
+    void run(std::vector<StmtPtr>& program, std::size_t first = 0);
+
+    // Forgets every value learned so far, e.g. after a statement failed
+    // part way through at run time.
+    void reset();
+
+private:
+    using Scope = std::unordered_map<std::string, std::optional<Value>>;
+
+    std::unordered_map<std::string, Value> defines_;
+    // Innermost last; the first holds globals.
+    std::vector<Scope> scopes_{1};
+    // How many branches or loop bodies that may not run enclose the code
+    // being specialized.
+    std::size_t conditional_ = 0;
+    // Set once code certain to run is known to fail.
+    bool fails_ = false;
+
+    std::optional<Value> fold(TokenType op, const Value& operand);
+    std::optional<Value> fold(TokenType op, const Value& left, const Value& right);
+    std::optional<Value> lookup(const std::string& name) const;
+    void assign(const std::string& name, std::optional<Value> value);
+    void forget(const std::unordered_set<std::string>& names);
+    void merge(const std::vector<Scope>& other);
+
+    ExprPtr specialize(const Expr* node);
+    void specialize(const Stmt* node, std::vector<StmtPtr>& out);
+    void specialize_loop(const WhileStmt& loop, std::vector<StmtPtr>& out);
+    bool unroll(const WhileStmt& loop, std::vector<StmtPtr>& out);
+};
+
+} // namespace tl
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "ast.hpp"
+#include "value.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace tl {
+
+// Register-machine code. Every instruction names its source and destination
+// registers directly (three-address form), so `x = x + 1` on a local is one
+// instruction. A unit's registers are laid out as
+//
+//   [0, constant_base - temporaries)   locals, by Resolver slot
+//   [.., constant_base)                temporaries, by linear scan
+//   [constant_base, register_count)    constants, copied in before a run
+//
+// so operands never need to say what kind of register they name.
+
+enum class RegOpcode : std::uint8_t {
+    MOVE,          // a = b
+    NEGATE,        // a = -b
+    NOT,           // a = !b
+    ADD,           // a = b + c, and so on for every BinaryOp
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    GREATER,
+    GREATER_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    EQUAL,
+    NOT_EQUAL,
+    AND,
+    OR,
+    LOAD_GLOBAL,   // a = globals[b]
+    STORE_GLOBAL,  // globals[a] = b; it must exist
+    DEFINE_GLOBAL, // globals[a] = b, creating it if needed
+    PRINT,         // print a
+    CALL,          // a = builtin b()
+    CALL_ARGUMENT, // a = builtin c(b)
+    JUMP,          // to instruction a
+    JUMP_IF_FALSE, // to instruction b unless a is truthy
+    RETURN
+};
+
+struct RegInstruction {
+    RegOpcode opcode;
+    std::uint32_t a = 0;
+    std::uint32_t b = 0;
+    std::uint32_t c = 0;
+};
+
+struct RegProgram {
+    std::vector<RegInstruction> instructions; // the last one is RETURN
+    std::vector<Value> constants;
+    std::vector<std::string> globals;
+    // One per name in globals; filled in as the program runs.
+    std::vector<GlobalCache> global_caches;
+    std::uint32_t constant_base = 0;
+    std::uint32_t register_count = 0;
+};
+
+// Compiles a resolved program whose locals need `frame_size` slots.
+RegProgram compile_registers(const std::vector<StmtPtr>& program, std::uint32_t frame_size);
+
+// Runs `program` in `registers`, growing them as needed. `globals_version`
+// is the version GlobalCaches are checked against, and is bumped when a
+// global is added. With `jit`, hot loops run as native traces where
+// jit_supported().
+void execute(RegProgram& program, std::vector<Value>& registers,
+             std::unordered_map<std::string, Value>& globals, std::uint64_t& globals_version, bool jit = false);
+
+// Textual form for debugging, one instruction per line.
+std::string to_string(const RegProgram& program);
+
+} // namespace tl
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "ast.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace tl {
+
+// Binds every block-local variable to a slot in one flat frame per unit,
+// so blocks need no scope object at run time. Nothing can capture a local,
+// so none outlives its block and slots are reused once a block ends; the
+// frame only needs as many slots as the deepest nest of live locals.
+class Resolver {
+public:
+    // Sets the slot of every local LetStmt, VariableExpr and AssignExpr in
+    // `program` and returns the frame size it needs.
+    std::uint32_t run(std::vector<StmtPtr>& program);
+
+private:
+    std::vector<std::unordered_map<std::string, std::uint32_t>> scopes_;
+    std::uint32_t next_slot_ = 0;
+    std::uint32_t frame_size_ = 0;
+
+    std::uint32_t lookup(const std::string& name) const;
+    void resolve(Expr* node);
+    void resolve(Stmt* node);
+};
+
+} // namespace tl
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "builtins.hpp"
+#include "ops.hpp"
+#include "value.hpp"
+
+#include <limits>
+#include <utility>
+
+namespace tl {
+
+// Support for programs compiled to C++ by tlc, linked in from the
+// tinylang_runtime library. Values and operators are the interpreter's
+// own, so compiled programs print the same results and errors.
+
+// A global variable. Reading or assigning it before its `let` has run
+// fails as it does in the interpreter.
+class Global {
+public:
+    explicit Global(const char* name) : name_(name) {}
+
+    const Value& get() const {
+        if (!defined_) undefined();
+        return value_;
+    }
+
+    void set(Value value) {
+        if (!defined_) undefined();
+        value_ = std::move(value);
+    }
+
+    void define(Value value) {
+        value_ = std::move(value);
+        defined_ = true;
+    }
+
+private:
+    const char* name_;
+    Value value_;
+    bool defined_ = false;
+
+    [[noreturn]] void undefined() const;
+};
+
+inline Value negate(const Value& right) {
+    if (const double* number = std::get_if<double>(&right)) return Value{-*number};
+    return apply_unary(UnaryOp::NEGATE, right);
+}
+
+// apply_binary with the all-numbers case inlined for each operator.
+template <BinaryOp op>
+inline Value binary(const Value& left, const Value& right) {
+    const double* a = std::get_if<double>(&left);
+    const double* b = std::get_if<double>(&right);
+    if (a && b) {
+        if constexpr (op == BinaryOp::ADD) return Value{*a + *b};
+        if constexpr (op == BinaryOp::SUBTRACT) return Value{*a - *b};
+        if constexpr (op == BinaryOp::MULTIPLY) return Value{*a * *b};
+        if constexpr (op == BinaryOp::DIVIDE) {
+            if (*b != 0.0) return Value{*a / *b};
+        }
+        if constexpr (op == BinaryOp::GREATER) return Value{*a > *b};
+        if constexpr (op == BinaryOp::GREATER_EQUAL) return Value{*a >= *b};
+        if constexpr (op == BinaryOp::LESS) return Value{*a < *b};
+        if constexpr (op == BinaryOp::LESS_EQUAL) return Value{*a <= *b};
+        if constexpr (op == BinaryOp::EQUAL) return Value{*a == *b};
+        if constexpr (op == BinaryOp::NOT_EQUAL) return Value{*a != *b};
+    }
+    return apply_binary(op, left, right);
+}
+
+// The print statement.
+void print(const Value& value);
+
+// Runs a compiled program, reporting a runtime error the way `tl` does,
+// and returns the process exit status.
+int run_compiled(void (*program)());
+
+} // namespace tl
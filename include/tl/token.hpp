@@ -48,9 +48,14 @@ struct Token {
     std::string lexeme;
     Literal literal;
     int line;
+    int column; // 1-based byte column of the first character, 0 if unknown
 
-    Token(TokenType type, std::string lexeme, Literal literal, int line)
-        : type(type), lexeme(std::move(lexeme)), literal(std::move(literal)), line(line) {}
+    Token(TokenType type, std::string lexeme, Literal literal, int line, int column = 0)
+        : type(type), lexeme(std::move(lexeme)), literal(std::move(literal)), line(line), column(column) {}
+
+    // A token without a literal value.
+    Token(TokenType type, std::string lexeme, int line, int column = 0)
+        : type(type), lexeme(std::move(lexeme)), line(line), column(column) {}
 };
 
 inline std::string token_type_to_string(TokenType type) {
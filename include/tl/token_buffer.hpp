@@ -0,0 +1,86 @@
+#pragma once
+
+#include "token.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tl {
+
+// Struct-of-arrays token stream. Each token is a type byte plus a 32-bit
+// offset and length into text owned by the buffer; lines are kept as a
+// run-length table and decoded number literals in a side table, so a token
+// costs about nine bytes instead of a full Token. String literal values are
+// the lexeme without its quotes and need no table.
+class TokenBuffer {
+public:
+    TokenBuffer() = default;
+
+    // Copies every lexeme into the buffer's own text.
+    explicit TokenBuffer(const std::vector<Token>& tokens);
+
+    std::size_t size() const;
+    bool empty() const;
+
+    TokenType type(std::size_t index) const;
+    std::string_view lexeme(std::size_t index) const;
+    int line(std::size_t index) const;
+    int column(std::size_t index) const;
+    double number(std::size_t index) const;
+    std::string_view string_value(std::size_t index) const;
+
+    // Materializes a full Token, for consumers that still need one.
+    Token token(std::size_t index) const;
+
+    // Appends a token whose lexeme lies at [offset, offset + length) of text().
+    void push(TokenType type, std::size_t offset, std::size_t length, int line, int column,
+              double number = 0.0);
+
+    // Appends a token, copying its lexeme to the end of text().
+    void append(const Token& token);
+
+    // Drops the first `count` tokens, along with the text only they used.
+    void discard(std::size_t count);
+
+    // Copies tokens [begin, end) and the text they span into a new buffer.
+    // Lines and columns are preserved.
+    TokenBuffer slice(std::size_t begin, std::size_t end) const;
+
+    // Releases the slack left in the arrays by incremental growth.
+    void shrink_to_fit();
+
+    const std::string& text() const;
+
+    // Bytes held by the token arrays and tables, excluding text().
+    std::size_t memory_usage() const;
+
+private:
+    friend class Lexer;
+
+    // Tokens from first_token on share a line, and a column is the token's
+    // offset minus line_start. When text() is the source that means one run
+    // per line; copied lexemes lose their spacing and need a run per token.
+    struct LineRun {
+        std::uint32_t first_token;
+        std::int32_t line;
+        std::int64_t line_start;
+    };
+
+    const LineRun& run(std::size_t index) const;
+
+    // Appends the tokens of `part`, whose offsets are relative to `offset`
+    // in text() and whose lines are `lines` short.
+    void splice(const TokenBuffer& part, std::size_t offset, int lines);
+
+    std::string text_;
+    std::vector<std::uint8_t> types_;
+    std::vector<std::uint32_t> offsets_;
+    std::vector<std::uint32_t> lengths_;
+    std::vector<LineRun> lines_;
+    std::vector<std::uint32_t> number_tokens_;
+    std::vector<double> numbers_;
+};
+
+} // namespace tl
@@ -1,7 +1,8 @@
 #pragma once
 
-#include <iomanip>
-#include <sstream>
+#include <charconv>
+#include <ostream>
+#include <stdexcept>
 #include <string>
 #include <variant>
 
@@ -9,6 +10,12 @@ namespace tl {
 
 using Value = std::variant<std::monostate, double, bool, std::string>;
 
+class RuntimeError : public std::runtime_error {
+public:
+    explicit RuntimeError(const std::string& message)
+        : std::runtime_error(message) {}
+};
+
 inline bool is_truthy(const Value& value) {
     if (std::holds_alternative<std::monostate>(value)) {
         return false;
@@ -25,28 +32,35 @@ inline bool is_truthy(const Value& value) {
     return false;
 }
 
+// Large enough for any number format_number writes.
+constexpr std::size_t number_buffer_size = 32;
+
+// Writes `number` as print shows it, with 12 significant digits, into
+// `buffer` and returns the end of the text. Allocates nothing.
+inline char* format_number(double number, char* buffer) {
+    char* end = std::to_chars(buffer, buffer + number_buffer_size, number, std::chars_format::general, 12).ptr;
+    // Trim trailing zeros and decimal point for integers
+    if (std::char_traits<char>::find(buffer, end - buffer, '.')) {
+        while (end != buffer && end[-1] == '0') {
+            --end;
+        }
+        if (end != buffer && end[-1] == '.') {
+            --end;
+        }
+    }
+    if (end == buffer) {
+        *end++ = '0';
+    }
+    return end;
+}
+
 inline std::string to_string(const Value& value) {
     if (std::holds_alternative<std::monostate>(value)) {
         return "nil";
     }
     if (std::holds_alternative<double>(value)) {
-        double number = std::get<double>(value);
-        std::ostringstream oss;
-        oss << std::setprecision(12) << number;
-        std::string result = oss.str();
-        // Trim trailing zeros and decimal point for integers
-        if (result.find('.') != std::string::npos) {
-            while (!result.empty() && result.back() == '0') {
-                result.pop_back();
-            }
-            if (!result.empty() && result.back() == '.') {
-                result.pop_back();
-            }
-        }
-        if (result.empty()) {
-            result = "0";
-        }
-        return result;
+        char buffer[number_buffer_size];
+        return std::string(buffer, format_number(std::get<double>(value), buffer));
     }
     if (std::holds_alternative<bool>(value)) {
         return std::get<bool>(value) ? "true" : "false";
@@ -57,6 +71,21 @@ inline std::string to_string(const Value& value) {
     return "unknown";
 }
 
+// Writes to_string(value) to `out` without building the string.
+inline std::ostream& write_value(std::ostream& out, const Value& value) {
+    if (const double* number = std::get_if<double>(&value)) {
+        char buffer[number_buffer_size];
+        return out.write(buffer, format_number(*number, buffer) - buffer);
+    }
+    if (const std::string* text = std::get_if<std::string>(&value)) {
+        return out.write(text->data(), static_cast<std::streamsize>(text->size()));
+    }
+    if (const bool* boolean = std::get_if<bool>(&value)) {
+        return out << (*boolean ? "true" : "false");
+    }
+    return out << "nil";
+}
+
 inline bool values_equal(const Value& a, const Value& b) {
     return a == b;
 }
@@ -1,9 +1,18 @@
 #pragma once
 
 #include "ast.hpp"
+#include "async_output.hpp"
+#include "ir_passes.hpp"
+#include "optimizer.hpp"
 #include "parser.hpp"
+#include "partial_eval.hpp"
+#include "reg.hpp"
+#include "resolver.hpp"
 #include "value.hpp"
 
+#include <istream>
+#include <memory>
+#include <ostream>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -16,24 +25,66 @@ enum class InterpretResult {
     RUNTIME_ERROR
 };
 
-class RuntimeError : public std::runtime_error {
-public:
-    explicit RuntimeError(const std::string& message)
-        : std::runtime_error(message) {}
+// How programs run: walking the AST, compiled to register-machine code,
+// or lowered to SSA, optimized by the default pass pipeline and executed
+// from the IR.
+enum class Tier {
+    AST,
+    REGISTER,
+    SSA
 };
 
 class VM : public ExprVisitor, public StmtVisitor {
 public:
-    VM();
+    explicit VM(Tier tier = Tier::AST);
+    ~VM() override;
+
+    // The SSA and register tiers write the code of every unit they compile
+    // here.
+    void set_ir_dump(std::ostream* out);
+    // Every store removed by dead-store elimination is listed here.
+    void set_dead_store_report(std::ostream* out);
+    // The SSA tier writes the inferred type of every variable here.
+    void set_type_report(std::ostream* out);
+    // Whether the tree-walker fuses common node shapes; on by default.
+    void set_superinstructions(bool enabled);
+    // Whether the register tier compiles hot loops to native code; off by
+    // default.
+    void set_jit(bool enabled);
+    // Whether std::cout writes through an AsyncOutputBuffer, so printing
+    // does not wait on a slow reader; off by default. Turning it off, or
+    // destroying the VM, writes out everything printed first.
+    void set_async_output(bool enabled);
+    // Binds global `name` before the program runs, and specializes every
+    // statement for the values given this way; see PartialEvaluator.
+    void define(const std::string& name, Value value);
+    const PassManager& passes() const;
 
     InterpretResult interpret(const std::string& source);
 
+    // Lexes, parses and executes `input` one top-level statement at a time,
+    // so arbitrarily large scripts run in bounded front-end memory. Execution
+    // stops at the first statement with a syntax error; the rest of the input
+    // is still parsed so all errors are reported together.
+    InterpretResult interpret(std::istream& input);
+
+    // Same result as interpret(std::istream&), but all of `source` is lexed
+    // and parsed up front on a thread pool. Faster for large scripts, at the
+    // cost of holding every token and statement at once.
+    InterpretResult interpret_parallel(std::string source);
+
     // ExprVisitor implementation
     Value visit_literal_expr(LiteralExpr& expr) override;
     Value visit_variable_expr(VariableExpr& expr) override;
     Value visit_unary_expr(UnaryExpr& expr) override;
     Value visit_binary_expr(BinaryExpr& expr) override;
     Value visit_assign_expr(AssignExpr& expr) override;
+    Value visit_call_expr(CallExpr& expr) override;
+    Value visit_temp_store_expr(TempStoreExpr& expr) override;
+    Value visit_temp_load_expr(TempLoadExpr& expr) override;
+    Value visit_fused_binary_expr(FusedBinaryExpr& expr) override;
+    Value visit_fused_assign_expr(FusedAssignExpr& expr) override;
+    Value visit_error_expr(ErrorExpr& expr) override;
 
     // StmtVisitor implementation
     void visit_expression_stmt(ExpressionStmt& stmt) override;
@@ -42,19 +93,42 @@ public:
     void visit_block_stmt(BlockStmt& stmt) override;
     void visit_if_stmt(IfStmt& stmt) override;
     void visit_while_stmt(WhileStmt& stmt) override;
+    void visit_fused_while_stmt(FusedWhileStmt& stmt) override;
+    void visit_counted_loop_stmt(CountedLoopStmt& stmt) override;
+    void visit_error_stmt(ErrorStmt& stmt) override;
 
 private:
+    Tier tier_;
+    PassManager passes_;
+    std::ostream* ir_dump_ = nullptr;
+    std::ostream* dead_store_report_ = nullptr;
+    std::ostream* type_report_ = nullptr;
     std::unordered_map<std::string, Value> globals_;
-    std::vector<std::unordered_map<std::string, Value>> scopes_;
-
-    void execute(const std::vector<StmtPtr>& statements);
-    void execute_block(const std::vector<StmtPtr>& statements);
+    // Bumped whenever a global is added. Globals are never removed and map
+    // nodes do not move, so this is the only thing that stales a GlobalCache.
+    std::uint64_t globals_version_ = 1;
+    // Block-local variables of the running unit, by Resolver slot.
+    std::vector<Value> frame_;
+    std::vector<Value> temps_;
+    CommonSubexpressionEliminator cse_;
+    DeadStoreEliminator dead_stores_;
+    Resolver resolver_;
+    SuperinstructionFuser fuser_;
+    bool superinstructions_ = true;
+    bool jit_ = false;
+    std::unique_ptr<AsyncOutputBuffer> async_output_;
+    PartialEvaluator partial_evaluator_;
+    bool specialize_ = false;
 
-    void define(const std::string& name, const Value& value);
-    void assign(const std::string& name, const Value& value);
+    InterpretResult interpret_streaming(Lexer& lexer);
+    void run(std::vector<StmtPtr>& statements, StmtPtr statement);
+    void execute(std::vector<StmtPtr>& statements);
+    void execute_ssa(std::vector<StmtPtr>& statements);
+    void remove_dead_stores(std::vector<StmtPtr>& statements);
     Value evaluate(Expr& expr);
-
-    std::unordered_map<std::string, Value>& current_scope();
+    const Value& operand(const FusedOperand& operand) const;
+    bool run_counted_loop(const CountedLoopStmt& stmt);
+    Value* find_global(const std::string& name, GlobalCache& cache);
 };
 
 } // namespace tl
@@ -0,0 +1,296 @@
+#include "tl/aot.hpp"
+
+#include "tl/ops.hpp"
+#include "tl/resolver.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <unordered_map>
+
+namespace tl {
+
+namespace {
+
+const char* op_name(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::ADD: return "ADD";
+        case BinaryOp::SUBTRACT: return "SUBTRACT";
+        case BinaryOp::MULTIPLY: return "MULTIPLY";
+        case BinaryOp::DIVIDE: return "DIVIDE";
+        case BinaryOp::GREATER: return "GREATER";
+        case BinaryOp::GREATER_EQUAL: return "GREATER_EQUAL";
+        case BinaryOp::LESS: return "LESS";
+        case BinaryOp::LESS_EQUAL: return "LESS_EQUAL";
+        case BinaryOp::EQUAL: return "EQUAL";
+        case BinaryOp::NOT_EQUAL: return "NOT_EQUAL";
+        case BinaryOp::AND: return "AND";
+        case BinaryOp::OR: return "OR";
+    }
+    return "OR";
+}
+
+const char* builtin_name(Builtin builtin) {
+    switch (builtin) {
+        case Builtin::READLINE: return "READLINE";
+        case Builtin::LINES: return "LINES";
+        case Builtin::READFILE: return "READFILE";
+    }
+    return "READFILE";
+}
+
+bool has_assignment(const Expr* node) {
+    if (dynamic_cast<const AssignExpr*>(node)) return true;
+    if (auto* unary = dynamic_cast<const UnaryExpr*>(node)) return has_assignment(unary->right.get());
+    if (auto* binary = dynamic_cast<const BinaryExpr*>(node)) {
+        return has_assignment(binary->left.get()) || has_assignment(binary->right.get());
+    }
+    if (auto* call = dynamic_cast<const CallExpr*>(node)) {
+        for (const auto& argument : call->arguments) {
+            if (has_assignment(argument.get())) return true;
+        }
+    }
+    return false;
+}
+
+// The shortest decimal literal that reads back as `number`.
+std::string number_literal(double number) {
+    if (std::isinf(number)) return "std::numeric_limits<double>::infinity()";
+    char buffer[32];
+    for (int precision = 1; precision <= 17; ++precision) {
+        std::snprintf(buffer, sizeof(buffer), "%.*g", precision, number);
+        if (std::strtod(buffer, nullptr) == number) break;
+    }
+    std::string literal = buffer;
+    if (literal.find_first_of(".e") == std::string::npos) literal += ".0";
+    return literal;
+}
+
+std::string string_literal(const std::string& text) {
+    std::string literal = "std::string(\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            literal += '\\';
+            literal += static_cast<char>(c);
+        } else if (c >= 0x20 && c < 0x7F) {
+            literal += static_cast<char>(c);
+        } else {
+            // Three octal digits, so the next character cannot extend it.
+            char escape[5];
+            std::snprintf(escape, sizeof(escape), "\\%03o", c);
+            literal += escape;
+        }
+    }
+    return literal + "\", " + std::to_string(text.size()) + ")";
+}
+
+// Emits one C++ statement per effect, in the interpreter's evaluation
+// order. Expression results are C++ expressions over operands that are
+// locals (`l<slot>`), constants (`k<n>`) or temporaries (`t<n>`).
+class CppEmitter {
+public:
+    std::string run(std::vector<StmtPtr>& program) {
+        std::uint32_t frame_size = Resolver().run(program);
+        indent_ = 1;
+        for (const auto& statement : program) {
+            emit(statement.get());
+        }
+        std::string body = std::move(out_);
+
+        std::ostringstream file;
+        file << "// Generated by tlc.\n"
+             << "#include \"tl/runtime.hpp\"\n\n"
+             << "namespace {\n\n";
+        for (std::size_t i = 0; i < global_names_.size(); ++i) {
+            file << "tl::Global g" << i << "{\"" << global_names_[i] << "\"};\n";
+        }
+        for (std::size_t i = 0; i < constants_.size(); ++i) {
+            file << "const tl::Value k" << i << "{" << constants_[i] << "};\n";
+        }
+        if (!global_names_.empty() || !constants_.empty()) file << "\n";
+        file << "void run() {\n";
+        for (std::uint32_t slot = 0; slot < frame_size; ++slot) {
+            file << "    tl::Value l" << slot << ";\n";
+        }
+        file << body << "}\n\n"
+             << "} // namespace\n\n"
+             << "int main() {\n"
+             << "    return tl::run_compiled(run);\n"
+             << "}\n";
+        return file.str();
+    }
+
+private:
+    std::string out_;
+    int indent_ = 0;
+    std::size_t temps_ = 0;
+    std::vector<std::string> global_names_;
+    std::unordered_map<std::string, std::size_t> globals_;
+    std::vector<std::string> constants_;
+    std::unordered_map<std::string, std::size_t> constant_index_;
+
+    void line(const std::string& text) {
+        out_.append(4 * indent_, ' ');
+        out_ += text;
+        out_ += '\n';
+    }
+
+    std::string global(const std::string& name) {
+        auto [it, inserted] = globals_.try_emplace(name, global_names_.size());
+        if (inserted) global_names_.push_back(name);
+        return "g" + std::to_string(it->second);
+    }
+
+    std::string constant(const Value& value) {
+        std::string initializer;
+        if (std::holds_alternative<std::monostate>(value)) {
+            initializer = "";
+        } else if (auto* number = std::get_if<double>(&value)) {
+            initializer = number_literal(*number);
+        } else if (auto* boolean = std::get_if<bool>(&value)) {
+            initializer = *boolean ? "true" : "false";
+        } else {
+            initializer = string_literal(std::get<std::string>(value));
+        }
+        auto [it, inserted] = constant_index_.try_emplace(initializer, constants_.size());
+        if (inserted) constants_.push_back(initializer);
+        return "k" + std::to_string(it->second);
+    }
+
+    static std::string local(std::uint32_t slot) { return "l" + std::to_string(slot); }
+
+    std::string temporary(const std::string& value, bool reference = false) {
+        std::string name = "t" + std::to_string(temps_++);
+        line((reference ? "const tl::Value& " : "const tl::Value ") + name + " = " + value + ";");
+        return name;
+    }
+
+    // `node` as a name for its value. Unless `copy` is set, the name may
+    // refer to a variable, so it is only good until the next assignment.
+    std::string operand(const Expr* node, bool copy = false) {
+        if (auto* literal = dynamic_cast<const LiteralExpr*>(node)) return constant(literal->value);
+        if (auto* variable = dynamic_cast<const VariableExpr*>(node)) {
+            if (variable->slot == no_frame_slot) return temporary(global(variable->name) + ".get()", !copy);
+            return copy ? temporary(local(variable->slot)) : local(variable->slot);
+        }
+        std::string value = expression(node);
+        if (value.find_first_of("(:{") == std::string::npos && !copy) return value;
+        return temporary(value);
+    }
+
+    std::string expression(const Expr* node) {
+        if (auto* literal = dynamic_cast<const LiteralExpr*>(node)) return constant(literal->value);
+        if (auto* variable = dynamic_cast<const VariableExpr*>(node)) {
+            if (variable->slot != no_frame_slot) return local(variable->slot);
+            return global(variable->name) + ".get()";
+        }
+        if (auto* unary = dynamic_cast<const UnaryExpr*>(node)) {
+            std::string right = operand(unary->right.get());
+            if (to_unary_op(unary->op.type) == UnaryOp::NOT) return "tl::Value{!tl::is_truthy(" + right + ")}";
+            return "tl::negate(" + right + ")";
+        }
+        if (auto* binary = dynamic_cast<const BinaryExpr*>(node)) {
+            std::string left = operand(binary->left.get(), has_assignment(binary->right.get()));
+            std::string right = operand(binary->right.get());
+            return std::string("tl::binary<tl::BinaryOp::") + op_name(to_binary_op(binary->op.type)) + ">(" + left +
+                   ", " + right + ")";
+        }
+        if (auto* assign = dynamic_cast<const AssignExpr*>(node)) {
+            std::string value = expression(assign->value.get());
+            if (assign->slot != no_frame_slot) {
+                line(local(assign->slot) + " = " + value + ";");
+                return local(assign->slot);
+            }
+            std::string target = global(assign->name);
+            line(target + ".set(" + value + ");");
+            return target + ".get()";
+        }
+        if (auto* call = dynamic_cast<const CallExpr*>(node)) {
+            std::string builtin = std::string("tl::Builtin::") + builtin_name(call->builtin);
+            if (call->arguments.empty()) return "tl::call_builtin(" + builtin + ", nullptr, 0)";
+            std::string arguments;
+            const auto& nodes = call->arguments;
+            for (std::size_t i = 0; i < nodes.size(); ++i) {
+                bool copy = std::any_of(nodes.begin() + i + 1, nodes.end(),
+                                        [](const ExprPtr& later) { return has_assignment(later.get()); });
+                arguments += (i > 0 ? ", " : "") + operand(nodes[i].get(), copy);
+            }
+            std::string array = "t" + std::to_string(temps_++);
+            line("const tl::Value " + array + "[] = {" + arguments + "};");
+            return "tl::call_builtin(" + builtin + ", " + array + ", " + std::to_string(nodes.size()) + ")";
+        }
+        throw RuntimeError("Cannot compile an expression with syntax errors.");
+    }
+
+    // Statements of a nested body, indented one level.
+    void body(const Stmt* node) {
+        ++indent_;
+        if (auto* block = dynamic_cast<const BlockStmt*>(node)) {
+            for (const auto& statement : block->statements) emit(statement.get());
+        } else if (node) {
+            emit(node);
+        }
+        --indent_;
+    }
+
+    void emit(const Stmt* node) {
+        if (auto* expression_stmt = dynamic_cast<const ExpressionStmt*>(node)) {
+            std::string value = expression(expression_stmt->expression.get());
+            // Assignments were emitted as statements; other expressions are
+            // still evaluated for their errors.
+            if (!dynamic_cast<const AssignExpr*>(expression_stmt->expression.get())) {
+                line("(void)" + value + ";");
+            }
+        } else if (auto* print = dynamic_cast<const PrintStmt*>(node)) {
+            line("tl::print(" + expression(print->expression.get()) + ");");
+        } else if (auto* let = dynamic_cast<const LetStmt*>(node)) {
+            std::string value = let->initializer ? expression(let->initializer.get()) : "tl::Value{}";
+            if (let->slot != no_frame_slot) {
+                line(local(let->slot) + " = " + value + ";");
+            } else {
+                line(global(let->name) + ".define(" + value + ");");
+            }
+        } else if (auto* block = dynamic_cast<const BlockStmt*>(node)) {
+            for (const auto& statement : block->statements) emit(statement.get());
+        } else if (auto* branch = dynamic_cast<const IfStmt*>(node)) {
+            line("if (tl::is_truthy(" + expression(branch->condition.get()) + ")) {");
+            body(branch->then_branch.get());
+            if (branch->else_branch) {
+                line("} else {");
+                body(branch->else_branch.get());
+            }
+            line("}");
+        } else if (auto* loop = dynamic_cast<const WhileStmt*>(node)) {
+            // The condition's own statements have to run on every
+            // iteration, so they move inside the loop when there are any.
+            std::string outer = std::move(out_);
+            out_.clear();
+            ++indent_;
+            std::string condition = expression(loop->condition.get());
+            --indent_;
+            std::string prelude = std::move(out_);
+            out_ = std::move(outer);
+            if (prelude.empty()) {
+                line("while (tl::is_truthy(" + condition + ")) {");
+            } else {
+                line("while (true) {");
+                out_ += prelude;
+                line("    if (!tl::is_truthy(" + condition + ")) break;");
+            }
+            body(loop->body.get());
+            line("}");
+        } else {
+            throw RuntimeError("Cannot compile a statement with syntax errors.");
+        }
+    }
+};
+
+} // namespace
+
+std::string compile_to_cpp(std::vector<StmtPtr>& program) {
+    return CppEmitter().run(program);
+}
+
+} // namespace tl
@@ -1,6 +1,8 @@
 #include "tl/ast.hpp"
 #include "tl/vm.hpp"
 
+#include <charconv>
+
 namespace tl {
 
 LiteralExpr::LiteralExpr(Value value) : value(std::move(value)) {}
@@ -21,6 +23,28 @@ AssignExpr::AssignExpr(std::string name, std::unique_ptr<Expr> value)
     : name(std::move(name)), value(std::move(value)) {}
 Value AssignExpr::accept(ExprVisitor& visitor) { return visitor.visit_assign_expr(*this); }
 
+CallExpr::CallExpr(Builtin builtin, std::vector<std::unique_ptr<Expr>> arguments)
+    : builtin(builtin), arguments(std::move(arguments)) {}
+Value CallExpr::accept(ExprVisitor& visitor) { return visitor.visit_call_expr(*this); }
+
+TempStoreExpr::TempStoreExpr(std::unique_ptr<Expr> value, std::size_t slot)
+    : value(std::move(value)), slot(slot) {}
+Value TempStoreExpr::accept(ExprVisitor& visitor) { return visitor.visit_temp_store_expr(*this); }
+
+TempLoadExpr::TempLoadExpr(std::size_t slot, const Expr* source) : slot(slot), source(source) {}
+Value TempLoadExpr::accept(ExprVisitor& visitor) { return visitor.visit_temp_load_expr(*this); }
+
+FusedBinaryExpr::FusedBinaryExpr(BinaryOp op, FusedOperand left, FusedOperand right)
+    : op(op), left(std::move(left)), right(std::move(right)) {}
+Value FusedBinaryExpr::accept(ExprVisitor& visitor) { return visitor.visit_fused_binary_expr(*this); }
+
+FusedAssignExpr::FusedAssignExpr(std::uint32_t slot, BinaryOp op, FusedOperand right)
+    : slot(slot), op(op), right(std::move(right)) {}
+Value FusedAssignExpr::accept(ExprVisitor& visitor) { return visitor.visit_fused_assign_expr(*this); }
+
+ErrorExpr::ErrorExpr(std::size_t diagnostic) : diagnostic(diagnostic) {}
+Value ErrorExpr::accept(ExprVisitor& visitor) { return visitor.visit_error_expr(*this); }
+
 ExpressionStmt::ExpressionStmt(std::unique_ptr<Expr> expression)
     : expression(std::move(expression)) {}
 void ExpressionStmt::accept(StmtVisitor& visitor) { visitor.visit_expression_stmt(*this); }
@@ -49,5 +73,129 @@ WhileStmt::WhileStmt(std::unique_ptr<Expr> condition, std::unique_ptr<Stmt> body
     : condition(std::move(condition)), body(std::move(body)) {}
 void WhileStmt::accept(StmtVisitor& visitor) { visitor.visit_while_stmt(*this); }
 
-} // namespace tl
+FusedWhileStmt::FusedWhileStmt(std::unique_ptr<FusedBinaryExpr> condition, std::unique_ptr<Stmt> body)
+    : condition(std::move(condition)), body(std::move(body)) {}
+void FusedWhileStmt::accept(StmtVisitor& visitor) { visitor.visit_fused_while_stmt(*this); }
+
+CountedLoopStmt::CountedLoopStmt(std::unique_ptr<FusedWhileStmt> loop, double stride, std::vector<Step> steps)
+    : loop(std::move(loop)), stride(stride), steps(std::move(steps)) {}
+void CountedLoopStmt::accept(StmtVisitor& visitor) { visitor.visit_counted_loop_stmt(*this); }
+
+ErrorStmt::ErrorStmt(std::size_t diagnostic) : diagnostic(diagnostic) {}
+void ErrorStmt::accept(StmtVisitor& visitor) { visitor.visit_error_stmt(*this); }
 
+namespace {
+
+// Binding power in the parser's terms: an operand binding more loosely
+// than its position allows needs parentheses.
+enum Binding { ASSIGNMENT, OR, AND, EQUALITY, COMPARISON, TERM, FACTOR, UNARY, PRIMARY };
+
+Binding binding(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::OR: return OR;
+        case BinaryOp::AND: return AND;
+        case BinaryOp::EQUAL:
+        case BinaryOp::NOT_EQUAL: return EQUALITY;
+        case BinaryOp::ADD:
+        case BinaryOp::SUBTRACT: return TERM;
+        case BinaryOp::MULTIPLY:
+        case BinaryOp::DIVIDE: return FACTOR;
+        default: return COMPARISON;
+    }
+}
+
+std::string literal_source(const Value& value) {
+    if (const double* number = std::get_if<double>(&value)) {
+        // Shortest text that reads back as the same double.
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), *number);
+        return std::string(buffer, result.ptr);
+    }
+    if (const std::string* text = std::get_if<std::string>(&value)) return "\"" + *text + "\"";
+    return to_string(value);
+}
+
+std::string expression_source(const Expr* node, Binding context) {
+    std::string text;
+    Binding own = PRIMARY;
+    if (auto* literal = dynamic_cast<const LiteralExpr*>(node)) {
+        text = literal_source(literal->value);
+        if (text[0] == '-') own = UNARY;
+    } else if (auto* variable = dynamic_cast<const VariableExpr*>(node)) {
+        text = variable->name;
+    } else if (auto* unary = dynamic_cast<const UnaryExpr*>(node)) {
+        std::string right = expression_source(unary->right.get(), UNARY);
+        // Keep `- -x` from reading as a decrement.
+        text = token_type_to_string(unary->op.type) + (right[0] == '-' ? " " : "") + right;
+        own = UNARY;
+    } else if (auto* binary = dynamic_cast<const BinaryExpr*>(node)) {
+        own = binding(to_binary_op(binary->op.type));
+        text = expression_source(binary->left.get(), own) + " " + token_type_to_string(binary->op.type) + " " +
+               expression_source(binary->right.get(), static_cast<Binding>(own + 1));
+    } else if (auto* assign = dynamic_cast<const AssignExpr*>(node)) {
+        text = assign->name + " = " + expression_source(assign->value.get(), ASSIGNMENT);
+        own = ASSIGNMENT;
+    } else if (auto* call = dynamic_cast<const CallExpr*>(node)) {
+        text = std::string(builtin_info(call->builtin).name) + "(";
+        for (std::size_t i = 0; i < call->arguments.size(); ++i) {
+            if (i > 0) text += ", ";
+            text += expression_source(call->arguments[i].get(), ASSIGNMENT);
+        }
+        text += ")";
+    } else {
+        throw std::logic_error("to_source: unsupported expression");
+    }
+    return own < context ? "(" + text + ")" : text;
+}
+
+void statement_source(const Stmt* node, int depth, std::string& out);
+
+// A branch or loop body, braced, continuing the line of its keyword.
+void body_source(const Stmt* node, int depth, std::string& out) {
+    out += "{\n";
+    if (auto* block = dynamic_cast<const BlockStmt*>(node)) {
+        for (const auto& statement : block->statements) statement_source(statement.get(), depth + 1, out);
+    } else {
+        statement_source(node, depth + 1, out);
+    }
+    out.append(4 * depth, ' ');
+    out += "}";
+}
+
+void statement_source(const Stmt* node, int depth, std::string& out) {
+    out.append(4 * depth, ' ');
+    if (auto* expression = dynamic_cast<const ExpressionStmt*>(node)) {
+        out += expression_source(expression->expression.get(), ASSIGNMENT) + ";";
+    } else if (auto* print = dynamic_cast<const PrintStmt*>(node)) {
+        out += "print " + expression_source(print->expression.get(), ASSIGNMENT) + ";";
+    } else if (auto* let = dynamic_cast<const LetStmt*>(node)) {
+        out += "let " + let->name + " = " + expression_source(let->initializer.get(), ASSIGNMENT) + ";";
+    } else if (auto* block = dynamic_cast<const BlockStmt*>(node)) {
+        body_source(block, depth, out);
+    } else if (auto* branch = dynamic_cast<const IfStmt*>(node)) {
+        out += "if (" + expression_source(branch->condition.get(), ASSIGNMENT) + ") ";
+        body_source(branch->then_branch.get(), depth, out);
+        if (branch->else_branch) {
+            out += " else ";
+            body_source(branch->else_branch.get(), depth, out);
+        }
+    } else if (auto* loop = dynamic_cast<const WhileStmt*>(node)) {
+        out += "while (" + expression_source(loop->condition.get(), ASSIGNMENT) + ") ";
+        body_source(loop->body.get(), depth, out);
+    } else {
+        throw std::logic_error("to_source: unsupported statement");
+    }
+    out += "\n";
+}
+
+} // namespace
+
+std::string to_source(const std::vector<StmtPtr>& program) {
+    std::string out;
+    for (const auto& statement : program) {
+        statement_source(statement.get(), 0, out);
+    }
+    return out;
+}
+
+} // namespace tl
@@ -0,0 +1,103 @@
+#include "tl/async_output.hpp"
+
+#include <algorithm>
+
+namespace tl {
+
+AsyncOutputBuffer::AsyncOutputBuffer(std::streambuf* sink)
+    : sink_(sink), ring_(new char[ring_size]) {
+    setp(ring_.get(), ring_.get() + chunk_size);
+    writer_ = std::thread([this] { run(); });
+}
+
+AsyncOutputBuffer::~AsyncOutputBuffer() {
+    publish();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    writer_wake_.notify_one();
+    writer_.join();
+}
+
+std::streambuf* AsyncOutputBuffer::sink() const {
+    return sink_;
+}
+
+AsyncOutputBuffer::int_type AsyncOutputBuffer::overflow(int_type ch) {
+    publish();
+    claim();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return failed_ ? traits_type::eof() : traits_type::not_eof(ch);
+}
+
+int AsyncOutputBuffer::sync() {
+    publish();
+    std::size_t head = head_.load(std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(mutex_);
+    producer_waiting_ = true;
+    producer_wake_.wait(lock, [&] { return tail_.load() == head; });
+    producer_waiting_ = false;
+    return failed_ ? -1 : 0;
+}
+
+// Hands what was put since the last call to the writer.
+void AsyncOutputBuffer::publish() {
+    std::size_t size = pptr() - pbase();
+    if (size == 0) return;
+    head_.store(head_.load(std::memory_order_relaxed) + size);
+    setp(pptr(), epptr());
+    if (writer_waiting_.load()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        writer_wake_.notify_one();
+    }
+}
+
+// Makes the next free stretch of the ring the put area, waiting for the
+// writer if there is none.
+void AsyncOutputBuffer::claim() {
+    std::size_t head = head_.load(std::memory_order_relaxed);
+    auto room = [&] { return ring_size - (head - tail_.load()); };
+    if (room() == 0) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        producer_waiting_ = true;
+        producer_wake_.wait(lock, [&] { return room() != 0; });
+        producer_waiting_ = false;
+    }
+    std::size_t position = head % ring_size;
+    std::size_t size = std::min({room(), ring_size - position, chunk_size});
+    setp(ring_.get() + position, ring_.get() + position + size);
+}
+
+void AsyncOutputBuffer::run() {
+    while (true) {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        std::size_t head = head_.load();
+        if (head == tail) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            writer_waiting_ = true;
+            writer_wake_.wait(lock, [&] { return stopping_ || head_.load() != tail; });
+            writer_waiting_ = false;
+            if (head_.load() == tail) return;
+            continue;
+        }
+        std::size_t position = tail % ring_size;
+        std::size_t size = std::min(head - tail, ring_size - position);
+        // After a failed write the rest is dropped, but still consumed so
+        // the producer never waits forever.
+        if (!failed_) {
+            auto written = sink_->sputn(ring_.get() + position, static_cast<std::streamsize>(size));
+            if (static_cast<std::size_t>(written) != size || sink_->pubsync() != 0) failed_ = true;
+        }
+        tail_.store(tail + size);
+        if (producer_waiting_.load()) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            producer_wake_.notify_one();
+        }
+    }
+}
+
+} // namespace tl
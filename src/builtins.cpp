@@ -0,0 +1,193 @@
+#include "tl/builtins.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tl {
+
+namespace {
+
+const BuiltinInfo builtins[] = {
+    {"readline", 0, 1},
+    {"lines", 0, 1},
+    {"readfile", 1, 1},
+};
+
+#ifdef _WIN32
+int open_file(const char* path) { return ::_open(path, _O_RDONLY | _O_BINARY); }
+long read_file(int fd, char* data, std::size_t size) { return ::_read(fd, data, static_cast<unsigned>(size)); }
+void close_file(int fd) { ::_close(fd); }
+#else
+int open_file(const char* path) { return ::open(path, O_RDONLY | O_CLOEXEC); }
+long read_file(int fd, char* data, std::size_t size) { return ::read(fd, data, size); }
+void close_file(int fd) { ::close(fd); }
+#endif
+
+long read_retrying(int fd, char* data, std::size_t size) {
+    long count;
+    do {
+        count = read_file(fd, data, size);
+    } while (count < 0 && errno == EINTR);
+    if (count < 0) throw RuntimeError(std::string("Could not read input: ") + std::strerror(errno) + ".");
+    return count;
+}
+
+int open_path(const Value& path) {
+    const std::string* name = std::get_if<std::string>(&path);
+    if (!name) throw RuntimeError("Path must be a string.");
+    int fd = open_file(name->c_str());
+    if (fd < 0) throw RuntimeError("Could not open file '" + *name + "'.");
+    return fd;
+}
+
+// The whole file at `path`, read straight into the string it returns. A
+// regular file's size is known up front, so the string is sized once;
+// anything else, such as a pipe, is read until its end.
+std::string read_whole_file(const Value& path) {
+    struct Closer {
+        int fd;
+        ~Closer() { close_file(fd); }
+    } file{open_path(path)};
+
+    std::size_t capacity = std::size_t{1} << 16;
+#ifndef _WIN32
+    struct stat status;
+    if (::fstat(file.fd, &status) == 0 && S_ISREG(status.st_mode)) {
+        // One byte spare, so the read that finds the end needs no growth.
+        capacity = static_cast<std::size_t>(status.st_size) + 1;
+    }
+#endif
+    std::string text(capacity, '\0');
+    std::size_t used = 0;
+    while (long count = read_retrying(file.fd, text.data() + used, text.size() - used)) {
+        used += static_cast<std::size_t>(count);
+        if (used == text.size()) text.resize(2 * text.size());
+    }
+    text.resize(used);
+    return text;
+}
+
+// Splits an input into lines. Reads go straight into one large buffer,
+// which only grows for a line longer than it.
+class LineReader {
+public:
+    static constexpr std::size_t buffer_size = std::size_t{1} << 20;
+
+    LineReader(int fd, bool owned) : fd_(fd), owned_(owned), buffer_(buffer_size) {}
+    ~LineReader() {
+        if (owned_) close_file(fd_);
+    }
+
+    LineReader(const LineReader&) = delete;
+    LineReader& operator=(const LineReader&) = delete;
+
+    bool next(std::string& line) {
+        while (true) {
+            char* start = buffer_.data() + begin_;
+            char* from = buffer_.data() + searched_;
+            if (auto* newline = static_cast<char*>(std::memchr(from, '\n', end_ - searched_))) {
+                line.assign(start, newline);
+                begin_ = searched_ = newline + 1 - buffer_.data();
+                ++lines_;
+                return true;
+            }
+            searched_ = end_;
+            if (at_end_) {
+                if (begin_ == end_) return false;
+                line.assign(start, end_ - begin_);
+                begin_ = searched_ = end_;
+                ++lines_;
+                return true;
+            }
+            fill();
+        }
+    }
+
+    double lines() const { return static_cast<double>(lines_); }
+
+private:
+    int fd_;
+    bool owned_;
+    std::vector<char> buffer_;
+    // Unread bytes are [begin_, end_); none before searched_ is a '\n'.
+    std::size_t begin_ = 0;
+    std::size_t end_ = 0;
+    std::size_t searched_ = 0;
+    bool at_end_ = false;
+    std::uint64_t lines_ = 0;
+
+    void fill() {
+        if (begin_ > 0) {
+            std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            searched_ -= begin_;
+            begin_ = 0;
+        }
+        if (end_ == buffer_.size()) buffer_.resize(2 * buffer_.size());
+        long count = read_retrying(fd_, buffer_.data() + end_, buffer_.size() - end_);
+        if (count == 0) at_end_ = true;
+        end_ += static_cast<std::size_t>(count);
+    }
+};
+
+// The reader of `path`, or of stdin without one, opened on first use.
+LineReader& reader(const Value* path) {
+    static LineReader input(0, false);
+    static std::unordered_map<std::string, std::unique_ptr<LineReader>> files;
+    if (!path) return input;
+
+    const std::string* name = std::get_if<std::string>(path);
+    if (!name) throw RuntimeError("Path must be a string.");
+    auto it = files.find(*name);
+    if (it == files.end()) {
+        it = files.emplace(*name, std::make_unique<LineReader>(open_path(*path), true)).first;
+    }
+    return *it->second;
+}
+
+} // namespace
+
+const BuiltinInfo& builtin_info(Builtin builtin) {
+    return builtins[static_cast<std::size_t>(builtin)];
+}
+
+bool find_builtin(std::string_view name, Builtin& builtin) {
+    for (std::size_t i = 0; i < std::size(builtins); ++i) {
+        if (name == builtins[i].name) {
+            builtin = static_cast<Builtin>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+Value call_builtin(Builtin builtin, const Value* arguments, std::size_t count) {
+    const Value* path = count > 0 ? &arguments[0] : nullptr;
+    switch (builtin) {
+        case Builtin::READLINE: {
+            std::string line;
+            if (!reader(path).next(line)) return Value{};
+            return Value{std::move(line)};
+        }
+        case Builtin::LINES:
+            return Value{reader(path).lines()};
+        case Builtin::READFILE:
+            return Value{read_whole_file(*path)};
+    }
+    return Value{};
+}
+
+} // namespace tl
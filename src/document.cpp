@@ -0,0 +1,241 @@
+#include "tl/document.hpp"
+
+#include "tl/lexer.hpp"
+#include "tl/parser.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace tl {
+
+Document::Document(std::string source) {
+    relex(source, 1, true, nullptr, segments_);
+    std::size_t offset = 0;
+    int line = 1;
+    for (const auto& segment : segments_) {
+        offsets_.push_back(offset);
+        lines_.push_back(line);
+        offset += segment.text.size();
+        line += segment.newlines;
+    }
+}
+
+EditResult Document::edit(std::size_t offset, std::size_t length, std::string_view replacement) {
+    if (offset > size() || length > size() - offset) {
+        throw std::out_of_range("Edit range outside of document.");
+    }
+
+    // Segments touching the edit on either side are re-lexed too: text typed
+    // right after a statement can extend it ("else ..."), and text typed
+    // right before one can merge into its first token.
+    std::size_t first = segment_at(offset);
+    if (first > 0 && offsets_[first] == offset) first--;
+    std::size_t stop = segment_at(offset + length) + 1;
+    if (!error().empty()) {
+        // The message embeds a line number that may move with this edit.
+        stop = segments_.size();
+    }
+
+    std::string text;
+    for (std::size_t i = first; i < stop; ++i) {
+        text += segments_[i].text;
+    }
+    text.replace(offset - offsets_[first], length, replacement);
+
+    // Widen the region until it re-lexes into whole statements: forward when
+    // it ends mid-statement, backward when it starts with an 'else' that
+    // belongs to the statement before it.
+    std::vector<Segment> fresh;
+    while (true) {
+        const Segment* next = stop < segments_.size() ? &segments_[stop] : nullptr;
+        if (!relex(text, lines_[first], next == nullptr, next, fresh)) {
+            text += segments_[stop].text;
+            stop++;
+            continue;
+        }
+        if (first > 0 && !fresh.empty() && !fresh.front().tokens.empty() &&
+            fresh.front().tokens.front().type == TokenType::ELSE) {
+            first--;
+            text.insert(0, segments_[first].text);
+            continue;
+        }
+        break;
+    }
+
+    int old_newlines = 0;
+    for (std::size_t i = first; i < stop; ++i) {
+        old_newlines += segments_[i].newlines;
+    }
+
+    std::size_t removed = stop - first;
+    std::size_t inserted = fresh.size();
+    auto at = [first](auto& items, std::size_t index) {
+        return items.begin() + static_cast<std::ptrdiff_t>(first + index);
+    };
+    // Reuse the slots of replaced segments and open or close the hole once,
+    // so the tail of each array moves at most a single time.
+    std::size_t reused = std::min(removed, inserted);
+    for (std::size_t i = 0; i < reused; ++i) {
+        segments_[first + i] = std::move(fresh[i]);
+    }
+    if (inserted > removed) {
+        segments_.insert(at(segments_, removed), std::make_move_iterator(fresh.begin() + static_cast<std::ptrdiff_t>(removed)),
+                         std::make_move_iterator(fresh.end()));
+        offsets_.insert(at(offsets_, removed), inserted - removed, 0);
+        lines_.insert(at(lines_, removed), inserted - removed, 0);
+    } else if (removed > inserted) {
+        segments_.erase(at(segments_, inserted), at(segments_, removed));
+        offsets_.erase(at(offsets_, inserted), at(offsets_, removed));
+        lines_.erase(at(lines_, inserted), at(lines_, removed));
+    }
+
+    std::size_t position = offsets_[first];
+    int line = lines_[first];
+    for (std::size_t i = first; i < first + inserted; ++i) {
+        offsets_[i] = position;
+        lines_[i] = line;
+        position += segments_[i].text.size();
+        line += segments_[i].newlines;
+    }
+
+    std::size_t shift = replacement.size() - length;
+    int line_shift = line - lines_[first] - old_newlines;
+    for (std::size_t i = first + inserted; i < segments_.size(); ++i) {
+        offsets_[i] += shift;
+        lines_[i] += line_shift;
+    }
+
+    return EditResult{first, removed, inserted};
+}
+
+std::string Document::text() const {
+    std::string result;
+    result.reserve(size());
+    for (const auto& segment : segments_) {
+        result += segment.text;
+    }
+    return result;
+}
+
+std::size_t Document::size() const {
+    return offsets_.back() + segments_.back().text.size();
+}
+
+std::size_t Document::statement_count() const {
+    return segments_.size();
+}
+
+const std::vector<StmtPtr>& Document::statements(std::size_t index) const {
+    return segments_.at(index).statements;
+}
+
+const std::vector<Token>& Document::tokens(std::size_t index) const {
+    return segments_.at(index).tokens;
+}
+
+const std::vector<Diagnostic>& Document::diagnostics(std::size_t index) const {
+    return segments_.at(index).diagnostics;
+}
+
+std::size_t Document::statement_offset(std::size_t index) const {
+    return offsets_.at(index);
+}
+
+int Document::statement_line(std::size_t index) const {
+    return lines_.at(index);
+}
+
+const std::string& Document::error() const {
+    return segments_.back().error;
+}
+
+std::size_t Document::segment_at(std::size_t offset) const {
+    auto it = std::upper_bound(offsets_.begin(), offsets_.end(), offset);
+    return static_cast<std::size_t>(it - offsets_.begin()) - 1;
+}
+
+// Splits `text` into segments. Unless the text runs to the end of the
+// document it must finish exactly on a statement boundary, with the lexer
+// outside any string, or the caller has to widen the region.
+bool Document::relex(const std::string& text, int line, bool at_end, const Segment* next,
+                     std::vector<Segment>& out) const {
+    out.clear();
+
+    std::vector<Token> tokens;
+    std::vector<std::size_t> ends;
+    std::string error;
+    try {
+        Lexer lexer(text, line);
+        while (true) {
+            Token token = lexer.next_token();
+            if (token.type == TokenType::END_OF_FILE) break;
+            tokens.push_back(std::move(token));
+            ends.push_back(lexer.position());
+        }
+    } catch (const std::exception& lex_error) {
+        // Statements before the bad token are still usable; the rest of the
+        // document becomes the trailing segment carrying the error.
+        if (!at_end) return false;
+        error = lex_error.what();
+    }
+
+    std::vector<std::size_t> boundaries = statement_boundaries(tokens);
+    std::size_t consumed = boundaries.empty() ? 0 : boundaries.back();
+    std::size_t cut = consumed == 0 ? 0 : ends[consumed - 1];
+    if (!at_end) {
+        if (cut != text.size()) return false;
+        if (!next->tokens.empty() && next->tokens.front().type == TokenType::ELSE) {
+            return false;
+        }
+    }
+
+    std::size_t first_token = 0;
+    std::size_t begin = 0;
+    auto emit = [&](std::size_t last_token, std::size_t end) {
+        // Columns of tokens starting on the segment's first line count from
+        // where it begins.
+        std::size_t newline = begin == 0 ? std::string::npos : text.rfind('\n', begin - 1);
+        int column = static_cast<int>(newline == std::string::npos ? begin : begin - newline - 1);
+        std::size_t first_line_end = text.find('\n', begin);
+        for (std::size_t i = first_token; i < last_token; ++i) {
+            if (ends[i] - tokens[i].lexeme.size() < first_line_end) tokens[i].column -= column;
+            tokens[i].line -= line - 1;
+        }
+        std::vector<Token> segment_tokens(
+            std::make_move_iterator(tokens.begin() + static_cast<std::ptrdiff_t>(first_token)),
+            std::make_move_iterator(tokens.begin() + static_cast<std::ptrdiff_t>(last_token)));
+        Segment segment = make_segment(text.substr(begin, end - begin), std::move(segment_tokens));
+        line += segment.newlines;
+        out.push_back(std::move(segment));
+        first_token = last_token;
+        begin = end;
+    };
+    for (std::size_t boundary : boundaries) {
+        emit(boundary, ends[boundary - 1]);
+    }
+    if (at_end) {
+        emit(tokens.size(), text.size());
+        out.back().error = std::move(error);
+    }
+    return true;
+}
+
+Document::Segment Document::make_segment(std::string text, std::vector<Token> tokens) {
+    Segment segment;
+    segment.newlines = static_cast<int>(std::count(text.begin(), text.end(), '\n'));
+    segment.text = std::move(text);
+
+    if (!tokens.empty()) {
+        std::vector<Token> parse_tokens = tokens;
+        const Token& last = parse_tokens.back();
+        parse_tokens.emplace_back(TokenType::END_OF_FILE, "", last.line,
+                                  last.column + static_cast<int>(last.lexeme.size()));
+        Parser parser(std::move(parse_tokens));
+        segment.statements = parser.parse();
+        segment.diagnostics = parser.diagnostics();
+    }
+    segment.tokens = std::move(tokens);
+    return segment;
+}
+
+} // namespace tl
@@ -0,0 +1,583 @@
+#include "tl/flat_ast.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace tl {
+
+std::size_t FlatAst::node_count() const {
+    return literals.size() + variables.size() + unaries.size() + binaries.size() + assigns.size() +
+           calls.size() + expression_stmts.size() + print_stmts.size() + lets.size() + blocks.size() + ifs.size() +
+           whiles.size();
+}
+
+namespace {
+
+std::uint32_t next_index(std::size_t size) {
+    if (size > ExprRef::index_mask) {
+        throw std::length_error("Too many nodes for a flat AST.");
+    }
+    return static_cast<std::uint32_t>(size);
+}
+
+class Flattener {
+public:
+    FlatAst ast;
+
+    std::uint32_t name(const std::string& text) {
+        auto [it, inserted] = names_.emplace(text, static_cast<std::uint32_t>(ast.names.size()));
+        if (inserted) ast.names.push_back(text);
+        return it->second;
+    }
+
+    ExprRef expr(const Expr* node) {
+        if (!node || dynamic_cast<const ErrorExpr*>(node)) return ExprRef{};
+
+        if (auto* literal = dynamic_cast<const LiteralExpr*>(node)) {
+            ast.literals.push_back(literal->value);
+            return ExprRef(ExprKind::LITERAL, next_index(ast.literals.size() - 1));
+        }
+        if (auto* variable = dynamic_cast<const VariableExpr*>(node)) {
+            ast.variables.push_back(name(variable->name));
+            return ExprRef(ExprKind::VARIABLE, next_index(ast.variables.size() - 1));
+        }
+        if (auto* unary = dynamic_cast<const UnaryExpr*>(node)) {
+            ExprRef operand = expr(unary->right.get());
+            ast.unaries.push_back(FlatUnary{operand, to_unary_op(unary->op.type)});
+            return ExprRef(ExprKind::UNARY, next_index(ast.unaries.size() - 1));
+        }
+        if (auto* binary = dynamic_cast<const BinaryExpr*>(node)) {
+            ExprRef left = expr(binary->left.get());
+            ExprRef right = expr(binary->right.get());
+            ast.binaries.push_back(FlatBinary{left, right, to_binary_op(binary->op.type)});
+            return ExprRef(ExprKind::BINARY, next_index(ast.binaries.size() - 1));
+        }
+        // CSE temporaries flatten to the expression they stand for.
+        if (auto* store = dynamic_cast<const TempStoreExpr*>(node)) {
+            return expr(store->value.get());
+        }
+        if (auto* load = dynamic_cast<const TempLoadExpr*>(node)) {
+            return expr(load->source);
+        }
+        if (auto* call = dynamic_cast<const CallExpr*>(node)) {
+            std::vector<ExprRef> arguments;
+            arguments.reserve(call->arguments.size());
+            for (const auto& argument : call->arguments) {
+                arguments.push_back(expr(argument.get()));
+            }
+            auto first = next_index(ast.call_arguments.size());
+            ast.call_arguments.insert(ast.call_arguments.end(), arguments.begin(), arguments.end());
+            ast.calls.push_back(FlatCall{first, static_cast<std::uint32_t>(arguments.size()), call->builtin});
+            return ExprRef(ExprKind::CALL, next_index(ast.calls.size() - 1));
+        }
+        auto* assign = static_cast<const AssignExpr*>(node);
+        ExprRef value = expr(assign->value.get());
+        ast.assigns.push_back(FlatAssign{name(assign->name), value});
+        return ExprRef(ExprKind::ASSIGN, next_index(ast.assigns.size() - 1));
+    }
+
+    StmtRef stmt(const Stmt* node) {
+        if (!node || dynamic_cast<const ErrorStmt*>(node)) return StmtRef{};
+
+        if (auto* expression = dynamic_cast<const ExpressionStmt*>(node)) {
+            ExprRef value = expr(expression->expression.get());
+            ast.expression_stmts.push_back(value);
+            return StmtRef(StmtKind::EXPRESSION, next_index(ast.expression_stmts.size() - 1));
+        }
+        if (auto* print = dynamic_cast<const PrintStmt*>(node)) {
+            ExprRef value = expr(print->expression.get());
+            ast.print_stmts.push_back(value);
+            return StmtRef(StmtKind::PRINT, next_index(ast.print_stmts.size() - 1));
+        }
+        if (auto* let = dynamic_cast<const LetStmt*>(node)) {
+            ExprRef initializer = expr(let->initializer.get());
+            ast.lets.push_back(FlatLet{name(let->name), initializer});
+            return StmtRef(StmtKind::LET, next_index(ast.lets.size() - 1));
+        }
+        if (auto* block = dynamic_cast<const BlockStmt*>(node)) {
+            // Children first, so the block's items end up contiguous.
+            std::vector<StmtRef> items;
+            items.reserve(block->statements.size());
+            for (const auto& item : block->statements) {
+                items.push_back(stmt(item.get()));
+            }
+            auto first = next_index(ast.block_items.size());
+            ast.block_items.insert(ast.block_items.end(), items.begin(), items.end());
+            ast.blocks.push_back(FlatBlock{first, static_cast<std::uint32_t>(items.size())});
+            return StmtRef(StmtKind::BLOCK, next_index(ast.blocks.size() - 1));
+        }
+        if (auto* branch = dynamic_cast<const IfStmt*>(node)) {
+            ExprRef condition = expr(branch->condition.get());
+            StmtRef then_branch = stmt(branch->then_branch.get());
+            StmtRef else_branch = stmt(branch->else_branch.get());
+            ast.ifs.push_back(FlatIf{condition, then_branch, else_branch});
+            return StmtRef(StmtKind::IF, next_index(ast.ifs.size() - 1));
+        }
+        auto* loop = static_cast<const WhileStmt*>(node);
+        ExprRef condition = expr(loop->condition.get());
+        StmtRef body = stmt(loop->body.get());
+        ast.whiles.push_back(FlatWhile{condition, body});
+        return StmtRef(StmtKind::WHILE, next_index(ast.whiles.size() - 1));
+    }
+
+private:
+    std::unordered_map<std::string, std::uint32_t> names_;
+};
+
+ExprPtr expand(const FlatAst& ast, ExprRef ref) {
+    if (ref.empty()) return nullptr;
+    std::uint32_t index = ref.index();
+    switch (ref.kind()) {
+        case ExprKind::LITERAL:
+            return std::make_unique<LiteralExpr>(ast.literals[index]);
+        case ExprKind::VARIABLE:
+            return std::make_unique<VariableExpr>(ast.names[ast.variables[index]]);
+        case ExprKind::UNARY: {
+            const FlatUnary& node = ast.unaries[index];
+            TokenType type = to_token_type(node.op);
+            return std::make_unique<UnaryExpr>(Token(type, token_type_to_string(type), Literal{}, 0),
+                                               expand(ast, node.operand));
+        }
+        case ExprKind::BINARY: {
+            const FlatBinary& node = ast.binaries[index];
+            TokenType type = to_token_type(node.op);
+            return std::make_unique<BinaryExpr>(expand(ast, node.left),
+                                                Token(type, token_type_to_string(type), Literal{}, 0),
+                                                expand(ast, node.right));
+        }
+        case ExprKind::ASSIGN: {
+            const FlatAssign& node = ast.assigns[index];
+            return std::make_unique<AssignExpr>(ast.names[node.name], expand(ast, node.value));
+        }
+        case ExprKind::CALL: {
+            const FlatCall& node = ast.calls[index];
+            std::vector<ExprPtr> arguments;
+            arguments.reserve(node.count);
+            for (std::uint32_t i = 0; i < node.count; ++i) {
+                arguments.push_back(expand(ast, ast.call_arguments[node.first + i]));
+            }
+            return std::make_unique<CallExpr>(node.builtin, std::move(arguments));
+        }
+    }
+    return nullptr;
+}
+
+StmtPtr expand(const FlatAst& ast, StmtRef ref) {
+    if (ref.empty()) return nullptr;
+    std::uint32_t index = ref.index();
+    switch (ref.kind()) {
+        case StmtKind::EXPRESSION:
+            return std::make_unique<ExpressionStmt>(expand(ast, ast.expression_stmts[index]));
+        case StmtKind::PRINT:
+            return std::make_unique<PrintStmt>(expand(ast, ast.print_stmts[index]));
+        case StmtKind::LET: {
+            const FlatLet& node = ast.lets[index];
+            return std::make_unique<LetStmt>(ast.names[node.name], expand(ast, node.initializer));
+        }
+        case StmtKind::BLOCK: {
+            const FlatBlock& node = ast.blocks[index];
+            std::vector<StmtPtr> statements;
+            statements.reserve(node.count);
+            for (std::uint32_t i = 0; i < node.count; ++i) {
+                statements.push_back(expand(ast, ast.block_items[node.first + i]));
+            }
+            return std::make_unique<BlockStmt>(std::move(statements));
+        }
+        case StmtKind::IF: {
+            const FlatIf& node = ast.ifs[index];
+            return std::make_unique<IfStmt>(expand(ast, node.condition), expand(ast, node.then_branch),
+                                            expand(ast, node.else_branch));
+        }
+        case StmtKind::WHILE: {
+            const FlatWhile& node = ast.whiles[index];
+            return std::make_unique<WhileStmt>(expand(ast, node.condition), expand(ast, node.body));
+        }
+    }
+    return nullptr;
+}
+
+class Writer {
+public:
+    std::string bytes;
+
+    void u8(std::uint8_t value) { bytes.push_back(static_cast<char>(value)); }
+
+    void u32(std::uint32_t value) {
+        for (int shift = 0; shift < 32; shift += 8) u8(static_cast<std::uint8_t>(value >> shift));
+    }
+
+    void u64(std::uint64_t value) {
+        for (int shift = 0; shift < 64; shift += 8) u8(static_cast<std::uint8_t>(value >> shift));
+    }
+
+    void text(const std::string& value) {
+        u32(static_cast<std::uint32_t>(value.size()));
+        bytes += value;
+    }
+
+    template <typename T, typename Write>
+    void array(const std::vector<T>& items, Write write) {
+        u32(static_cast<std::uint32_t>(items.size()));
+        for (const auto& item : items) write(item);
+    }
+};
+
+class Reader {
+public:
+    explicit Reader(std::string_view bytes) : bytes_(bytes), position_(0) {}
+
+    std::uint8_t u8() {
+        need(1);
+        return static_cast<std::uint8_t>(bytes_[position_++]);
+    }
+
+    std::uint32_t u32() {
+        std::uint32_t value = 0;
+        for (int shift = 0; shift < 32; shift += 8) value |= static_cast<std::uint32_t>(u8()) << shift;
+        return value;
+    }
+
+    std::uint64_t u64() {
+        std::uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 8) value |= static_cast<std::uint64_t>(u8()) << shift;
+        return value;
+    }
+
+    std::string text() {
+        std::uint32_t size = u32();
+        need(size);
+        std::string value(bytes_.substr(position_, size));
+        position_ += size;
+        return value;
+    }
+
+    template <typename T, typename Read>
+    void array(std::vector<T>& items, Read read) {
+        std::uint32_t count = u32();
+        // Every element takes at least one byte, which bounds the reserve.
+        need(count);
+        items.reserve(count);
+        for (std::uint32_t i = 0; i < count; ++i) items.push_back(read());
+    }
+
+    bool at_end() const { return position_ == bytes_.size(); }
+
+private:
+    std::string_view bytes_;
+    std::size_t position_;
+
+    void need(std::size_t count) const {
+        if (bytes_.size() - position_ < count) {
+            throw std::runtime_error("Malformed flat AST: unexpected end of data.");
+        }
+    }
+};
+
+constexpr char magic[4] = {'T', 'L', 'F', 'A'};
+constexpr std::uint32_t format_version = 2;
+
+enum class LiteralTag : std::uint8_t { NIL, NUMBER, BOOLEAN, STRING };
+
+// Checks that every reference points into its pool and that following
+// references never loops back to a node on the current path.
+class Validator {
+public:
+    explicit Validator(const FlatAst& ast)
+        : ast_(ast),
+          expr_state_{std::vector<std::uint8_t>(ast.literals.size()), std::vector<std::uint8_t>(ast.variables.size()),
+                      std::vector<std::uint8_t>(ast.unaries.size()), std::vector<std::uint8_t>(ast.binaries.size()),
+                      std::vector<std::uint8_t>(ast.assigns.size()), std::vector<std::uint8_t>(ast.calls.size())},
+          stmt_state_{std::vector<std::uint8_t>(ast.expression_stmts.size()), std::vector<std::uint8_t>(ast.print_stmts.size()),
+                      std::vector<std::uint8_t>(ast.lets.size()), std::vector<std::uint8_t>(ast.blocks.size()),
+                      std::vector<std::uint8_t>(ast.ifs.size()), std::vector<std::uint8_t>(ast.whiles.size())} {}
+
+    void run() {
+        for (std::uint32_t name : ast_.variables) check_name(name);
+        for (StmtRef ref : ast_.program) stmt(ref);
+    }
+
+private:
+    enum : std::uint8_t { UNSEEN, ACTIVE, DONE };
+
+    const FlatAst& ast_;
+    std::vector<std::uint8_t> expr_state_[6];
+    std::vector<std::uint8_t> stmt_state_[6];
+
+    [[noreturn]] static void fail(const char* what) {
+        throw std::runtime_error(std::string("Malformed flat AST: ") + what);
+    }
+
+    void check_name(std::uint32_t name) const {
+        if (name >= ast_.names.size()) fail("name index out of range.");
+    }
+
+    bool enter(std::vector<std::uint8_t>* states, unsigned kinds, unsigned kind, std::uint32_t index) {
+        if (kind >= kinds || index >= states[kind].size()) fail("node reference out of range.");
+        std::uint8_t& state = states[kind][index];
+        if (state == ACTIVE) fail("cycle between nodes.");
+        if (state == DONE) return false;
+        state = ACTIVE;
+        return true;
+    }
+
+    void expr(ExprRef ref) {
+        if (ref.empty()) return;
+        auto kind = static_cast<unsigned>(ref.kind());
+        std::uint32_t index = ref.index();
+        if (!enter(expr_state_, 6, kind, index)) return;
+        switch (ref.kind()) {
+            case ExprKind::UNARY:
+                expr(ast_.unaries[index].operand);
+                break;
+            case ExprKind::BINARY:
+                expr(ast_.binaries[index].left);
+                expr(ast_.binaries[index].right);
+                break;
+            case ExprKind::ASSIGN:
+                check_name(ast_.assigns[index].name);
+                expr(ast_.assigns[index].value);
+                break;
+            case ExprKind::CALL: {
+                const FlatCall& call = ast_.calls[index];
+                const BuiltinInfo& info = builtin_info(call.builtin);
+                if (call.count < info.min_arguments || call.count > info.max_arguments) {
+                    fail("wrong number of arguments.");
+                }
+                if (call.first > ast_.call_arguments.size() || call.count > ast_.call_arguments.size() - call.first) {
+                    fail("argument range out of range.");
+                }
+                for (std::uint32_t i = 0; i < call.count; ++i) expr(ast_.call_arguments[call.first + i]);
+                break;
+            }
+            default:
+                break;
+        }
+        expr_state_[kind][index] = DONE;
+    }
+
+    void stmt(StmtRef ref) {
+        if (ref.empty()) return;
+        auto kind = static_cast<unsigned>(ref.kind());
+        std::uint32_t index = ref.index();
+        if (!enter(stmt_state_, 6, kind, index)) return;
+        switch (ref.kind()) {
+            case StmtKind::EXPRESSION:
+                expr(ast_.expression_stmts[index]);
+                break;
+            case StmtKind::PRINT:
+                expr(ast_.print_stmts[index]);
+                break;
+            case StmtKind::LET:
+                check_name(ast_.lets[index].name);
+                expr(ast_.lets[index].initializer);
+                break;
+            case StmtKind::BLOCK: {
+                const FlatBlock& block = ast_.blocks[index];
+                if (block.first > ast_.block_items.size() || block.count > ast_.block_items.size() - block.first) {
+                    fail("block range out of range.");
+                }
+                for (std::uint32_t i = 0; i < block.count; ++i) stmt(ast_.block_items[block.first + i]);
+                break;
+            }
+            case StmtKind::IF:
+                expr(ast_.ifs[index].condition);
+                stmt(ast_.ifs[index].then_branch);
+                stmt(ast_.ifs[index].else_branch);
+                break;
+            case StmtKind::WHILE:
+                expr(ast_.whiles[index].condition);
+                stmt(ast_.whiles[index].body);
+                break;
+        }
+        stmt_state_[kind][index] = DONE;
+    }
+};
+
+} // namespace
+
+FlatAst flatten(const std::vector<StmtPtr>& program) {
+    Flattener flattener;
+    flattener.ast.program.reserve(program.size());
+    for (const auto& statement : program) {
+        flattener.ast.program.push_back(flattener.stmt(statement.get()));
+    }
+    return std::move(flattener.ast);
+}
+
+std::vector<StmtPtr> unflatten(const FlatAst& ast) {
+    std::vector<StmtPtr> program;
+    program.reserve(ast.program.size());
+    for (StmtRef ref : ast.program) {
+        program.push_back(expand(ast, ref));
+    }
+    return program;
+}
+
+std::string serialize(const FlatAst& ast) {
+    Writer out;
+    out.bytes.append(magic, sizeof(magic));
+    out.u32(format_version);
+
+    out.array(ast.names, [&](const std::string& name) { out.text(name); });
+    out.array(ast.literals, [&](const Value& value) {
+        if (std::holds_alternative<double>(value)) {
+            std::uint64_t bits;
+            double number = std::get<double>(value);
+            std::memcpy(&bits, &number, sizeof(bits));
+            out.u8(static_cast<std::uint8_t>(LiteralTag::NUMBER));
+            out.u64(bits);
+        } else if (std::holds_alternative<bool>(value)) {
+            out.u8(static_cast<std::uint8_t>(LiteralTag::BOOLEAN));
+            out.u8(std::get<bool>(value) ? 1 : 0);
+        } else if (std::holds_alternative<std::string>(value)) {
+            out.u8(static_cast<std::uint8_t>(LiteralTag::STRING));
+            out.text(std::get<std::string>(value));
+        } else {
+            out.u8(static_cast<std::uint8_t>(LiteralTag::NIL));
+        }
+    });
+    out.array(ast.variables, [&](std::uint32_t name) { out.u32(name); });
+    out.array(ast.unaries, [&](const FlatUnary& node) {
+        out.u32(node.operand.bits);
+        out.u8(static_cast<std::uint8_t>(node.op));
+    });
+    out.array(ast.binaries, [&](const FlatBinary& node) {
+        out.u32(node.left.bits);
+        out.u32(node.right.bits);
+        out.u8(static_cast<std::uint8_t>(node.op));
+    });
+    out.array(ast.assigns, [&](const FlatAssign& node) {
+        out.u32(node.name);
+        out.u32(node.value.bits);
+    });
+    out.array(ast.calls, [&](const FlatCall& node) {
+        out.u32(node.first);
+        out.u32(node.count);
+        out.u8(static_cast<std::uint8_t>(node.builtin));
+    });
+    out.array(ast.expression_stmts, [&](ExprRef ref) { out.u32(ref.bits); });
+    out.array(ast.print_stmts, [&](ExprRef ref) { out.u32(ref.bits); });
+    out.array(ast.lets, [&](const FlatLet& node) {
+        out.u32(node.name);
+        out.u32(node.initializer.bits);
+    });
+    out.array(ast.blocks, [&](const FlatBlock& node) {
+        out.u32(node.first);
+        out.u32(node.count);
+    });
+    out.array(ast.ifs, [&](const FlatIf& node) {
+        out.u32(node.condition.bits);
+        out.u32(node.then_branch.bits);
+        out.u32(node.else_branch.bits);
+    });
+    out.array(ast.whiles, [&](const FlatWhile& node) {
+        out.u32(node.condition.bits);
+        out.u32(node.body.bits);
+    });
+    out.array(ast.call_arguments, [&](ExprRef ref) { out.u32(ref.bits); });
+    out.array(ast.block_items, [&](StmtRef ref) { out.u32(ref.bits); });
+    out.array(ast.program, [&](StmtRef ref) { out.u32(ref.bits); });
+    return std::move(out.bytes);
+}
+
+FlatAst deserialize(std::string_view bytes) {
+    if (bytes.size() < sizeof(magic) || bytes.substr(0, sizeof(magic)) != std::string_view(magic, sizeof(magic))) {
+        throw std::runtime_error("Malformed flat AST: bad magic.");
+    }
+    Reader in(bytes.substr(sizeof(magic)));
+    if (in.u32() != format_version) {
+        throw std::runtime_error("Malformed flat AST: unsupported version.");
+    }
+
+    auto expr_ref = [&in] {
+        ExprRef ref;
+        ref.bits = in.u32();
+        return ref;
+    };
+    auto stmt_ref = [&in] {
+        StmtRef ref;
+        ref.bits = in.u32();
+        return ref;
+    };
+    auto binary_op = [&in] {
+        std::uint8_t op = in.u8();
+        if (op > static_cast<std::uint8_t>(BinaryOp::OR)) throw std::runtime_error("Malformed flat AST: bad operator.");
+        return static_cast<BinaryOp>(op);
+    };
+
+    FlatAst ast;
+    in.array(ast.names, [&] { return in.text(); });
+    in.array(ast.literals, [&]() -> Value {
+        switch (static_cast<LiteralTag>(in.u8())) {
+            case LiteralTag::NIL:
+                return Value{};
+            case LiteralTag::NUMBER: {
+                std::uint64_t bits = in.u64();
+                double number;
+                std::memcpy(&number, &bits, sizeof(number));
+                return Value{number};
+            }
+            case LiteralTag::BOOLEAN:
+                return Value{in.u8() != 0};
+            case LiteralTag::STRING:
+                return Value{in.text()};
+        }
+        throw std::runtime_error("Malformed flat AST: bad literal tag.");
+    });
+    in.array(ast.variables, [&] { return in.u32(); });
+    in.array(ast.unaries, [&] {
+        ExprRef operand = expr_ref();
+        std::uint8_t op = in.u8();
+        if (op > static_cast<std::uint8_t>(UnaryOp::NOT)) throw std::runtime_error("Malformed flat AST: bad operator.");
+        return FlatUnary{operand, static_cast<UnaryOp>(op)};
+    });
+    in.array(ast.binaries, [&] {
+        ExprRef left = expr_ref();
+        ExprRef right = expr_ref();
+        return FlatBinary{left, right, binary_op()};
+    });
+    in.array(ast.assigns, [&] {
+        std::uint32_t name = in.u32();
+        return FlatAssign{name, expr_ref()};
+    });
+    in.array(ast.calls, [&] {
+        std::uint32_t first = in.u32();
+        std::uint32_t count = in.u32();
+        std::uint8_t builtin = in.u8();
+        if (builtin > static_cast<std::uint8_t>(Builtin::READFILE)) {
+            throw std::runtime_error("Malformed flat AST: bad builtin.");
+        }
+        return FlatCall{first, count, static_cast<Builtin>(builtin)};
+    });
+    in.array(ast.expression_stmts, expr_ref);
+    in.array(ast.print_stmts, expr_ref);
+    in.array(ast.lets, [&] {
+        std::uint32_t name = in.u32();
+        return FlatLet{name, expr_ref()};
+    });
+    in.array(ast.blocks, [&] {
+        std::uint32_t first = in.u32();
+        return FlatBlock{first, in.u32()};
+    });
+    in.array(ast.ifs, [&] {
+        ExprRef condition = expr_ref();
+        StmtRef then_branch = stmt_ref();
+        return FlatIf{condition, then_branch, stmt_ref()};
+    });
+    in.array(ast.whiles, [&] {
+        ExprRef condition = expr_ref();
+        return FlatWhile{condition, stmt_ref()};
+    });
+    in.array(ast.call_arguments, expr_ref);
+    in.array(ast.block_items, stmt_ref);
+    in.array(ast.program, stmt_ref);
+    if (!in.at_end()) {
+        throw std::runtime_error("Malformed flat AST: trailing data.");
+    }
+
+    Validator(ast).run();
+    return ast;
+}
+
+} // namespace tl
@@ -0,0 +1,274 @@
+#include "tl/ir.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace tl {
+
+IrType type_of(const Value& value) {
+    switch (value.index()) {
+        case 0: return IrType::NIL;
+        case 1: return IrType::NUMBER;
+        case 2: return IrType::BOOL;
+        default: return IrType::STRING;
+    }
+}
+
+const char* to_string(IrType type) {
+    switch (type) {
+        case IrType::NONE: return "none";
+        case IrType::NIL: return "nil";
+        case IrType::NUMBER: return "number";
+        case IrType::BOOL: return "bool";
+        case IrType::STRING: return "string";
+        case IrType::ANY: return "any";
+    }
+    return "?";
+}
+
+ValueId IrFunction::add(BlockId block, IrOpcode opcode, std::vector<ValueId> operands, std::uint8_t op,
+                        std::uint32_t index) {
+    auto id = static_cast<ValueId>(values.size());
+    values.push_back(IrInstruction{opcode, op, block, index, std::move(operands)});
+    if (opcode == IrOpcode::PHI) {
+        blocks[block].phis.push_back(id);
+    } else {
+        blocks[block].instructions.push_back(id);
+    }
+    return id;
+}
+
+BlockId IrFunction::add_block() {
+    blocks.emplace_back();
+    return static_cast<BlockId>(blocks.size() - 1);
+}
+
+void IrFunction::add_edge(BlockId from, BlockId to) {
+    blocks[from].successors.push_back(to);
+    blocks[to].predecessors.push_back(from);
+}
+
+void IrFunction::remove_edge(BlockId from, BlockId to) {
+    auto& successors = blocks[from].successors;
+    successors.erase(std::find(successors.begin(), successors.end(), to));
+
+    auto& predecessors = blocks[to].predecessors;
+    auto it = std::find(predecessors.begin(), predecessors.end(), from);
+    auto position = it - predecessors.begin();
+    predecessors.erase(it);
+    for (ValueId phi : blocks[to].phis) {
+        auto& operands = values[phi].operands;
+        operands.erase(operands.begin() + position);
+    }
+}
+
+void IrFunction::replace(ValueId from, ValueId to) {
+    to = resolve(to);
+    if (from != to) values[from].replacement = to;
+}
+
+ValueId IrFunction::resolve(ValueId id) const {
+    while (values[id].replacement != no_value) {
+        id = values[id].replacement;
+    }
+    return id;
+}
+
+void IrFunction::canonicalize() {
+    for (BlockId block : reverse_post_order()) {
+        for (auto* list : {&blocks[block].phis, &blocks[block].instructions}) {
+            for (ValueId id : *list) {
+                for (ValueId& operand : values[id].operands) {
+                    operand = resolve(operand);
+                }
+            }
+        }
+    }
+}
+
+std::vector<BlockId> IrFunction::reverse_post_order() const {
+    std::vector<BlockId> order;
+    std::vector<bool> visited(blocks.size(), false);
+    // (block, next successor to visit)
+    std::vector<std::pair<BlockId, std::size_t>> stack{{0, 0}};
+    visited[0] = true;
+    while (!stack.empty()) {
+        auto& [block, next] = stack.back();
+        if (next < blocks[block].successors.size()) {
+            BlockId successor = blocks[block].successors[next++];
+            if (!visited[successor]) {
+                visited[successor] = true;
+                stack.emplace_back(successor, 0);
+            }
+        } else {
+            order.push_back(block);
+            stack.pop_back();
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+std::vector<BlockId> IrFunction::dominators(const std::vector<BlockId>& order) const {
+    // Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+    std::vector<std::size_t> number(blocks.size(), 0);
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        number[order[i]] = i;
+    }
+
+    std::vector<BlockId> idom(blocks.size(), no_block);
+    idom[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (std::size_t i = 1; i < order.size(); ++i) {
+            BlockId block = order[i];
+            BlockId dominator = no_block;
+            for (BlockId predecessor : blocks[block].predecessors) {
+                if (idom[predecessor] == no_block) continue;
+                if (dominator == no_block) {
+                    dominator = predecessor;
+                    continue;
+                }
+                BlockId other = predecessor;
+                while (dominator != other) {
+                    while (number[dominator] > number[other]) dominator = idom[dominator];
+                    while (number[other] > number[dominator]) other = idom[other];
+                }
+            }
+            if (idom[block] != dominator) {
+                idom[block] = dominator;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+namespace {
+
+const char* unary_name(UnaryOp op) {
+    return op == UnaryOp::NEGATE ? "neg" : "not";
+}
+
+const char* binary_name(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::ADD: return "add";
+        case BinaryOp::SUBTRACT: return "sub";
+        case BinaryOp::MULTIPLY: return "mul";
+        case BinaryOp::DIVIDE: return "div";
+        case BinaryOp::GREATER: return "gt";
+        case BinaryOp::GREATER_EQUAL: return "ge";
+        case BinaryOp::LESS: return "lt";
+        case BinaryOp::LESS_EQUAL: return "le";
+        case BinaryOp::EQUAL: return "eq";
+        case BinaryOp::NOT_EQUAL: return "ne";
+        case BinaryOp::AND: return "and";
+        case BinaryOp::OR: return "or";
+    }
+    return "?";
+}
+
+void print_constant(std::ostream& out, const Value& value) {
+    if (auto* text = std::get_if<std::string>(&value)) {
+        out << '"' << *text << '"';
+    } else {
+        out << to_string(value);
+    }
+}
+
+void print_operands(std::ostream& out, const IrFunction& function, const IrInstruction& instruction) {
+    for (std::size_t i = 0; i < instruction.operands.size(); ++i) {
+        out << (i == 0 ? " %" : ", %") << function.resolve(instruction.operands[i]);
+    }
+}
+
+} // namespace
+
+std::string to_string(const IrFunction& function) {
+    std::ostringstream out;
+    for (BlockId block : function.reverse_post_order()) {
+        const IrBlock& current = function.blocks[block];
+        out << "b" << block << ":";
+        if (!current.predecessors.empty()) {
+            out << "  ; preds";
+            for (BlockId predecessor : current.predecessors) out << " b" << predecessor;
+        }
+        out << "\n";
+
+        for (auto* list : {&current.phis, &current.instructions}) {
+            for (ValueId id : *list) {
+                const IrInstruction& instruction = function.values[id];
+                out << "  ";
+                switch (instruction.opcode) {
+                    case IrOpcode::CONST:
+                        out << "%" << id << " = const ";
+                        print_constant(out, function.constants[instruction.index]);
+                        break;
+                    case IrOpcode::PHI:
+                        out << "%" << id << " = phi";
+                        print_operands(out, function, instruction);
+                        break;
+                    case IrOpcode::UNARY:
+                        out << "%" << id << " = " << unary_name(static_cast<UnaryOp>(instruction.op));
+                        print_operands(out, function, instruction);
+                        break;
+                    case IrOpcode::BINARY:
+                        out << "%" << id << " = " << binary_name(static_cast<BinaryOp>(instruction.op));
+                        print_operands(out, function, instruction);
+                        break;
+                    case IrOpcode::NUMBER_UNARY:
+                        out << "%" << id << " = " << unary_name(static_cast<UnaryOp>(instruction.op)) << ".num";
+                        print_operands(out, function, instruction);
+                        break;
+                    case IrOpcode::NUMBER_BINARY:
+                        out << "%" << id << " = " << binary_name(static_cast<BinaryOp>(instruction.op)) << ".num";
+                        print_operands(out, function, instruction);
+                        break;
+                    case IrOpcode::CONCAT:
+                        out << "%" << id << " = concat";
+                        print_operands(out, function, instruction);
+                        break;
+                    case IrOpcode::LOAD_GLOBAL:
+                        out << "%" << id << " = load_global " << function.globals[instruction.index];
+                        break;
+                    case IrOpcode::STORE_GLOBAL:
+                        out << "store_global " << function.globals[instruction.index] << ",";
+                        print_operands(out, function, instruction);
+                        break;
+                    case IrOpcode::DEFINE_GLOBAL:
+                        out << "define_global " << function.globals[instruction.index] << ",";
+                        print_operands(out, function, instruction);
+                        break;
+                    case IrOpcode::PRINT:
+                        out << "print";
+                        print_operands(out, function, instruction);
+                        break;
+                    case IrOpcode::CALL:
+                        out << "%" << id << " = call " << builtin_info(static_cast<Builtin>(instruction.op)).name;
+                        print_operands(out, function, instruction);
+                        break;
+                    case IrOpcode::JUMP:
+                        out << "jump b" << current.successors[0];
+                        break;
+                    case IrOpcode::BRANCH:
+                        out << "branch";
+                        print_operands(out, function, instruction);
+                        out << ", b" << current.successors[0] << ", b" << current.successors[1];
+                        break;
+                    case IrOpcode::RETURN:
+                        out << "return";
+                        break;
+                }
+                if ((instruction.opcode == IrOpcode::LOAD_GLOBAL || instruction.opcode == IrOpcode::STORE_GLOBAL) &&
+                    instruction.op) {
+                    out << "  ; checked";
+                }
+                out << "\n";
+            }
+        }
+    }
+    return out.str();
+}
+
+} // namespace tl
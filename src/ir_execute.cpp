@@ -0,0 +1,130 @@
+#include "tl/ir.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace tl {
+
+namespace {
+
+// Resolves a global once per run; references into an unordered_map stay
+// valid when it rehashes.
+Value& global(const IrFunction& function, std::unordered_map<std::string, Value>& globals,
+              std::vector<Value*>& cells, std::uint32_t index) {
+    Value*& cell = cells[index];
+    if (!cell) {
+        auto it = globals.find(function.globals[index]);
+        if (it == globals.end()) {
+            throw RuntimeError("Undefined variable '" + function.globals[index] + "'.");
+        }
+        cell = &it->second;
+    }
+    return *cell;
+}
+
+} // namespace
+
+void execute(const IrFunction& function, std::unordered_map<std::string, Value>& globals) {
+    std::vector<Value> registers(function.values.size());
+    std::vector<Value*> cells(function.globals.size(), nullptr);
+    std::vector<Value> incoming;
+
+    BlockId block = 0;
+    while (true) {
+        const IrBlock& current = function.blocks[block];
+        BlockId next = no_block;
+
+        for (ValueId id : current.instructions) {
+            const IrInstruction& instruction = function.values[id];
+            const auto& operands = instruction.operands;
+            switch (instruction.opcode) {
+                case IrOpcode::CONST:
+                    registers[id] = function.constants[instruction.index];
+                    break;
+                case IrOpcode::PHI:
+                    break;
+                case IrOpcode::UNARY:
+                    registers[id] = apply_unary(static_cast<UnaryOp>(instruction.op), registers[operands[0]]);
+                    break;
+                case IrOpcode::BINARY:
+                    registers[id] = apply_binary(static_cast<BinaryOp>(instruction.op), registers[operands[0]],
+                                                  registers[operands[1]]);
+                    break;
+                case IrOpcode::NUMBER_UNARY:
+                    registers[id] = -*std::get_if<double>(&registers[operands[0]]);
+                    break;
+                case IrOpcode::NUMBER_BINARY: {
+                    double left = *std::get_if<double>(&registers[operands[0]]);
+                    double right = *std::get_if<double>(&registers[operands[1]]);
+                    switch (static_cast<BinaryOp>(instruction.op)) {
+                        case BinaryOp::ADD: registers[id] = left + right; break;
+                        case BinaryOp::SUBTRACT: registers[id] = left - right; break;
+                        case BinaryOp::MULTIPLY: registers[id] = left * right; break;
+                        case BinaryOp::DIVIDE:
+                            if (right == 0.0) throw RuntimeError("Division by zero.");
+                            registers[id] = left / right;
+                            break;
+                        case BinaryOp::GREATER: registers[id] = left > right; break;
+                        case BinaryOp::GREATER_EQUAL: registers[id] = left >= right; break;
+                        case BinaryOp::LESS: registers[id] = left < right; break;
+                        default: registers[id] = left <= right; break;
+                    }
+                    break;
+                }
+                case IrOpcode::CONCAT:
+                    registers[id] = *std::get_if<std::string>(&registers[operands[0]]) +
+                                    *std::get_if<std::string>(&registers[operands[1]]);
+                    break;
+                case IrOpcode::LOAD_GLOBAL:
+                    registers[id] = global(function, globals, cells, instruction.index);
+                    break;
+                case IrOpcode::STORE_GLOBAL:
+                    global(function, globals, cells, instruction.index) = registers[operands[0]];
+                    break;
+                case IrOpcode::DEFINE_GLOBAL: {
+                    Value*& cell = cells[instruction.index];
+                    cell = &globals[function.globals[instruction.index]];
+                    *cell = registers[operands[0]];
+                    break;
+                }
+                case IrOpcode::PRINT:
+                    write_value(std::cout, registers[operands[0]]) << '\n';
+                    break;
+                case IrOpcode::CALL: {
+                    Value arguments[max_builtin_arguments];
+                    for (std::size_t i = 0; i < operands.size(); ++i) {
+                        arguments[i] = registers[operands[i]];
+                    }
+                    registers[id] = call_builtin(static_cast<Builtin>(instruction.op), arguments, operands.size());
+                    break;
+                }
+                case IrOpcode::JUMP:
+                    next = current.successors[0];
+                    break;
+                case IrOpcode::BRANCH:
+                    next = current.successors[is_truthy(registers[operands[0]]) ? 0 : 1];
+                    break;
+                case IrOpcode::RETURN:
+                    return;
+            }
+        }
+
+        // Phis read their operands as of the end of the edge's source, so
+        // they are all evaluated before any is assigned.
+        const IrBlock& target = function.blocks[next];
+        if (!target.phis.empty()) {
+            auto position = std::find(target.predecessors.begin(), target.predecessors.end(), block) -
+                            target.predecessors.begin();
+            incoming.clear();
+            for (ValueId phi : target.phis) {
+                incoming.push_back(registers[function.values[phi].operands[position]]);
+            }
+            for (std::size_t i = 0; i < target.phis.size(); ++i) {
+                registers[target.phis[i]] = std::move(incoming[i]);
+            }
+        }
+        block = next;
+    }
+}
+
+} // namespace tl
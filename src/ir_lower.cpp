@@ -0,0 +1,332 @@
+#include "tl/ir.hpp"
+
+#include <algorithm>
+
+namespace tl {
+
+namespace {
+
+// Builds SSA directly from the AST with the algorithm of Braun et al.,
+// "Simple and Efficient Construction of Static Single Assignment Form":
+// each block records the latest definition of every variable, reads look
+// through predecessors, and a block's phis are completed once it is sealed
+// (all of its predecessors are known).
+class Lowering {
+public:
+    explicit Lowering(const std::unordered_map<std::string, Value>& globals)
+        : existing_(globals) {
+        // Block 0 only holds the loads of globals the unit starts with, so
+        // they can be appended as they are discovered.
+        new_block();
+        seal(0);
+        current_ = new_block();
+        function_.add_edge(0, current_);
+        seal(current_);
+    }
+
+    IrFunction finish(const std::vector<StmtPtr>& program) {
+        for (const auto& statement : program) {
+            stmt(statement.get());
+        }
+        function_.add(current_, IrOpcode::RETURN);
+        function_.add(0, IrOpcode::JUMP);
+        function_.canonicalize();
+        return std::move(function_);
+    }
+
+private:
+    static constexpr std::uint32_t no_variable = ~0u;
+
+    struct Variable {
+        bool global;
+        std::uint32_t global_name; // index into function_.globals
+        std::uint32_t name;        // index into function_.names
+    };
+
+    IrFunction function_;
+    const std::unordered_map<std::string, Value>& existing_;
+    BlockId current_ = 0;
+
+    std::vector<Variable> variables_;
+    std::vector<std::unordered_map<std::string, std::uint32_t>> scopes_;
+    // Globals known to exist, as variables; the rest are only accessed
+    // through checked loads and stores.
+    std::unordered_map<std::string, std::uint32_t> global_variables_;
+    std::unordered_map<std::string, std::uint32_t> global_names_;
+    std::unordered_map<std::string, std::uint32_t> names_;
+    std::vector<ValueId> temps_;
+
+    std::vector<std::unordered_map<std::uint32_t, ValueId>> defs_;
+    std::vector<bool> sealed_;
+    std::vector<std::vector<std::pair<std::uint32_t, ValueId>>> incomplete_;
+
+    BlockId new_block() {
+        defs_.emplace_back();
+        sealed_.push_back(false);
+        incomplete_.emplace_back();
+        return function_.add_block();
+    }
+
+    void seal(BlockId block) {
+        for (auto [variable, phi] : incomplete_[block]) {
+            add_phi_operands(variable, phi);
+        }
+        incomplete_[block].clear();
+        sealed_[block] = true;
+    }
+
+    void jump(BlockId target) {
+        function_.add(current_, IrOpcode::JUMP);
+        function_.add_edge(current_, target);
+    }
+
+    std::uint32_t global_name(const std::string& name) {
+        auto [it, inserted] = global_names_.emplace(name, static_cast<std::uint32_t>(function_.globals.size()));
+        if (inserted) function_.globals.push_back(name);
+        return it->second;
+    }
+
+    std::uint32_t variable_name(const std::string& name) {
+        auto [it, inserted] = names_.emplace(name, static_cast<std::uint32_t>(function_.names.size()));
+        if (inserted) function_.names.push_back(name);
+        return it->second;
+    }
+
+    std::uint32_t global_variable(const std::string& name) {
+        auto it = global_variables_.find(name);
+        if (it != global_variables_.end()) return it->second;
+        auto variable = static_cast<std::uint32_t>(variables_.size());
+        variables_.push_back(Variable{true, global_name(name), variable_name(name)});
+        global_variables_.emplace(name, variable);
+        return variable;
+    }
+
+    std::uint32_t lookup(const std::string& name) {
+        for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); ++scope) {
+            auto it = scope->find(name);
+            if (it != scope->end()) return it->second;
+        }
+        auto it = global_variables_.find(name);
+        if (it != global_variables_.end()) return it->second;
+        // Only a top-level `let` in this unit can define a global, so one
+        // that is not defined yet stays undefined until then.
+        if (existing_.count(name)) return global_variable(name);
+        return no_variable;
+    }
+
+    void write(std::uint32_t variable, BlockId block, ValueId value) {
+        defs_[block][variable] = value;
+        std::uint32_t& name = function_.values[function_.resolve(value)].name;
+        if (name == no_name) name = variables_[variable].name;
+    }
+
+    ValueId read(std::uint32_t variable, BlockId block) {
+        auto it = defs_[block].find(variable);
+        if (it != defs_[block].end()) return function_.resolve(it->second);
+        return read_recursive(variable, block);
+    }
+
+    ValueId read_recursive(std::uint32_t variable, BlockId block) {
+        const auto& predecessors = function_.blocks[block].predecessors;
+        ValueId value;
+        if (!sealed_[block]) {
+            value = function_.add(block, IrOpcode::PHI);
+            incomplete_[block].emplace_back(variable, value);
+        } else if (predecessors.size() == 1) {
+            value = read(variable, predecessors[0]);
+        } else if (predecessors.empty()) {
+            value = entry_value(variable);
+        } else {
+            value = function_.add(block, IrOpcode::PHI);
+            write(variable, block, value);
+            value = add_phi_operands(variable, value);
+        }
+        write(variable, block, value);
+        return value;
+    }
+
+    // Scoping puts a definition of every local, and of every global created
+    // by this unit, before its reads, so only globals the unit starts with
+    // get here.
+    ValueId entry_value(std::uint32_t variable) {
+        const Variable& current = variables_[variable];
+        if (!current.global) return nil(0);
+        ValueId value = function_.add(0, IrOpcode::LOAD_GLOBAL, {}, 0, current.global_name);
+        // Block 0 runs first, and the unit runs as soon as it is lowered.
+        function_.values[value].type = type_of(existing_.at(function_.globals[current.global_name]));
+        return value;
+    }
+
+    ValueId add_phi_operands(std::uint32_t variable, ValueId phi) {
+        for (BlockId predecessor : function_.blocks[function_.values[phi].block].predecessors) {
+            ValueId operand = read(variable, predecessor);
+            function_.values[phi].operands.push_back(operand);
+        }
+        return remove_trivial_phi(phi);
+    }
+
+    ValueId remove_trivial_phi(ValueId phi) {
+        ValueId same = no_value;
+        for (ValueId operand : function_.values[phi].operands) {
+            operand = function_.resolve(operand);
+            if (operand == same || operand == phi) continue;
+            if (same != no_value) return phi;
+            same = operand;
+        }
+        if (same == no_value) return phi;
+
+        auto& phis = function_.blocks[function_.values[phi].block].phis;
+        phis.erase(std::find(phis.begin(), phis.end(), phi));
+        function_.replace(phi, same);
+        return same;
+    }
+
+    ValueId constant(Value value, BlockId block) {
+        function_.constants.push_back(std::move(value));
+        return function_.add(block, IrOpcode::CONST, {}, 0,
+                             static_cast<std::uint32_t>(function_.constants.size() - 1));
+    }
+
+    // Built in place: moving in a temporary nil trips -Wmaybe-uninitialized.
+    ValueId nil(BlockId block) {
+        function_.constants.emplace_back();
+        return function_.add(block, IrOpcode::CONST, {}, 0,
+                             static_cast<std::uint32_t>(function_.constants.size() - 1));
+    }
+
+    ValueId expr(const Expr* node) {
+        if (auto* literal = dynamic_cast<const LiteralExpr*>(node)) {
+            return constant(literal->value, current_);
+        }
+        if (auto* variable = dynamic_cast<const VariableExpr*>(node)) {
+            std::uint32_t id = lookup(variable->name);
+            if (id != no_variable) return read(id, current_);
+            return function_.add(current_, IrOpcode::LOAD_GLOBAL, {}, 1, global_name(variable->name));
+        }
+        if (auto* unary = dynamic_cast<const UnaryExpr*>(node)) {
+            ValueId right = expr(unary->right.get());
+            return function_.add(current_, IrOpcode::UNARY, {right},
+                                 static_cast<std::uint8_t>(to_unary_op(unary->op.type)));
+        }
+        if (auto* binary = dynamic_cast<const BinaryExpr*>(node)) {
+            ValueId left = expr(binary->left.get());
+            ValueId right = expr(binary->right.get());
+            return function_.add(current_, IrOpcode::BINARY, {left, right},
+                                 static_cast<std::uint8_t>(to_binary_op(binary->op.type)));
+        }
+        if (auto* assign = dynamic_cast<const AssignExpr*>(node)) {
+            ValueId value = expr(assign->value.get());
+            std::uint32_t id = lookup(assign->name);
+            if (id == no_variable) {
+                function_.add(current_, IrOpcode::STORE_GLOBAL, {value}, 1, global_name(assign->name));
+                return value;
+            }
+            if (variables_[id].global) {
+                function_.add(current_, IrOpcode::STORE_GLOBAL, {value}, 0, variables_[id].global_name);
+            }
+            write(id, current_, value);
+            return value;
+        }
+        if (auto* call = dynamic_cast<const CallExpr*>(node)) {
+            std::vector<ValueId> arguments;
+            for (const auto& argument : call->arguments) {
+                arguments.push_back(expr(argument.get()));
+            }
+            return function_.add(current_, IrOpcode::CALL, std::move(arguments),
+                                 static_cast<std::uint8_t>(call->builtin));
+        }
+        if (auto* store = dynamic_cast<const TempStoreExpr*>(node)) {
+            ValueId value = expr(store->value.get());
+            if (store->slot >= temps_.size()) temps_.resize(store->slot + 1, no_value);
+            temps_[store->slot] = value;
+            return value;
+        }
+        if (auto* load = dynamic_cast<const TempLoadExpr*>(node)) {
+            return function_.resolve(temps_[load->slot]);
+        }
+        throw RuntimeError("Cannot evaluate an expression with syntax errors.");
+    }
+
+    void stmt(const Stmt* node) {
+        if (!node) return;
+
+        if (auto* expression = dynamic_cast<const ExpressionStmt*>(node)) {
+            expr(expression->expression.get());
+        } else if (auto* print = dynamic_cast<const PrintStmt*>(node)) {
+            ValueId value = expr(print->expression.get());
+            function_.add(current_, IrOpcode::PRINT, {value});
+        } else if (auto* let = dynamic_cast<const LetStmt*>(node)) {
+            ValueId value = let->initializer ? expr(let->initializer.get()) : nil(current_);
+            if (scopes_.empty()) {
+                std::uint32_t id = global_variable(let->name);
+                function_.add(current_, IrOpcode::DEFINE_GLOBAL, {value}, 0, variables_[id].global_name);
+                write(id, current_, value);
+            } else {
+                auto id = static_cast<std::uint32_t>(variables_.size());
+                variables_.push_back(Variable{false, 0, variable_name(let->name)});
+                scopes_.back()[let->name] = id;
+                write(id, current_, value);
+            }
+        } else if (auto* block = dynamic_cast<const BlockStmt*>(node)) {
+            scopes_.emplace_back();
+            for (const auto& statement : block->statements) {
+                stmt(statement.get());
+            }
+            scopes_.pop_back();
+        } else if (auto* branch = dynamic_cast<const IfStmt*>(node)) {
+            ValueId condition = expr(branch->condition.get());
+            function_.add(current_, IrOpcode::BRANCH, {condition});
+            BlockId start = current_;
+            BlockId then_block = new_block();
+            BlockId else_block = branch->else_branch ? new_block() : no_block;
+            BlockId join = new_block();
+            function_.add_edge(start, then_block);
+            function_.add_edge(start, branch->else_branch ? else_block : join);
+
+            seal(then_block);
+            current_ = then_block;
+            stmt(branch->then_branch.get());
+            jump(join);
+
+            if (branch->else_branch) {
+                seal(else_block);
+                current_ = else_block;
+                stmt(branch->else_branch.get());
+                jump(join);
+            }
+
+            seal(join);
+            current_ = join;
+        } else if (auto* loop = dynamic_cast<const WhileStmt*>(node)) {
+            BlockId header = new_block();
+            jump(header);
+            current_ = header;
+            ValueId condition = expr(loop->condition.get());
+            function_.add(header, IrOpcode::BRANCH, {condition});
+            BlockId body = new_block();
+            BlockId exit = new_block();
+            function_.add_edge(header, body);
+            function_.add_edge(header, exit);
+
+            seal(body);
+            current_ = body;
+            stmt(loop->body.get());
+            jump(header);
+
+            seal(header);
+            seal(exit);
+            current_ = exit;
+        } else {
+            throw RuntimeError("Cannot execute a statement with syntax errors.");
+        }
+    }
+};
+
+} // namespace
+
+IrFunction lower_to_ir(const std::vector<StmtPtr>& program,
+                       const std::unordered_map<std::string, Value>& globals) {
+    return Lowering(globals).finish(program);
+}
+
+} // namespace tl
@@ -0,0 +1,647 @@
+#include "tl/ir_passes.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <unordered_map>
+
+namespace tl {
+
+namespace {
+
+IrType join(IrType a, IrType b) {
+    if (a == IrType::NONE) return b;
+    if (b == IrType::NONE || a == b) return a;
+    return IrType::ANY;
+}
+
+IrType result_type(const IrFunction& function, const IrInstruction& instruction,
+                   const std::vector<IrType>& types) {
+    auto operand = [&](std::size_t i) { return types[function.resolve(instruction.operands[i])]; };
+
+    switch (instruction.opcode) {
+        case IrOpcode::CONST:
+            return type_of(function.constants[instruction.index]);
+        case IrOpcode::PHI: {
+            IrType type = IrType::NONE;
+            for (std::size_t i = 0; i < instruction.operands.size(); ++i) {
+                type = join(type, operand(i));
+            }
+            return type;
+        }
+        case IrOpcode::UNARY:
+            return static_cast<UnaryOp>(instruction.op) == UnaryOp::NOT ? IrType::BOOL : IrType::NUMBER;
+        case IrOpcode::BINARY:
+            switch (static_cast<BinaryOp>(instruction.op)) {
+                case BinaryOp::ADD: {
+                    IrType left = operand(0);
+                    IrType right = operand(1);
+                    if (left == IrType::NONE || right == IrType::NONE) return IrType::NONE;
+                    if (left == IrType::NUMBER || right == IrType::NUMBER) return IrType::NUMBER;
+                    if (left == IrType::STRING || right == IrType::STRING) return IrType::STRING;
+                    return IrType::ANY;
+                }
+                case BinaryOp::SUBTRACT:
+                case BinaryOp::MULTIPLY:
+                case BinaryOp::DIVIDE:
+                    return IrType::NUMBER;
+                default:
+                    return IrType::BOOL;
+            }
+        case IrOpcode::NUMBER_UNARY:
+            return IrType::NUMBER;
+        case IrOpcode::NUMBER_BINARY:
+            switch (static_cast<BinaryOp>(instruction.op)) {
+                case BinaryOp::ADD:
+                case BinaryOp::SUBTRACT:
+                case BinaryOp::MULTIPLY:
+                case BinaryOp::DIVIDE:
+                    return IrType::NUMBER;
+                default:
+                    return IrType::BOOL;
+            }
+        case IrOpcode::CONCAT:
+            return IrType::STRING;
+        case IrOpcode::LOAD_GLOBAL:
+            return instruction.type;
+        case IrOpcode::CALL:
+            switch (static_cast<Builtin>(instruction.op)) {
+                case Builtin::LINES: return IrType::NUMBER;
+                case Builtin::READFILE: return IrType::STRING;
+                default: return IrType::ANY;
+            }
+        default:
+            return IrType::NONE;
+    }
+}
+
+bool is_arithmetic(BinaryOp op) {
+    return op == BinaryOp::ADD || op == BinaryOp::SUBTRACT || op == BinaryOp::MULTIPLY || op == BinaryOp::DIVIDE;
+}
+
+bool is_constant(const IrFunction& function, ValueId id) {
+    return function.values[function.resolve(id)].opcode == IrOpcode::CONST;
+}
+
+const Value& constant_value(const IrFunction& function, ValueId id) {
+    return function.constants[function.values[function.resolve(id)].index];
+}
+
+bool is_operator(IrOpcode opcode) {
+    switch (opcode) {
+        case IrOpcode::UNARY:
+        case IrOpcode::BINARY:
+        case IrOpcode::NUMBER_UNARY:
+        case IrOpcode::NUMBER_BINARY:
+        case IrOpcode::CONCAT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool has_side_effects(IrOpcode opcode) {
+    switch (opcode) {
+        case IrOpcode::STORE_GLOBAL:
+        case IrOpcode::DEFINE_GLOBAL:
+        case IrOpcode::PRINT:
+        case IrOpcode::CALL:
+        case IrOpcode::JUMP:
+        case IrOpcode::BRANCH:
+        case IrOpcode::RETURN:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Removes the ids in `list` for which `drop` is true.
+template <typename Predicate>
+void remove_if(std::vector<ValueId>& list, Predicate drop) {
+    list.erase(std::remove_if(list.begin(), list.end(), drop), list.end());
+}
+
+std::vector<std::vector<BlockId>> dominator_tree(const std::vector<BlockId>& order,
+                                                 const std::vector<BlockId>& idom) {
+    std::vector<std::vector<BlockId>> children(idom.size());
+    for (BlockId block : order) {
+        if (block != 0) children[idom[block]].push_back(block);
+    }
+    return children;
+}
+
+} // namespace
+
+std::vector<IrType> infer_types(const IrFunction& function) {
+    std::vector<IrType> types(function.values.size(), IrType::NONE);
+    std::vector<BlockId> order = function.reverse_post_order();
+
+    // Types only move up the lattice, so this settles after a few sweeps.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (BlockId block : order) {
+            for (auto* list : {&function.blocks[block].phis, &function.blocks[block].instructions}) {
+                for (ValueId id : *list) {
+                    IrType type = result_type(function, function.values[id], types);
+                    if (type != types[id]) {
+                        types[id] = type;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+    return types;
+}
+
+bool may_throw(const IrFunction& function, const IrInstruction& instruction, const std::vector<IrType>& types) {
+    auto operand = [&](std::size_t i) { return types[function.resolve(instruction.operands[i])]; };
+
+    switch (instruction.opcode) {
+        case IrOpcode::UNARY:
+            return static_cast<UnaryOp>(instruction.op) == UnaryOp::NEGATE && operand(0) != IrType::NUMBER;
+        case IrOpcode::BINARY: {
+            IrType left = operand(0);
+            IrType right = operand(1);
+            bool numbers = left == IrType::NUMBER && right == IrType::NUMBER;
+            switch (static_cast<BinaryOp>(instruction.op)) {
+                case BinaryOp::ADD:
+                    return !numbers && !(left == IrType::STRING && right == IrType::STRING);
+                case BinaryOp::DIVIDE:
+                    return !numbers || !is_constant(function, instruction.operands[1]) ||
+                           std::get<double>(constant_value(function, instruction.operands[1])) == 0.0;
+                case BinaryOp::EQUAL:
+                case BinaryOp::NOT_EQUAL:
+                case BinaryOp::AND:
+                case BinaryOp::OR:
+                    return false;
+                default:
+                    return !numbers;
+            }
+        }
+        case IrOpcode::NUMBER_BINARY:
+            return static_cast<BinaryOp>(instruction.op) == BinaryOp::DIVIDE &&
+                   (!is_constant(function, instruction.operands[1]) ||
+                    std::get<double>(constant_value(function, instruction.operands[1])) == 0.0);
+        case IrOpcode::LOAD_GLOBAL:
+        case IrOpcode::STORE_GLOBAL:
+            return instruction.op != 0;
+        case IrOpcode::CALL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void ConstantPropagation::run(IrFunction& function) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        std::vector<BlockId> order = function.reverse_post_order();
+
+        for (BlockId block : order) {
+            std::vector<ValueId> phis = function.blocks[block].phis;
+            for (ValueId phi : phis) {
+                ValueId same = no_value;
+                bool trivial = true;
+                for (ValueId operand : function.values[phi].operands) {
+                    operand = function.resolve(operand);
+                    if (operand == phi || operand == same) continue;
+                    if (same != no_value) {
+                        trivial = false;
+                        break;
+                    }
+                    same = operand;
+                }
+                if (trivial && same != no_value) {
+                    function.replace(phi, same);
+                    remove_if(function.blocks[block].phis, [phi](ValueId id) { return id == phi; });
+                    changed = true;
+                }
+            }
+
+            for (ValueId id : function.blocks[block].instructions) {
+                IrInstruction& instruction = function.values[id];
+                if (instruction.opcode == IrOpcode::UNARY || instruction.opcode == IrOpcode::BINARY) {
+                    if (!std::all_of(instruction.operands.begin(), instruction.operands.end(),
+                                     [&](ValueId operand) { return is_constant(function, operand); })) {
+                        continue;
+                    }
+                    Value folded;
+                    try {
+                        if (instruction.opcode == IrOpcode::UNARY) {
+                            folded = apply_unary(static_cast<UnaryOp>(instruction.op),
+                                                 constant_value(function, instruction.operands[0]));
+                        } else {
+                            folded = apply_binary(static_cast<BinaryOp>(instruction.op),
+                                                  constant_value(function, instruction.operands[0]),
+                                                  constant_value(function, instruction.operands[1]));
+                        }
+                    } catch (const RuntimeError&) {
+                        // Left in place to fail at run time.
+                        continue;
+                    }
+                    function.constants.push_back(std::move(folded));
+                    instruction.opcode = IrOpcode::CONST;
+                    instruction.index = static_cast<std::uint32_t>(function.constants.size() - 1);
+                    instruction.operands.clear();
+                    changed = true;
+                } else if (instruction.opcode == IrOpcode::BRANCH && is_constant(function, instruction.operands[0])) {
+                    bool taken = is_truthy(constant_value(function, instruction.operands[0]));
+                    BlockId dropped = function.blocks[block].successors[taken ? 1 : 0];
+                    instruction.opcode = IrOpcode::JUMP;
+                    instruction.operands.clear();
+                    function.remove_edge(block, dropped);
+                    changed = true;
+                }
+            }
+        }
+
+        // Detach blocks that are no longer reachable.
+        std::vector<bool> reachable(function.blocks.size(), false);
+        for (BlockId block : function.reverse_post_order()) {
+            reachable[block] = true;
+        }
+        for (BlockId block = 0; block < function.blocks.size(); ++block) {
+            if (reachable[block] || function.blocks[block].instructions.empty()) continue;
+            std::vector<BlockId> successors = function.blocks[block].successors;
+            for (BlockId successor : successors) {
+                if (reachable[successor]) function.remove_edge(block, successor);
+            }
+            function.blocks[block] = IrBlock{};
+            changed = true;
+        }
+    }
+}
+
+void DeadCodeElimination::run(IrFunction& function) {
+    std::vector<IrType> types = infer_types(function);
+    std::vector<BlockId> order = function.reverse_post_order();
+    std::vector<bool> live(function.values.size(), false);
+    std::vector<ValueId> worklist;
+
+    for (BlockId block : order) {
+        for (ValueId id : function.blocks[block].instructions) {
+            const IrInstruction& instruction = function.values[id];
+            if (has_side_effects(instruction.opcode) || may_throw(function, instruction, types)) {
+                live[id] = true;
+                worklist.push_back(id);
+            }
+        }
+    }
+    while (!worklist.empty()) {
+        ValueId id = worklist.back();
+        worklist.pop_back();
+        for (ValueId operand : function.values[id].operands) {
+            operand = function.resolve(operand);
+            if (!live[operand]) {
+                live[operand] = true;
+                worklist.push_back(operand);
+            }
+        }
+    }
+
+    for (BlockId block : order) {
+        remove_if(function.blocks[block].phis, [&live](ValueId id) { return !live[id]; });
+        remove_if(function.blocks[block].instructions, [&live](ValueId id) { return !live[id]; });
+    }
+}
+
+void GlobalValueNumbering::run(IrFunction& function) {
+    struct Key {
+        IrOpcode opcode;
+        std::uint8_t op;
+        std::uint32_t a;
+        std::uint32_t b;
+
+        bool operator==(const Key& other) const {
+            return opcode == other.opcode && op == other.op && a == other.a && b == other.b;
+        }
+    };
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const {
+            std::size_t hash = static_cast<std::size_t>(key.opcode) << 8 | key.op;
+            hash = hash * 0x9e3779b97f4a7c15ull ^ key.a;
+            return hash * 0x9e3779b97f4a7c15ull ^ key.b;
+        }
+    };
+
+    // Equal constants share the index of the first one. Numbers compare by
+    // bit pattern, so -0 and 0 stay apart.
+    auto constant_hash = [&function](std::uint32_t index) {
+        const Value& value = function.constants[index];
+        if (auto* number = std::get_if<double>(&value)) {
+            std::uint64_t bits;
+            std::memcpy(&bits, number, sizeof(bits));
+            return std::hash<std::uint64_t>()(bits);
+        }
+        return std::hash<Value>()(value);
+    };
+    auto constant_equal = [&function](std::uint32_t a, std::uint32_t b) {
+        const Value& left = function.constants[a];
+        const Value& right = function.constants[b];
+        if (left.index() != right.index()) return false;
+        if (auto* number = std::get_if<double>(&left)) {
+            return std::memcmp(number, &std::get<double>(right), sizeof(double)) == 0;
+        }
+        return left == right;
+    };
+    std::unordered_map<std::uint32_t, std::uint32_t, decltype(constant_hash), decltype(constant_equal)> constants(
+        16, constant_hash, constant_equal);
+
+    std::vector<BlockId> order = function.reverse_post_order();
+    std::vector<BlockId> idom = function.dominators(order);
+    std::vector<std::vector<BlockId>> children = dominator_tree(order, idom);
+
+    // A scoped table: entries added in a block are undone when the walk
+    // leaves its subtree of the dominator tree.
+    std::unordered_map<Key, ValueId, KeyHash> available;
+    std::vector<Key> added;
+    std::vector<bool> redundant(function.values.size(), false);
+
+    struct Frame {
+        BlockId block;
+        std::size_t child;
+        std::size_t mark;
+    };
+    std::vector<Frame> stack;
+
+    auto enter = [&](BlockId block) {
+        stack.push_back(Frame{block, 0, added.size()});
+        for (ValueId id : function.blocks[block].instructions) {
+            IrInstruction& instruction = function.values[id];
+            Key key{instruction.opcode, instruction.op, 0, 0};
+            if (instruction.opcode == IrOpcode::CONST) {
+                key.a = constants.emplace(instruction.index, instruction.index).first->second;
+            } else if (is_operator(instruction.opcode)) {
+                for (ValueId& operand : instruction.operands) {
+                    operand = function.resolve(operand);
+                }
+                key.a = instruction.operands[0];
+                key.b = instruction.operands.size() > 1 ? instruction.operands[1] : no_value;
+            } else {
+                continue;
+            }
+            auto [it, inserted] = available.emplace(key, id);
+            if (inserted) {
+                added.push_back(key);
+            } else {
+                function.replace(id, it->second);
+                redundant[id] = true;
+            }
+        }
+        remove_if(function.blocks[block].instructions, [&redundant](ValueId id) { return redundant[id]; });
+    };
+
+    enter(0);
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (frame.child < children[frame.block].size()) {
+            enter(children[frame.block][frame.child++]);
+            continue;
+        }
+        while (added.size() > frame.mark) {
+            available.erase(added.back());
+            added.pop_back();
+        }
+        stack.pop_back();
+    }
+}
+
+void LoopInvariantCodeMotion::run(IrFunction& function) {
+    std::vector<BlockId> order = function.reverse_post_order();
+    std::vector<IrType> types = infer_types(function);
+
+    std::vector<std::size_t> number(function.blocks.size(), 0);
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        number[order[i]] = i;
+    }
+
+    // Natural loops, one per header. The graph comes from structured code,
+    // so an edge is a back edge exactly when it does not go forward in RPO.
+    struct Loop {
+        BlockId header;
+        std::vector<BlockId> blocks;
+    };
+    std::vector<Loop> loops;
+    std::vector<bool> inside(function.blocks.size(), false);
+    for (BlockId header : order) {
+        std::vector<BlockId> blocks{header};
+        std::vector<BlockId> worklist;
+        bool is_loop = false;
+        inside[header] = true;
+        for (BlockId latch : function.blocks[header].predecessors) {
+            if (number[latch] < number[header]) continue;
+            is_loop = true;
+            if (!inside[latch]) {
+                inside[latch] = true;
+                worklist.push_back(latch);
+            }
+        }
+        while (!worklist.empty()) {
+            BlockId block = worklist.back();
+            worklist.pop_back();
+            blocks.push_back(block);
+            for (BlockId predecessor : function.blocks[block].predecessors) {
+                if (!inside[predecessor]) {
+                    inside[predecessor] = true;
+                    worklist.push_back(predecessor);
+                }
+            }
+        }
+        for (BlockId block : blocks) inside[block] = false;
+        if (!is_loop) continue;
+        std::sort(blocks.begin(), blocks.end(), [&number](BlockId a, BlockId b) { return number[a] < number[b]; });
+        loops.push_back(Loop{header, std::move(blocks)});
+    }
+
+    // Inner loops first, so their invariants can move on out of outer ones.
+    std::sort(loops.begin(), loops.end(),
+              [](const Loop& a, const Loop& b) { return a.blocks.size() < b.blocks.size(); });
+
+    for (const Loop& loop : loops) {
+        for (BlockId block : loop.blocks) inside[block] = true;
+        // The one block that enters the loop, and does nothing else.
+        BlockId preheader = no_block;
+        std::size_t entries = 0;
+        for (BlockId predecessor : function.blocks[loop.header].predecessors) {
+            if (!inside[predecessor]) {
+                preheader = predecessor;
+                ++entries;
+            }
+        }
+
+        if (entries == 1 && function.blocks[preheader].successors.size() == 1) {
+            auto& target = function.blocks[preheader].instructions;
+            for (BlockId block : loop.blocks) {
+                auto& instructions = function.blocks[block].instructions;
+                std::vector<ValueId> kept;
+                for (ValueId id : instructions) {
+                    IrInstruction& instruction = function.values[id];
+                    bool movable = instruction.opcode == IrOpcode::CONST ||
+                                   (is_operator(instruction.opcode) && !may_throw(function, instruction, types));
+                    for (ValueId operand : instruction.operands) {
+                        movable = movable && !inside[function.values[function.resolve(operand)].block];
+                    }
+                    if (!movable) {
+                        kept.push_back(id);
+                        continue;
+                    }
+                    // Before the preheader's jump.
+                    target.insert(target.end() - 1, id);
+                    instruction.block = preheader;
+                }
+                instructions = std::move(kept);
+            }
+        }
+
+        for (BlockId block : loop.blocks) inside[block] = false;
+    }
+}
+
+void PassManager::add(std::unique_ptr<IrPass> pass) {
+    passes_.push_back(Entry{std::move(pass)});
+}
+
+void PassManager::run(IrFunction& function) {
+    for (auto& entry : passes_) {
+        auto start = std::chrono::steady_clock::now();
+        entry.pass->run(function);
+        function.canonicalize();
+        entry.time += std::chrono::steady_clock::now() - start;
+        ++entry.runs;
+    }
+}
+
+void PassManager::report(std::ostream& out) const {
+    out << std::left << std::setw(12) << "pass" << std::right << std::setw(10) << "runs" << std::setw(14)
+        << "time (ms)" << "\n";
+    for (const auto& entry : passes_) {
+        double milliseconds = std::chrono::duration<double, std::milli>(entry.time).count();
+        out << std::left << std::setw(12) << entry.pass->name() << std::right << std::setw(10) << entry.runs
+            << std::setw(14) << std::fixed << std::setprecision(3) << milliseconds << "\n";
+    }
+}
+
+void TypeSpecialization::run(IrFunction& function) {
+    std::vector<IrType> types = infer_types(function);
+    for (BlockId block : function.reverse_post_order()) {
+        for (auto* list : {&function.blocks[block].phis, &function.blocks[block].instructions}) {
+            for (ValueId id : *list) {
+                IrInstruction& instruction = function.values[id];
+                instruction.type = types[id];
+                if (instruction.opcode == IrOpcode::UNARY) {
+                    if (static_cast<UnaryOp>(instruction.op) == UnaryOp::NEGATE &&
+                        types[instruction.operands[0]] == IrType::NUMBER) {
+                        instruction.opcode = IrOpcode::NUMBER_UNARY;
+                    }
+                } else if (instruction.opcode == IrOpcode::BINARY) {
+                    IrType left = types[instruction.operands[0]];
+                    IrType right = types[instruction.operands[1]];
+                    auto op = static_cast<BinaryOp>(instruction.op);
+                    // eq, ne, and and or never fail, so there is nothing to skip.
+                    bool ordered = is_arithmetic(op) || op == BinaryOp::GREATER || op == BinaryOp::GREATER_EQUAL ||
+                                   op == BinaryOp::LESS || op == BinaryOp::LESS_EQUAL;
+                    if (ordered && left == IrType::NUMBER && right == IrType::NUMBER) {
+                        instruction.opcode = IrOpcode::NUMBER_BINARY;
+                    } else if (op == BinaryOp::ADD && left == IrType::STRING && right == IrType::STRING) {
+                        instruction.opcode = IrOpcode::CONCAT;
+                    }
+                }
+            }
+        }
+    }
+}
+
+PassManager default_pipeline() {
+    PassManager passes;
+    passes.add(std::make_unique<ConstantPropagation>());
+    passes.add(std::make_unique<GlobalValueNumbering>());
+    passes.add(std::make_unique<LoopInvariantCodeMotion>());
+    passes.add(std::make_unique<DeadCodeElimination>());
+    passes.add(std::make_unique<TypeSpecialization>());
+    return passes;
+}
+
+namespace {
+
+const char* binary_symbol(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::ADD: return "+";
+        case BinaryOp::SUBTRACT: return "-";
+        case BinaryOp::MULTIPLY: return "*";
+        case BinaryOp::DIVIDE: return "/";
+        case BinaryOp::GREATER: return ">";
+        case BinaryOp::GREATER_EQUAL: return ">=";
+        case BinaryOp::LESS: return "<";
+        case BinaryOp::LESS_EQUAL: return "<=";
+        case BinaryOp::EQUAL: return "==";
+        case BinaryOp::NOT_EQUAL: return "!=";
+        case BinaryOp::AND: return "and";
+        case BinaryOp::OR: return "or";
+    }
+    return "?";
+}
+
+// Why `instruction` has the type recorded on it.
+std::string type_reason(const IrFunction& function, const IrInstruction& instruction) {
+    auto operand_type = [&](ValueId operand) { return to_string(function.values[operand].type); };
+
+    switch (instruction.opcode) {
+        case IrOpcode::CONST:
+            return "constant";
+        case IrOpcode::PHI: {
+            std::string reason = "phi of";
+            const auto& predecessors = function.blocks[instruction.block].predecessors;
+            for (std::size_t i = 0; i < instruction.operands.size(); ++i) {
+                ValueId operand = instruction.operands[i];
+                reason += i == 0 ? " " : ", ";
+                reason += std::string(operand_type(operand)) + " %" + std::to_string(operand) + " (b" +
+                          std::to_string(predecessors[i]) + ")";
+            }
+            return reason;
+        }
+        case IrOpcode::UNARY:
+        case IrOpcode::NUMBER_UNARY:
+            return std::string(static_cast<UnaryOp>(instruction.op) == UnaryOp::NEGATE ? "-" : "!") + " of " +
+                   operand_type(instruction.operands[0]);
+        case IrOpcode::BINARY:
+        case IrOpcode::NUMBER_BINARY:
+        case IrOpcode::CONCAT:
+            return std::string(binary_symbol(static_cast<BinaryOp>(instruction.op))) + " of " +
+                   operand_type(instruction.operands[0]) + ", " + operand_type(instruction.operands[1]);
+        case IrOpcode::LOAD_GLOBAL:
+            if (instruction.op) return "global may be undefined";
+            return std::string("global held a ") + to_string(instruction.type) + " when the unit was compiled";
+        case IrOpcode::CALL:
+            return std::string("result of ") + builtin_info(static_cast<Builtin>(instruction.op)).name;
+        default:
+            return "";
+    }
+}
+
+} // namespace
+
+std::string explain_types(const IrFunction& function) {
+    std::ostringstream out;
+    for (BlockId block : function.reverse_post_order()) {
+        for (auto* list : {&function.blocks[block].phis, &function.blocks[block].instructions}) {
+            for (ValueId id : *list) {
+                const IrInstruction& instruction = function.values[id];
+                if (instruction.name == no_name) continue;
+                out << "%" << id << " " << function.names[instruction.name] << ": " << to_string(instruction.type)
+                    << " (" << type_reason(function, instruction) << ")";
+                if (instruction.opcode == IrOpcode::NUMBER_UNARY || instruction.opcode == IrOpcode::NUMBER_BINARY ||
+                    instruction.opcode == IrOpcode::CONCAT) {
+                    out << ", unchecked";
+                }
+                out << "\n";
+            }
+        }
+    }
+    return out.str();
+}
+
+} // namespace tl
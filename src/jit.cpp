@@ -0,0 +1,598 @@
+#include "tl/jit.hpp"
+
+#include <cstring>
+#include <initializer_list>
+#include <optional>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define TL_JIT_X86_64 1
+#include <sys/mman.h>
+#endif
+
+namespace tl {
+
+namespace {
+
+// Traces hold numbers and booleans unboxed as doubles, booleans as 0 or 1.
+enum class Kind : std::uint8_t { NUMBER, BOOL };
+
+bool is_binary(RegOpcode opcode) {
+    return opcode >= RegOpcode::ADD && opcode <= RegOpcode::OR;
+}
+
+bool truthy(double value) {
+    return value != 0.0;
+}
+
+// Folds an operator on two unboxed operands the way apply_binary would.
+// Division by zero is not folded, so that it fails at run time.
+std::optional<double> fold(RegOpcode opcode, double left, double right) {
+    switch (opcode) {
+        case RegOpcode::ADD: return left + right;
+        case RegOpcode::SUBTRACT: return left - right;
+        case RegOpcode::MULTIPLY: return left * right;
+        case RegOpcode::DIVIDE:
+            if (right == 0.0) return std::nullopt;
+            return left / right;
+        case RegOpcode::GREATER: return left > right;
+        case RegOpcode::GREATER_EQUAL: return left >= right;
+        case RegOpcode::LESS: return left < right;
+        case RegOpcode::LESS_EQUAL: return left <= right;
+        case RegOpcode::EQUAL: return left == right;
+        case RegOpcode::NOT_EQUAL: return left != right;
+        case RegOpcode::AND: return truthy(left) && truthy(right);
+        case RegOpcode::OR: return truthy(left) || truthy(right);
+        default: return std::nullopt;
+    }
+}
+
+// The few x86-64 instructions traces need. Unboxed values live at
+// [rdi + 8 * slot]; only rax, rcx, rdx and xmm0-xmm2 are used, all
+// caller-saved under the System V ABI, so traces need no prologue.
+class Assembler {
+public:
+    std::vector<std::uint8_t> code;
+
+    void bytes(std::initializer_list<std::uint8_t> list) { code.insert(code.end(), list); }
+
+    void u32(std::uint32_t value) {
+        for (int i = 0; i < 4; ++i) code.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+    }
+
+    void u64(std::uint64_t value) {
+        for (int i = 0; i < 8; ++i) code.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+    }
+
+    // movsd xmm, [rdi + 8 * slot]
+    void load(int xmm, std::uint32_t slot) {
+        bytes({0xF2, 0x0F, 0x10, static_cast<std::uint8_t>(0x87 | xmm << 3)});
+        u32(slot * 8);
+    }
+
+    // movsd [rdi + 8 * slot], xmm
+    void store(std::uint32_t slot, int xmm) {
+        bytes({0xF2, 0x0F, 0x11, static_cast<std::uint8_t>(0x87 | xmm << 3)});
+        u32(slot * 8);
+    }
+
+    // mov rax, imm64
+    void rax(std::uint64_t value) {
+        bytes({0x48, 0xB8});
+        u64(value);
+    }
+
+    // mov rax, imm64; movq xmm, rax
+    void load_immediate(int xmm, double value) {
+        rax(bits(value));
+        bytes({0x66, 0x48, 0x0F, 0x6E, static_cast<std::uint8_t>(0xC0 | xmm << 3)});
+    }
+
+    // mov rax, imm64; mov [rdi + 8 * slot], rax
+    void store_immediate(std::uint32_t slot, double value) {
+        rax(bits(value));
+        bytes({0x48, 0x89, 0x87});
+        u32(slot * 8);
+    }
+
+    // A two-register SSE instruction: prefix 0F opcode, modrm a, b.
+    void sse(std::uint8_t prefix, std::uint8_t opcode, int a, int b) {
+        bytes({prefix, 0x0F, opcode, static_cast<std::uint8_t>(0xC0 | a << 3 | b)});
+    }
+
+    // al = 1 if xmm is truthy (not 0; NaN is truthy), clobbering cl and xmm2.
+    void truthy(int xmm) {
+        sse(0x66, 0x57, 2, 2);                  // xorpd xmm2, xmm2
+        sse(0x66, 0x2E, xmm, 2);                // ucomisd xmm, xmm2
+        bytes({0x0F, 0x95, 0xC0});              // setne al
+        bytes({0x0F, 0x9A, 0xC1});              // setp cl
+        bytes({0x08, 0xC8});                    // or al, cl
+    }
+
+    // xmm0 = al as 0.0 or 1.0
+    void boolean() {
+        bytes({0x0F, 0xB6, 0xC0});              // movzx eax, al
+        bytes({0xF2, 0x0F, 0x2A, 0xC0});        // cvtsi2sd xmm0, eax
+    }
+
+    // jcc rel32 (or jmp if `condition` is negative); returns the offset to patch.
+    std::size_t jump(int condition) {
+        if (condition < 0) {
+            bytes({0xE9});
+        } else {
+            bytes({0x0F, static_cast<std::uint8_t>(0x80 | condition)});
+        }
+        u32(0);
+        return code.size() - 4;
+    }
+
+    void patch(std::size_t at, std::size_t target) {
+        auto relative = static_cast<std::uint32_t>(static_cast<std::int64_t>(target) - static_cast<std::int64_t>(at + 4));
+        std::memcpy(&code[at], &relative, 4);
+    }
+
+    static std::uint64_t bits(double value) {
+        std::uint64_t result;
+        std::memcpy(&result, &value, sizeof(result));
+        return result;
+    }
+};
+
+constexpr int jump_always = -1;
+constexpr int jump_equal = 0x4;
+constexpr int jump_not_equal = 0x5;
+constexpr int jump_parity = 0xA;
+
+} // namespace
+
+struct TraceJit::Trace {
+    // The register or global behind each slot of unboxed values.
+    std::vector<std::uint32_t> registers;
+    std::vector<Value*> globals;
+    // What every slot holds when the native loop is entered.
+    std::vector<Kind> entry;
+
+    struct Exit {
+        std::uint32_t pc;
+        std::vector<Kind> kinds;
+    };
+    std::vector<Exit> exits;
+
+    std::vector<double> slots;
+    void* code = nullptr;
+    std::size_t size = 0;
+
+    ~Trace() {
+#ifdef TL_JIT_X86_64
+        if (code) munmap(code, size);
+#endif
+    }
+};
+
+bool jit_supported() {
+#ifdef TL_JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+TraceJit::TraceJit(RegProgram& program) : program_(program), loops_(program.instructions.size()) {}
+
+TraceJit::~TraceJit() = default;
+
+void TraceJit::abort() {
+    loops_[recording_].blacklisted = true;
+    recording_ = no_pc;
+}
+
+bool TraceJit::capture(std::uint32_t reg, const Value& value) {
+    bool constant = reg >= program_.constant_base && reg < program_.register_count;
+    if (constant || written_[reg] || entry_is_number_.count(reg)) return true;
+    if (std::holds_alternative<double>(value)) {
+        entry_is_number_[reg] = true;
+    } else if (std::holds_alternative<bool>(value)) {
+        entry_is_number_[reg] = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void TraceJit::record(std::uint32_t pc, const Value* registers, std::unordered_map<std::string, Value>& globals) {
+    if (ops_.size() == max_trace) {
+        abort();
+        return;
+    }
+
+    const RegInstruction& instruction = program_.instructions[pc];
+    auto global = [&](std::uint32_t index) -> Value* {
+        std::uint32_t reg = program_.register_count + index;
+        auto it = globals.find(program_.globals[index]);
+        if (it == globals.end()) return nullptr;
+        global_storage_[reg] = &it->second;
+        return &it->second;
+    };
+
+    bool ok = true;
+    switch (instruction.opcode) {
+        case RegOpcode::MOVE:
+        case RegOpcode::NEGATE:
+        case RegOpcode::NOT:
+            ok = capture(instruction.b, registers[instruction.b]);
+            ops_.push_back(TraceOp{instruction.opcode, instruction.a, instruction.b, 0, pc, false});
+            written_[instruction.a] = true;
+            break;
+        case RegOpcode::LOAD_GLOBAL: {
+            std::uint32_t reg = program_.register_count + instruction.b;
+            Value* storage = global(instruction.b);
+            ok = storage && capture(reg, *storage);
+            ops_.push_back(TraceOp{RegOpcode::MOVE, instruction.a, reg, 0, pc, false});
+            written_[instruction.a] = true;
+            break;
+        }
+        case RegOpcode::STORE_GLOBAL: {
+            std::uint32_t reg = program_.register_count + instruction.a;
+            ok = global(instruction.a) && capture(instruction.b, registers[instruction.b]);
+            ops_.push_back(TraceOp{RegOpcode::MOVE, reg, instruction.b, 0, pc, false});
+            written_[reg] = true;
+            break;
+        }
+        case RegOpcode::JUMP_IF_FALSE: {
+            bool taken = is_truthy(registers[instruction.a]);
+            ok = capture(instruction.a, registers[instruction.a]);
+            ops_.push_back(TraceOp{RegOpcode::JUMP_IF_FALSE, 0, instruction.a, 0, taken ? instruction.b : pc + 1, taken});
+            break;
+        }
+        case RegOpcode::JUMP:
+            break;
+        default:
+            if (!is_binary(instruction.opcode)) {
+                ok = false;
+                break;
+            }
+            ok = capture(instruction.b, registers[instruction.b]) && capture(instruction.c, registers[instruction.c]);
+            ops_.push_back(TraceOp{instruction.opcode, instruction.a, instruction.b, instruction.c, pc, false});
+            written_[instruction.a] = true;
+            break;
+    }
+    if (!ok) abort();
+}
+
+std::uint32_t TraceJit::back_edge(std::uint32_t header, Value* registers) {
+    if (recording_ != no_pc) {
+        if (header == recording_) {
+            loops_[header].trace = compile();
+            if (!loops_[header].trace) loops_[header].blacklisted = true;
+            recording_ = no_pc;
+        } else {
+            // The iteration left the loop or ran another one; try again
+            // once it is hot again.
+            loops_[recording_].count = 0;
+            recording_ = no_pc;
+        }
+    }
+
+    Loop& loop = loops_[header];
+    if (!loop.trace) {
+        if (!loop.blacklisted && ++loop.count == hot_loop) {
+            recording_ = header;
+            ops_.clear();
+            entry_is_number_.clear();
+            global_storage_.clear();
+            written_.assign(program_.register_count + program_.globals.size(), false);
+        }
+        return header;
+    }
+
+    Trace& trace = *loop.trace;
+    auto value = [&](std::size_t slot) -> Value& {
+        return trace.globals[slot] ? *trace.globals[slot] : registers[trace.registers[slot]];
+    };
+    for (std::size_t slot = 0; slot < trace.registers.size(); ++slot) {
+        const Value& current = value(slot);
+        if (trace.entry[slot] == Kind::NUMBER) {
+            const double* number = std::get_if<double>(&current);
+            if (!number) return header;
+            trace.slots[slot] = *number;
+        } else {
+            const bool* boolean = std::get_if<bool>(&current);
+            if (!boolean) return header;
+            trace.slots[slot] = *boolean ? 1.0 : 0.0;
+        }
+    }
+
+    using Native = std::uint32_t (*)(double*);
+    std::uint32_t exit = reinterpret_cast<Native>(trace.code)(trace.slots.data());
+
+    const Trace::Exit& taken = trace.exits[exit];
+    for (std::size_t slot = 0; slot < trace.registers.size(); ++slot) {
+        double unboxed = trace.slots[slot];
+        value(slot) = taken.kinds[slot] == Kind::NUMBER ? Value{unboxed} : Value{unboxed != 0.0};
+    }
+    return taken.pc;
+}
+
+std::unique_ptr<TraceJit::Trace> TraceJit::compile() {
+#ifdef TL_JIT_X86_64
+    auto trace = std::make_unique<Trace>();
+    const std::uint32_t no_slot = ~0u;
+    std::vector<std::uint32_t> slot_of(written_.size(), no_slot);
+
+    auto is_constant = [&](std::uint32_t reg) {
+        return reg >= program_.constant_base && reg < program_.register_count;
+    };
+    auto slot = [&](std::uint32_t reg) {
+        if (slot_of[reg] == no_slot) {
+            slot_of[reg] = static_cast<std::uint32_t>(trace->registers.size());
+            trace->registers.push_back(reg);
+            auto storage = global_storage_.find(reg);
+            trace->globals.push_back(storage != global_storage_.end() ? storage->second : nullptr);
+        }
+        return slot_of[reg];
+    };
+    auto reads_right = [](const TraceOp& op) { return is_binary(op.opcode); };
+    auto writes = [](const TraceOp& op) { return op.opcode != RegOpcode::JUMP_IF_FALSE; };
+
+    // Constants become immediates; other strings and nil end the attempt.
+    std::vector<std::optional<double>> constant_value(written_.size());
+    std::vector<Kind> constant_kind(written_.size(), Kind::NUMBER);
+    for (const TraceOp& op : ops_) {
+        for (std::uint32_t reg : {op.left, reads_right(op) ? op.right : op.left}) {
+            if (!is_constant(reg)) {
+                slot(reg);
+                continue;
+            }
+            const Value& value = program_.constants[reg - program_.constant_base];
+            if (auto* number = std::get_if<double>(&value)) {
+                constant_value[reg] = *number;
+            } else if (auto* boolean = std::get_if<bool>(&value)) {
+                constant_value[reg] = *boolean ? 1.0 : 0.0;
+                constant_kind[reg] = Kind::BOOL;
+            } else {
+                return nullptr;
+            }
+        }
+        if (writes(op)) slot(op.dest);
+    }
+
+    // The kind each op leaves in its destination, or nullopt if it would
+    // fail for every value of the operand kinds.
+    auto result_kind = [](const TraceOp& op, Kind left, Kind right) -> std::optional<Kind> {
+        switch (op.opcode) {
+            case RegOpcode::MOVE: return left;
+            case RegOpcode::NEGATE:
+                if (left != Kind::NUMBER) return std::nullopt;
+                return Kind::NUMBER;
+            case RegOpcode::NOT:
+            case RegOpcode::EQUAL:
+            case RegOpcode::NOT_EQUAL:
+            case RegOpcode::AND:
+            case RegOpcode::OR:
+                return Kind::BOOL;
+            case RegOpcode::ADD:
+            case RegOpcode::SUBTRACT:
+            case RegOpcode::MULTIPLY:
+            case RegOpcode::DIVIDE:
+                if (left != Kind::NUMBER || right != Kind::NUMBER) return std::nullopt;
+                return Kind::NUMBER;
+            default:
+                if (left != Kind::NUMBER || right != Kind::NUMBER) return std::nullopt;
+                return Kind::BOOL;
+        }
+    };
+
+    // Kinds after one iteration from the recorded entry; a loop can only
+    // run natively if that is also what the next iteration starts with.
+    std::size_t slots = trace->registers.size();
+    std::vector<Kind> kinds(slots, Kind::NUMBER);
+    for (auto [reg, is_number] : entry_is_number_) {
+        kinds[slot_of[reg]] = is_number ? Kind::NUMBER : Kind::BOOL;
+    }
+    auto kind_of = [&](std::uint32_t reg) { return is_constant(reg) ? constant_kind[reg] : kinds[slot_of[reg]]; };
+    for (const TraceOp& op : ops_) {
+        if (!writes(op)) continue;
+        std::optional<Kind> kind = result_kind(op, kind_of(op.left), reads_right(op) ? kind_of(op.right) : Kind::NUMBER);
+        if (!kind) return nullptr;
+        kinds[slot_of[op.dest]] = *kind;
+    }
+    for (auto [reg, is_number] : entry_is_number_) {
+        if (kinds[slot_of[reg]] != (is_number ? Kind::NUMBER : Kind::BOOL)) return nullptr;
+    }
+    trace->entry = kinds;
+    trace->slots.resize(slots);
+
+    // Code generation, folding values known within the iteration.
+    Assembler out;
+    std::vector<std::optional<double>> known(slots);
+    std::vector<std::pair<std::size_t, std::size_t>> exit_jumps; // (patch offset, exit)
+    auto known_value = [&](std::uint32_t reg) { return is_constant(reg) ? constant_value[reg] : known[slot_of[reg]]; };
+    auto load = [&](int xmm, std::uint32_t reg) {
+        if (auto value = known_value(reg)) {
+            out.load_immediate(xmm, *value);
+        } else {
+            out.load(xmm, slot_of[reg]);
+        }
+    };
+    auto side_exit = [&](std::uint32_t pc, int condition) {
+        exit_jumps.emplace_back(out.jump(condition), trace->exits.size());
+        trace->exits.push_back(Trace::Exit{pc, kinds});
+    };
+    auto set = [&](std::uint32_t reg, Kind kind, std::optional<double> value) {
+        known[slot_of[reg]] = value;
+        kinds[slot_of[reg]] = kind;
+        if (value) {
+            out.store_immediate(slot_of[reg], *value);
+        } else {
+            out.store(slot_of[reg], 0);
+        }
+    };
+
+    for (const TraceOp& op : ops_) {
+        std::optional<double> left = known_value(op.left);
+        std::optional<double> right = reads_right(op) ? known_value(op.right) : std::nullopt;
+
+        if (op.opcode == RegOpcode::JUMP_IF_FALSE) {
+            if (left) {
+                if (truthy(*left) != op.truthy) side_exit(op.exit_pc, jump_always);
+                continue;
+            }
+            load(0, op.left);
+            out.sse(0x66, 0x57, 2, 2);  // xorpd xmm2, xmm2
+            out.sse(0x66, 0x2E, 0, 2);  // ucomisd xmm0, xmm2
+            if (op.truthy) {
+                // Leave if the condition is an ordered zero.
+                out.bytes({0x7A, 0x06}); // jp over the je
+                side_exit(op.exit_pc, jump_equal);
+            } else {
+                side_exit(op.exit_pc, jump_parity);
+                side_exit(op.exit_pc, jump_not_equal);
+            }
+            continue;
+        }
+
+        Kind left_kind = kind_of(op.left);
+        Kind right_kind = reads_right(op) ? kind_of(op.right) : Kind::NUMBER;
+        Kind kind = *result_kind(op, left_kind, right_kind);
+
+        switch (op.opcode) {
+            case RegOpcode::MOVE:
+                if (left) {
+                    set(op.dest, kind, left);
+                } else {
+                    load(0, op.left);
+                    set(op.dest, kind, std::nullopt);
+                }
+                break;
+            case RegOpcode::NEGATE:
+                if (left) {
+                    set(op.dest, kind, -*left);
+                } else {
+                    load(0, op.left);
+                    out.load_immediate(1, -0.0);
+                    out.sse(0x66, 0x57, 0, 1); // xorpd xmm0, xmm1
+                    set(op.dest, kind, std::nullopt);
+                }
+                break;
+            case RegOpcode::NOT:
+                if (left) {
+                    set(op.dest, kind, truthy(*left) ? 0.0 : 1.0);
+                } else {
+                    load(0, op.left);
+                    out.truthy(0);
+                    out.bytes({0x34, 0x01}); // xor al, 1
+                    out.boolean();
+                    set(op.dest, kind, std::nullopt);
+                }
+                break;
+            case RegOpcode::EQUAL:
+            case RegOpcode::NOT_EQUAL:
+                if (left_kind != right_kind) {
+                    // Values of different types are never equal.
+                    set(op.dest, kind, op.opcode == RegOpcode::NOT_EQUAL ? 1.0 : 0.0);
+                    break;
+                }
+                [[fallthrough]];
+            default: {
+                if (left && right) {
+                    if (auto folded = fold(op.opcode, *left, *right)) {
+                        set(op.dest, kind, folded);
+                        break;
+                    }
+                }
+                load(0, op.left);
+                load(1, op.right);
+                switch (op.opcode) {
+                    case RegOpcode::ADD: out.sse(0xF2, 0x58, 0, 1); break;
+                    case RegOpcode::SUBTRACT: out.sse(0xF2, 0x5C, 0, 1); break;
+                    case RegOpcode::MULTIPLY: out.sse(0xF2, 0x59, 0, 1); break;
+                    case RegOpcode::DIVIDE:
+                        if (std::optional<double> divisor = known_value(op.right); !divisor) {
+                            // Leave on an ordered zero divisor, so the
+                            // interpreter reports it.
+                            out.sse(0x66, 0x57, 2, 2); // xorpd xmm2, xmm2
+                            out.sse(0x66, 0x2E, 1, 2); // ucomisd xmm1, xmm2
+                            out.bytes({0x7A, 0x06});   // jp over the je
+                            side_exit(op.exit_pc, jump_equal);
+                        } else if (*divisor == 0.0) {
+                            side_exit(op.exit_pc, jump_always);
+                        }
+                        out.sse(0xF2, 0x5E, 0, 1);
+                        break;
+                    case RegOpcode::GREATER:
+                        out.sse(0x66, 0x2E, 0, 1);
+                        out.bytes({0x0F, 0x97, 0xC0}); // seta al
+                        out.boolean();
+                        break;
+                    case RegOpcode::GREATER_EQUAL:
+                        out.sse(0x66, 0x2E, 0, 1);
+                        out.bytes({0x0F, 0x93, 0xC0}); // setae al
+                        out.boolean();
+                        break;
+                    case RegOpcode::LESS:
+                        out.sse(0x66, 0x2E, 1, 0);
+                        out.bytes({0x0F, 0x97, 0xC0}); // seta al
+                        out.boolean();
+                        break;
+                    case RegOpcode::LESS_EQUAL:
+                        out.sse(0x66, 0x2E, 1, 0);
+                        out.bytes({0x0F, 0x93, 0xC0}); // setae al
+                        out.boolean();
+                        break;
+                    case RegOpcode::EQUAL:
+                        out.sse(0x66, 0x2E, 0, 1);
+                        out.bytes({0x0F, 0x94, 0xC0}); // sete al
+                        out.bytes({0x0F, 0x9B, 0xC1}); // setnp cl
+                        out.bytes({0x20, 0xC8});       // and al, cl
+                        out.boolean();
+                        break;
+                    case RegOpcode::NOT_EQUAL:
+                        out.sse(0x66, 0x2E, 0, 1);
+                        out.bytes({0x0F, 0x95, 0xC0}); // setne al
+                        out.bytes({0x0F, 0x9A, 0xC1}); // setp cl
+                        out.bytes({0x08, 0xC8});       // or al, cl
+                        out.boolean();
+                        break;
+                    default: // AND, OR
+                        out.truthy(0);
+                        out.bytes({0x88, 0xC2}); // mov dl, al
+                        out.truthy(1);
+                        out.bytes({static_cast<std::uint8_t>(op.opcode == RegOpcode::AND ? 0x20 : 0x08), 0xD0});
+                        out.boolean();
+                        break;
+                }
+                set(op.dest, kind, std::nullopt);
+                break;
+            }
+        }
+    }
+
+    // Back to the top for the next iteration.
+    out.patch(out.jump(jump_always), 0);
+
+    std::vector<std::size_t> stubs;
+    for (std::size_t exit = 0; exit < trace->exits.size(); ++exit) {
+        stubs.push_back(out.code.size());
+        out.bytes({0xB8}); // mov eax, exit
+        out.u32(static_cast<std::uint32_t>(exit));
+        out.bytes({0xC3}); // ret
+    }
+    for (auto [at, exit] : exit_jumps) {
+        out.patch(at, stubs[exit]);
+    }
+
+    trace->size = out.code.size();
+    void* memory = mmap(nullptr, trace->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return nullptr;
+    std::memcpy(memory, out.code.data(), out.code.size());
+    if (mprotect(memory, trace->size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, trace->size);
+        return nullptr;
+    }
+    trace->code = memory;
+    return trace;
+#else
+    return nullptr;
+#endif
+}
+
+} // namespace tl
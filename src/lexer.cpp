@@ -1,7 +1,11 @@
 #include "tl/lexer.hpp"
 
+#include <algorithm>
 #include <cctype>
+#include <charconv>
+#include <future>
 #include <stdexcept>
+#include <string>
 
 namespace tl {
 
@@ -18,8 +22,13 @@ const std::unordered_map<std::string, TokenType> Lexer::keywords_ = {
     {"or", TokenType::OR}
 };
 
-Lexer::Lexer(std::string source)
-    : source_(std::move(source)), start_(0), current_(0), line_(1) {}
+Lexer::Lexer(std::string source, int line, int column)
+    : source_(std::move(source)), start_(0), current_(0), line_(line), consumed_(0),
+      line_start_(1 - column), column_(column), input_(nullptr), chunk_size_(0), compact_(nullptr) {}
+
+Lexer::Lexer(std::istream& input, std::size_t chunk_size)
+    : start_(0), current_(0), line_(1), consumed_(0), line_start_(0), column_(1), input_(&input),
+      chunk_size_(chunk_size), compact_(nullptr) {}
 
 std::vector<Token> Lexer::tokenize() {
     while (!is_at_end()) {
@@ -27,36 +36,202 @@ std::vector<Token> Lexer::tokenize() {
         scan_token();
     }
 
-    tokens_.emplace_back(TokenType::END_OF_FILE, "", Literal{}, line_);
+    tokens_.emplace_back(TokenType::END_OF_FILE, "", line_, column_of(current_));
     return tokens_;
 }
 
-bool Lexer::is_at_end() const {
-    return current_ >= source_.size();
+TokenBuffer Lexer::tokenize_compact() {
+    TokenBuffer buffer;
+    if (input_) {
+        // Streamed text does not stay addressable, so lexemes are copied.
+        while (true) {
+            Token token = next_token();
+            buffer.append(token);
+            if (token.type == TokenType::END_OF_FILE) return buffer;
+        }
+    }
+
+    compact_ = &buffer;
+    try {
+        while (!is_at_end()) {
+            start_ = current_;
+            scan_token();
+        }
+    } catch (...) {
+        compact_ = nullptr;
+        throw;
+    }
+    compact_ = nullptr;
+
+    buffer.push(TokenType::END_OF_FILE, source_.size(), 0, line_, column_of(current_));
+    buffer.shrink_to_fit();
+    buffer.text_ = std::move(source_);
+    return buffer;
+}
+
+TokenBuffer Lexer::tokenize_parallel(ThreadPool& pool, std::size_t chunk_size) {
+    if (input_ || source_.size() <= chunk_size) {
+        return tokenize_compact();
+    }
+
+    std::vector<std::pair<std::size_t, std::size_t>> ranges;
+    for (std::size_t begin = 0; begin < source_.size();) {
+        std::size_t end = source_.find('\n', std::min(begin + chunk_size, source_.size()));
+        end = end == std::string::npos ? source_.size() : end + 1;
+        ranges.emplace_back(begin, end);
+        begin = end;
+    }
+
+    // Every chunk is lexed as if it started outside a string. Strings are the
+    // only tokens that can span lines, so that guess only fails for a chunk
+    // that follows one ending inside a string; those are fixed up below.
+    std::vector<std::future<Chunk>> pending;
+    pending.reserve(ranges.size());
+    for (auto [begin, end] : ranges) {
+        pending.push_back(pool.submit([this, begin = begin, end = end] { return lex_chunk(begin, end, 1); }));
+    }
+    std::vector<Chunk> chunks;
+    chunks.reserve(ranges.size());
+    for (auto& future : pending) {
+        chunks.push_back(future.get());
+    }
+
+    TokenBuffer tokens;
+    int line = 1;
+    std::size_t open_string = std::string::npos;
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+        auto [begin, end] = ranges[i];
+        Chunk& chunk = chunks[i];
+        int newlines = chunk.newlines;
+
+        if (open_string != std::string::npos) {
+            std::size_t close = source_.find('"', begin);
+            if (close >= end) {
+                line += newlines;
+                continue;
+            }
+            int close_line = 1 + static_cast<int>(std::count(source_.begin() + static_cast<std::ptrdiff_t>(begin),
+                                                             source_.begin() + static_cast<std::ptrdiff_t>(close), '\n'));
+            tokens.push(TokenType::STRING, open_string, close + 1 - open_string, line - 1 + close_line,
+                        column_at(open_string));
+            open_string = std::string::npos;
+            chunk = lex_chunk(close + 1, end, close_line, column_at(close + 1));
+        }
+
+        tokens.splice(chunk.tokens, chunk.begin, line - 1);
+        if (!chunk.error.empty()) {
+            line_ = line - 1 + chunk.error_line;
+            error(chunk.error);
+        }
+        open_string = chunk.open_string;
+        line += newlines;
+    }
+
+    line_ = line;
+    if (open_string != std::string::npos) {
+        error("Unterminated string");
+    }
+    tokens.push(TokenType::END_OF_FILE, source_.size(), 0, line_, column_at(source_.size()));
+    tokens.shrink_to_fit();
+    tokens.text_ = std::move(source_);
+    return tokens;
+}
+
+// Lexes source_[begin, end) starting outside any string, with line numbers
+// counted from `line`. Errors are recorded instead of thrown, and a string
+// still open at `end` is reported through open_string.
+Lexer::Chunk Lexer::lex_chunk(std::size_t begin, std::size_t end, int line, int column) const {
+    Chunk chunk;
+    chunk.begin = begin;
+    chunk.newlines = static_cast<int>(std::count(source_.begin() + static_cast<std::ptrdiff_t>(begin),
+                                                 source_.begin() + static_cast<std::ptrdiff_t>(end), '\n'));
+    Lexer lexer(source_.substr(begin, end - begin), line, column);
+    lexer.compact_ = &chunk.tokens;
+    try {
+        while (!lexer.is_at_end()) {
+            lexer.start_ = lexer.current_;
+            lexer.scan_token();
+        }
+    } catch (const std::runtime_error&) {
+        if (lexer.source_[lexer.start_] == '"') {
+            chunk.open_string = begin + lexer.start_;
+        } else {
+            chunk.error = lexer.error_;
+            chunk.error_line = lexer.line_;
+        }
+    }
+    return chunk;
+}
+
+Token Lexer::next_token() {
+    tokens_.clear();
+    while (tokens_.empty()) {
+        if (is_at_end()) {
+            return Token(TokenType::END_OF_FILE, "", line_, column_of(current_));
+        }
+        start_ = current_;
+        scan_token();
+    }
+    return std::move(tokens_.back());
+}
+
+std::size_t Lexer::position() const {
+    return consumed_ + current_;
+}
+
+std::string Lexer::release_source() {
+    return std::move(source_);
+}
+
+bool Lexer::is_at_end() {
+    return current_ >= source_.size() && !refill();
+}
+
+// Drops everything before the token being scanned and appends the next
+// chunk. Offsets are rebased so start_/current_ stay valid; a token that
+// straddles the chunk boundary simply keeps its prefix in the buffer.
+bool Lexer::refill() {
+    if (!input_ || !*input_) return false;
+
+    source_.erase(0, start_);
+    consumed_ += start_;
+    current_ -= start_;
+    start_ = 0;
+
+    std::size_t kept = source_.size();
+    source_.resize(kept + chunk_size_);
+    input_->read(source_.data() + kept, static_cast<std::streamsize>(chunk_size_));
+    source_.resize(kept + static_cast<std::size_t>(input_->gcount()));
+    return source_.size() > kept;
 }
 
 char Lexer::advance() {
     return source_[current_++];
 }
 
-char Lexer::peek() const {
-    if (is_at_end()) return '\0';
-    return source_[current_];
+char Lexer::peek() {
+    return peek_at(0);
 }
 
-char Lexer::peek_next() const {
-    if (current_ + 1 >= source_.size()) return '\0';
-    return source_[current_ + 1];
+char Lexer::peek_next() {
+    return peek_at(1);
+}
+
+char Lexer::peek_at(std::size_t ahead) {
+    while (current_ + ahead >= source_.size()) {
+        if (!refill()) return '\0';
+    }
+    return source_[current_ + ahead];
 }
 
 bool Lexer::match(char expected) {
-    if (is_at_end()) return false;
-    if (source_[current_] != expected) return false;
+    if (peek() != expected) return false;
     current_++;
     return true;
 }
 
 void Lexer::scan_token() {
+    column_ = column_of(start_);
     char c = advance();
     switch (c) {
         case '(': add_token(TokenType::LEFT_PAREN); break;
@@ -93,7 +268,7 @@ void Lexer::scan_token() {
         case '\t':
             break;
         case '\n':
-            line_++;
+            newline();
             break;
         case '"':
             string();
@@ -104,7 +279,7 @@ void Lexer::scan_token() {
             } else if (is_alpha(c)) {
                 identifier();
             } else {
-                throw std::runtime_error("Unexpected character at line " + std::to_string(line_));
+                error("Unexpected character");
             }
             break;
     }
@@ -112,32 +287,147 @@ void Lexer::scan_token() {
 
 void Lexer::string() {
     while (peek() != '"' && !is_at_end()) {
-        if (peek() == '\n') line_++;
-        advance();
+        char c = advance();
+        if (c == '\n') newline();
     }
 
     if (is_at_end()) {
-        throw std::runtime_error("Unterminated string at line " + std::to_string(line_));
+        error("Unterminated string");
     }
 
     advance(); // closing quote
 
-    std::string value = source_.substr(start_ + 1, current_ - start_ - 2);
-    add_token(TokenType::STRING, value);
+    if (compact_) {
+        add_token(TokenType::STRING);
+    } else {
+        add_token(TokenType::STRING, source_.substr(start_ + 1, current_ - start_ - 2));
+    }
 }
 
 void Lexer::number() {
-    while (is_digit(peek())) advance();
+    char prefix = peek();
+    if (source_[start_] == '0' && (prefix == 'x' || prefix == 'X') && is_hex_digit(peek_next())) {
+        advance();
+        radix_number(16);
+        return;
+    }
+    if (source_[start_] == '0' && (prefix == 'b' || prefix == 'B') && is_binary_digit(peek_next())) {
+        advance();
+        radix_number(2);
+        return;
+    }
+
+    bool has_separators = digits(&Lexer::is_digit);
 
     if (peek() == '.' && is_digit(peek_next())) {
         advance();
-        while (is_digit(peek())) advance();
+        has_separators |= digits(&Lexer::is_digit);
+    }
+
+    if (peek() == 'e' || peek() == 'E') {
+        char next = peek_next();
+        bool signed_exponent = (next == '+' || next == '-') && is_digit(peek_at(2));
+        if (is_digit(next) || signed_exponent) {
+            advance();
+            if (signed_exponent) advance();
+            has_separators |= digits(&Lexer::is_digit);
+        }
+    }
+
+    // Parse straight out of the source buffer. Only literals written with '_'
+    // separators need a compacted copy, which fits on the stack in practice.
+    const char* first = source_.data() + start_;
+    const char* last = source_.data() + current_;
+    char scratch[128];
+    std::string long_literal;
+    if (has_separators) {
+        char* out = scratch;
+        if (static_cast<std::size_t>(last - first) > sizeof(scratch)) {
+            long_literal.resize(static_cast<std::size_t>(last - first));
+            out = long_literal.data();
+        }
+        char* compacted = out;
+        for (const char* p = first; p != last; ++p) {
+            if (*p != '_') *compacted++ = *p;
+        }
+        first = out;
+        last = compacted;
+    }
+
+    double value = 0.0;
+    auto [end, status] = std::from_chars(first, last, value, std::chars_format::general);
+    if (status != std::errc{} || end != last) {
+        error("Number literal out of range");
+    }
+    add_token(TokenType::NUMBER, value);
+}
+
+void Lexer::radix_number(int radix) {
+    digits(radix == 16 ? &Lexer::is_hex_digit : &Lexer::is_binary_digit);
+    if (is_alphanumeric(peek())) {
+        error("Invalid digit in number literal");
+    }
+
+    // Hex digits go to from_chars as-is, which rounds correctly past 2^53.
+    // Binary digits are regrouped into hex nibbles first so they get the
+    // same rounding. Anything wider than 1024 bits is out of double range.
+    const char* digit = source_.data() + start_ + 2;
+    const char* last = source_.data() + current_;
+    while (digit != last && (*digit == '0' || *digit == '_')) ++digit;
+
+    char nibbles[256];
+    std::size_t length = 0;
+    std::size_t significant = 0;
+    for (const char* p = digit; p != last; ++p) {
+        if (*p != '_') significant++;
+    }
+    std::size_t width = radix == 16 ? significant : (significant + 3) / 4;
+    if (width > sizeof(nibbles)) {
+        error("Number literal out of range");
     }
 
-    double value = std::stod(source_.substr(start_, current_ - start_));
+    if (radix == 16) {
+        for (; digit != last; ++digit) {
+            if (*digit != '_') nibbles[length++] = *digit;
+        }
+    } else {
+        unsigned nibble = 0;
+        std::size_t bits = (4 - significant % 4) % 4;
+        for (; digit != last; ++digit) {
+            if (*digit == '_') continue;
+            nibble = (nibble << 1) | static_cast<unsigned>(*digit - '0');
+            if (++bits == 4) {
+                nibbles[length++] = "0123456789abcdef"[nibble];
+                nibble = 0;
+                bits = 0;
+            }
+        }
+    }
+
+    double value = 0.0;
+    if (length > 0) {
+        auto [end, status] = std::from_chars(nibbles, nibbles + length, value, std::chars_format::hex);
+        if (status != std::errc{} || end != nibbles + length) {
+            error("Number literal out of range");
+        }
+    }
     add_token(TokenType::NUMBER, value);
 }
 
+bool Lexer::digits(bool (Lexer::*is_valid)(char) const) {
+    bool has_separators = false;
+    while (true) {
+        if ((this->*is_valid)(peek())) {
+            advance();
+        } else if (peek() == '_' && (this->*is_valid)(peek_next())) {
+            advance();
+            has_separators = true;
+        } else {
+            return has_separators;
+        }
+    }
+}
+
 void Lexer::identifier() {
     while (is_alphanumeric(peek())) advance();
 
@@ -151,14 +441,50 @@ void Lexer::identifier() {
 }
 
 void Lexer::add_token(TokenType type, Literal literal) {
+    if (compact_) {
+        double number = type == TokenType::NUMBER ? std::get<double>(literal) : 0.0;
+        compact_->push(type, start_, current_ - start_, line_, column_, number);
+        return;
+    }
     std::string text = source_.substr(start_, current_ - start_);
-    tokens_.emplace_back(type, std::move(text), std::move(literal), line_);
+    tokens_.emplace_back(type, std::move(text), std::move(literal), line_, column_);
+}
+
+// Called just after consuming a '\n'.
+void Lexer::newline() {
+    line_++;
+    line_start_ = static_cast<std::ptrdiff_t>(consumed_ + current_);
+}
+
+// Column of source_[index], from the line start tracked while scanning.
+int Lexer::column_of(std::size_t index) const {
+    return static_cast<int>(static_cast<std::ptrdiff_t>(consumed_ + index) - line_start_ + 1);
+}
+
+// Column of source_[offset], found by searching back for the line break.
+// Used where chunks were lexed out of order and no line start is tracked.
+int Lexer::column_at(std::size_t offset) const {
+    std::size_t line_break = offset == 0 ? std::string::npos : source_.rfind('\n', offset - 1);
+    return static_cast<int>(line_break == std::string::npos ? offset + 1 : offset - line_break);
+}
+
+void Lexer::error(const std::string& message) {
+    error_ = message;
+    throw std::runtime_error(message + " at line " + std::to_string(line_));
 }
 
 bool Lexer::is_digit(char c) const {
     return std::isdigit(static_cast<unsigned char>(c));
 }
 
+bool Lexer::is_hex_digit(char c) const {
+    return std::isxdigit(static_cast<unsigned char>(c));
+}
+
+bool Lexer::is_binary_digit(char c) const {
+    return c == '0' || c == '1';
+}
+
 bool Lexer::is_alpha(char c) const {
     return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
 }
@@ -1,11 +1,25 @@
 #include "tl/vm.hpp"
 
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace {
 
+// Scripts from this size up are lexed on every core, if there is more than
+// one. Past the upper bound they stream, so their tokens never all have to
+// fit in memory.
+constexpr std::uintmax_t parallel_min_bytes = std::uintmax_t{1} << 20;
+constexpr std::uintmax_t parallel_max_bytes = std::uintmax_t{256} << 20;
+
 std::string trim(const std::string& str) {
     const auto first = str.find_first_not_of(" \t\r\n");
     if (first == std::string::npos) {
@@ -15,10 +29,159 @@ std::string trim(const std::string& str) {
     return str.substr(first, last - first + 1);
 }
 
+// A --define value: nil, true, false, a number, or a string in quotes.
+bool parse_literal(const std::string& text, tl::Value& value) {
+    if (text == "nil") {
+        value = tl::Value{};
+    } else if (text == "true" || text == "false") {
+        value = text == "true";
+    } else if (text.size() >= 2 && text.front() == '"' && text.back() == '"') {
+        value = text.substr(1, text.size() - 2);
+    } else {
+        char* end = nullptr;
+        double number = std::strtod(text.c_str(), &end);
+        if (text.empty() || *end != '\0' || !std::isfinite(number)) return false;
+        value = number;
+    }
+    return true;
+}
+
+// Prints the program at `path` specialized for `defines`.
+int print_residual(const char* path, const std::vector<std::pair<std::string, tl::Value>>& defines) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Could not open file '" << path << "'." << std::endl;
+        return 1;
+    }
+    std::stringstream source;
+    source << file.rdbuf();
+    try {
+        tl::Lexer lexer(source.str());
+        tl::Parser parser(lexer.tokenize_compact());
+        auto statements = parser.parse();
+        if (!parser.diagnostics().empty()) {
+            for (const auto& diagnostic : parser.diagnostics()) {
+                std::cerr << "[compile error] " << tl::to_string(diagnostic) << std::endl;
+            }
+            return 1;
+        }
+        tl::PartialEvaluator evaluator;
+        for (const auto& [name, value] : defines) {
+            evaluator.define(name, value);
+        }
+        evaluator.run(statements);
+        std::cout << tl::to_source(statements);
+        return 0;
+    } catch (const std::exception& error) {
+        std::cerr << "[error] " << error.what() << std::endl;
+        return 1;
+    }
+}
+
 } // namespace
 
-int main() {
-    tl::VM vm;
+int main(int argc, char** argv) {
+    tl::Tier tier = tl::Tier::AST;
+    bool dump_ir = false;
+    bool time_passes = false;
+    bool report_dead_stores = false;
+    bool explain_types = false;
+    bool jit = false;
+    bool residual = false;
+    bool async_output = false;
+    std::vector<std::pair<std::string, tl::Value>> defines;
+    const char* path = nullptr;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--ssa") {
+            tier = tl::Tier::SSA;
+        } else if (arg == "--register") {
+            tier = tl::Tier::REGISTER;
+        } else if (arg == "--jit") {
+            tier = tl::Tier::REGISTER;
+            jit = true;
+        } else if (arg == "--dump-ir") {
+            if (tier != tl::Tier::REGISTER) tier = tl::Tier::SSA;
+            dump_ir = true;
+        } else if (arg == "--time-passes") {
+            tier = tl::Tier::SSA;
+            time_passes = true;
+        } else if (arg == "--explain-types") {
+            tier = tl::Tier::SSA;
+            explain_types = true;
+        } else if (arg == "--report-dead-stores") {
+            report_dead_stores = true;
+        } else if (arg == "--define" && i + 1 < argc) {
+            std::string definition = argv[++i];
+            auto equals = definition.find('=');
+            tl::Value value;
+            if (equals == std::string::npos || equals == 0 || !parse_literal(definition.substr(equals + 1), value)) {
+                std::cerr << "Invalid --define '" << definition << "'; expected name=value." << std::endl;
+                return 1;
+            }
+            defines.emplace_back(definition.substr(0, equals), std::move(value));
+        } else if (arg == "--residual") {
+            residual = true;
+        } else if (arg == "--async-output") {
+            async_output = true;
+        } else if (arg.rfind("--", 0) == 0 || path) {
+            std::cerr << "Usage: tl [--ssa | --register | --jit] [--dump-ir] [--time-passes] [--explain-types]"
+                         " [--report-dead-stores] [--define name=value]... [--residual] [--async-output] [file]"
+                      << std::endl;
+            return 1;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (residual) {
+        if (!path) {
+            std::cerr << "--residual needs a file." << std::endl;
+            return 1;
+        }
+        return print_residual(path, defines);
+    }
+
+    tl::VM vm(tier);
+    vm.set_jit(jit);
+    vm.set_async_output(async_output);
+    for (const auto& [name, value] : defines) {
+        vm.define(name, value);
+    }
+    if (dump_ir) {
+        vm.set_ir_dump(&std::cerr);
+    }
+    if (explain_types) {
+        vm.set_type_report(&std::cerr);
+    }
+    if (report_dead_stores) {
+        vm.set_dead_store_report(&std::cerr);
+    }
+
+    if (path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            std::cerr << "Could not open file '" << path << "'." << std::endl;
+            return 1;
+        }
+        std::error_code error;
+        std::uintmax_t size = std::filesystem::file_size(path, error);
+        bool ok;
+        if (!error && size >= parallel_min_bytes && size <= parallel_max_bytes &&
+            std::thread::hardware_concurrency() > 1) {
+            std::string source(static_cast<std::size_t>(size), '\0');
+            file.read(source.data(), static_cast<std::streamsize>(size));
+            source.resize(static_cast<std::size_t>(file.gcount()));
+            ok = vm.interpret_parallel(std::move(source)) == tl::InterpretResult::OK;
+        } else {
+            ok = vm.interpret(file) == tl::InterpretResult::OK;
+        }
+        if (time_passes) {
+            vm.passes().report(std::cerr);
+        }
+        return ok ? 0 : 1;
+    }
 
     std::cout << "TinyLang (minimal)" << std::endl;
     std::cout << "Type :quit to exit" << std::endl;
@@ -56,6 +219,9 @@ int main() {
     }
 
     std::cout << "Goodbye!" << std::endl;
+    if (time_passes) {
+        vm.passes().report(std::cerr);
+    }
     return 0;
 }
 
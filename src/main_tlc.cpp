@@ -0,0 +1,65 @@
+#include "tl/aot.hpp"
+#include "tl/lexer.hpp"
+#include "tl/parser.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+int main(int argc, char** argv) {
+    const char* path = nullptr;
+    const char* output = nullptr;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg.rfind("-", 0) == 0 || path) {
+            path = nullptr;
+            break;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        std::cerr << "Usage: tlc [-o output.cpp] file" << std::endl;
+        return 1;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Could not open file '" << path << "'." << std::endl;
+        return 1;
+    }
+    std::stringstream source;
+    source << file.rdbuf();
+
+    std::string code;
+    try {
+        tl::Lexer lexer(source.str());
+        tl::Parser parser(lexer.tokenize_compact());
+        auto statements = parser.parse();
+        if (!parser.diagnostics().empty()) {
+            for (const auto& diagnostic : parser.diagnostics()) {
+                std::cerr << "[compile error] " << tl::to_string(diagnostic) << std::endl;
+            }
+            return 1;
+        }
+        code = tl::compile_to_cpp(statements);
+    } catch (const std::exception& error) {
+        std::cerr << "[error] " << error.what() << std::endl;
+        return 1;
+    }
+
+    if (!output) {
+        std::cout << code;
+        return 0;
+    }
+    std::ofstream out(output, std::ios::binary);
+    if (!(out << code)) {
+        std::cerr << "Could not write file '" << output << "'." << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,866 @@
+#include "tl/optimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <typeinfo>
+
+namespace tl {
+
+namespace {
+
+// Regions keep at most this many candidates, so lookups and kills stay cheap.
+constexpr std::size_t max_available = 64;
+
+enum class Kind { LITERAL, VARIABLE, UNARY, BINARY, ASSIGN, CALL, OTHER };
+
+// The passes look at every node several times; comparing type_info is much
+// cheaper than a chain of dynamic_casts.
+Kind kind_of(const Expr& node) {
+    const std::type_info& type = typeid(node);
+    if (type == typeid(BinaryExpr)) return Kind::BINARY;
+    if (type == typeid(VariableExpr)) return Kind::VARIABLE;
+    if (type == typeid(LiteralExpr)) return Kind::LITERAL;
+    if (type == typeid(UnaryExpr)) return Kind::UNARY;
+    if (type == typeid(AssignExpr)) return Kind::ASSIGN;
+    if (type == typeid(CallExpr)) return Kind::CALL;
+    return Kind::OTHER;
+}
+
+std::size_t combine(std::size_t seed, std::size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+std::uint64_t bits_of(double value) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+std::size_t hash_literal(const Value& value) {
+    std::size_t hash = value.index();
+    if (auto* number = std::get_if<double>(&value)) {
+        hash = combine(hash, std::hash<std::uint64_t>()(bits_of(*number)));
+    } else if (auto* boolean = std::get_if<bool>(&value)) {
+        hash = combine(hash, *boolean);
+    } else if (auto* text = std::get_if<std::string>(&value)) {
+        hash = combine(hash, std::hash<std::string>()(*text));
+    }
+    return hash;
+}
+
+// Structural equality of pure expressions. Numbers compare by bit pattern,
+// so -0 and 0 stay apart and NaN matches itself.
+bool same(const Expr& a, const Expr& b) {
+    Kind kind = kind_of(a);
+    if (kind != kind_of(b)) return false;
+    switch (kind) {
+        case Kind::LITERAL: {
+            const Value& left = static_cast<const LiteralExpr&>(a).value;
+            const Value& right = static_cast<const LiteralExpr&>(b).value;
+            if (left.index() != right.index()) return false;
+            if (auto* number = std::get_if<double>(&left)) {
+                return bits_of(*number) == bits_of(std::get<double>(right));
+            }
+            return left == right;
+        }
+        case Kind::VARIABLE:
+            return static_cast<const VariableExpr&>(a).name == static_cast<const VariableExpr&>(b).name;
+        case Kind::UNARY: {
+            auto& left = static_cast<const UnaryExpr&>(a);
+            auto& right = static_cast<const UnaryExpr&>(b);
+            return left.op.type == right.op.type && same(*left.right, *right.right);
+        }
+        case Kind::BINARY: {
+            auto& left = static_cast<const BinaryExpr&>(a);
+            auto& right = static_cast<const BinaryExpr&>(b);
+            return left.op.type == right.op.type && same(*left.left, *right.left) &&
+                   same(*left.right, *right.right);
+        }
+        default:
+            return false;
+    }
+}
+
+bool reads(const Expr& node, const std::string& name) {
+    switch (kind_of(node)) {
+        case Kind::VARIABLE:
+            return static_cast<const VariableExpr&>(node).name == name;
+        case Kind::UNARY:
+            return reads(*static_cast<const UnaryExpr&>(node).right, name);
+        case Kind::BINARY: {
+            auto& binary = static_cast<const BinaryExpr&>(node);
+            return reads(*binary.left, name) || reads(*binary.right, name);
+        }
+        default:
+            return false;
+    }
+}
+
+// Static result types, for deciding which expressions cannot fail.
+enum class Shape { NUMBER, STRING, OTHER };
+
+Shape shape_of(const Expr& node) {
+    switch (kind_of(node)) {
+        case Kind::LITERAL: {
+            const Value& value = static_cast<const LiteralExpr&>(node).value;
+            if (std::holds_alternative<double>(value)) return Shape::NUMBER;
+            if (std::holds_alternative<std::string>(value)) return Shape::STRING;
+            return Shape::OTHER;
+        }
+        case Kind::UNARY:
+            return static_cast<const UnaryExpr&>(node).op.type == TokenType::MINUS ? Shape::NUMBER : Shape::OTHER;
+        case Kind::BINARY: {
+            auto& binary = static_cast<const BinaryExpr&>(node);
+            switch (binary.op.type) {
+                case TokenType::PLUS: {
+                    Shape left = shape_of(*binary.left);
+                    return left == shape_of(*binary.right) ? left : Shape::OTHER;
+                }
+                case TokenType::MINUS:
+                case TokenType::STAR:
+                case TokenType::SLASH:
+                    return Shape::NUMBER;
+                default:
+                    return Shape::OTHER;
+            }
+        }
+        default:
+            return Shape::OTHER;
+    }
+}
+
+// Whether evaluating `node` can neither fail nor change any variable.
+// Locals always exist; globals may not.
+template <typename IsLocal>
+bool is_safe(const Expr& node, const IsLocal& is_local) {
+    switch (kind_of(node)) {
+        case Kind::LITERAL:
+            return true;
+        case Kind::VARIABLE:
+            return is_local(&node);
+        case Kind::UNARY: {
+            auto& unary = static_cast<const UnaryExpr&>(node);
+            return is_safe(*unary.right, is_local) &&
+                   (unary.op.type == TokenType::BANG || shape_of(*unary.right) == Shape::NUMBER);
+        }
+        case Kind::BINARY: {
+            auto& binary = static_cast<const BinaryExpr&>(node);
+            if (!is_safe(*binary.left, is_local) || !is_safe(*binary.right, is_local)) return false;
+            Shape left = shape_of(*binary.left);
+            Shape right = shape_of(*binary.right);
+            switch (binary.op.type) {
+                case TokenType::EQUAL_EQUAL:
+                case TokenType::BANG_EQUAL:
+                case TokenType::AND:
+                case TokenType::OR:
+                    return true;
+                case TokenType::PLUS:
+                    return left == right && left != Shape::OTHER;
+                case TokenType::SLASH: {
+                    auto* divisor = dynamic_cast<const LiteralExpr*>(binary.right.get());
+                    return left == Shape::NUMBER && right == Shape::NUMBER && divisor &&
+                           std::get<double>(divisor->value) != 0.0;
+                }
+                default:
+                    return left == Shape::NUMBER && right == Shape::NUMBER;
+            }
+        }
+        default:
+            return false;
+    }
+}
+
+template <typename Entry>
+const Entry* find(const std::vector<Entry>& entries, const Expr* node) {
+    auto it = std::lower_bound(entries.begin(), entries.end(), node,
+                               [](const Entry& entry, const Expr* value) {
+                                   return std::less<const Expr*>()(entry.node, value);
+                               });
+    return it != entries.end() && it->node == node ? &*it : nullptr;
+}
+
+} // namespace
+
+std::size_t CommonSubexpressionEliminator::run(std::vector<StmtPtr>& program) {
+    defs_.clear();
+    uses_.clear();
+    reset();
+
+    for (const auto& statement : program) {
+        visit(statement.get());
+    }
+    if (uses_.empty()) return 0;
+
+    auto by_node = [](const auto& a, const auto& b) { return std::less<const Expr*>()(a.node, b.node); };
+    std::sort(defs_.begin(), defs_.end(), by_node);
+    std::sort(uses_.begin(), uses_.end(), by_node);
+    for (auto& statement : program) {
+        rewrite(statement.get());
+    }
+    return uses_.size();
+}
+
+// Starts a new straight-line region.
+void CommonSubexpressionEliminator::reset() {
+    available_.clear();
+    next_slot_ = 0;
+}
+
+void CommonSubexpressionEliminator::kill(const std::string& name) {
+    available_.erase(std::remove_if(available_.begin(), available_.end(),
+                                    [&name](const Available& entry) { return reads(*entry.node, name); }),
+                     available_.end());
+}
+
+// Walks `node` in evaluation order and returns whether it is free of side
+// effects, with its structural hash in `hash`. Subexpressions are matched
+// bottom-up; when a whole expression turns out to be a repeat, whatever its
+// children recorded is rolled back, since they will no longer be evaluated.
+bool CommonSubexpressionEliminator::visit(const Expr* node, std::size_t& hash) {
+    if (!node) return false;
+
+    std::size_t left = 0;
+    std::size_t right = 0;
+    Kind kind = kind_of(*node);
+    switch (kind) {
+        case Kind::LITERAL:
+            hash = hash_literal(static_cast<const LiteralExpr*>(node)->value);
+            return true;
+        case Kind::VARIABLE:
+            hash = combine(1, std::hash<std::string>()(static_cast<const VariableExpr*>(node)->name));
+            return true;
+        case Kind::ASSIGN: {
+            auto* assign = static_cast<const AssignExpr*>(node);
+            visit(assign->value.get(), left);
+            kill(assign->name);
+            return false;
+        }
+        case Kind::CALL:
+            // Each call reads input anew, so none repeats another.
+            for (const auto& argument : static_cast<const CallExpr*>(node)->arguments) {
+                visit(argument.get(), left);
+            }
+            return false;
+        case Kind::UNARY:
+        case Kind::BINARY:
+            break;
+        case Kind::OTHER:
+            return false;
+    }
+
+    std::size_t available_mark = available_.size();
+    std::size_t defs_mark = defs_.size();
+    std::size_t uses_mark = uses_.size();
+    std::size_t slot_mark = next_slot_;
+
+    bool pure;
+    if (kind == Kind::BINARY) {
+        auto* binary = static_cast<const BinaryExpr*>(node);
+        bool left_pure = visit(binary->left.get(), left);
+        bool right_pure = visit(binary->right.get(), right);
+        pure = left_pure && right_pure;
+        hash = combine(combine(static_cast<std::size_t>(binary->op.type), left), right);
+    } else {
+        auto* unary = static_cast<const UnaryExpr*>(node);
+        pure = visit(unary->right.get(), left);
+        hash = combine(0x100 + static_cast<std::size_t>(unary->op.type), left);
+    }
+    if (!pure) return false;
+
+    for (std::size_t i = 0; i < available_mark; ++i) {
+        Available& entry = available_[i];
+        if (entry.hash != hash || !same(*entry.node, *node)) continue;
+
+        for (std::size_t d = defs_mark; d < defs_.size(); ++d) {
+            if (defs_[d].entry < available_mark) available_[defs_[d].entry].slot = no_slot;
+        }
+        available_.resize(available_mark);
+        defs_.resize(defs_mark);
+        uses_.resize(uses_mark);
+        next_slot_ = slot_mark;
+
+        if (entry.slot == no_slot) {
+            entry.slot = next_slot_++;
+            defs_.push_back(Def{entry.node, entry.slot, i});
+        }
+        uses_.push_back(Use{node, entry.slot, entry.node});
+        return true;
+    }
+
+    // Available only once it has been evaluated.
+    if (available_.size() < max_available) {
+        available_.push_back(Available{hash, node, no_slot});
+    }
+    return true;
+}
+
+void CommonSubexpressionEliminator::visit(const Stmt* node) {
+    std::size_t hash = 0;
+    if (auto* expression = dynamic_cast<const ExpressionStmt*>(node)) {
+        visit(expression->expression.get(), hash);
+    } else if (auto* print = dynamic_cast<const PrintStmt*>(node)) {
+        visit(print->expression.get(), hash);
+    } else if (auto* let = dynamic_cast<const LetStmt*>(node)) {
+        visit(let->initializer.get(), hash);
+        kill(let->name);
+    } else if (auto* block = dynamic_cast<const BlockStmt*>(node)) {
+        // A block's `let`s shadow outer names only until it ends.
+        reset();
+        for (const auto& statement : block->statements) {
+            visit(statement.get());
+        }
+        reset();
+    } else if (auto* branch = dynamic_cast<const IfStmt*>(node)) {
+        visit(branch->condition.get(), hash);
+        reset();
+        visit(branch->then_branch.get());
+        reset();
+        visit(branch->else_branch.get());
+        reset();
+    } else if (auto* loop = dynamic_cast<const WhileStmt*>(node)) {
+        reset();
+        visit(loop->condition.get(), hash);
+        reset();
+        visit(loop->body.get());
+        reset();
+    }
+
+    // Between statements no rollback can be pending, so old entries can go.
+    if (available_.size() == max_available) {
+        available_.erase(available_.begin(), available_.begin() + max_available / 2);
+    }
+}
+
+void CommonSubexpressionEliminator::rewrite(ExprPtr& node) {
+    if (!node) return;
+
+    if (const Use* use = find(uses_, node.get())) {
+        node = std::make_unique<TempLoadExpr>(use->slot, use->source);
+        return;
+    }
+
+    switch (kind_of(*node)) {
+        case Kind::UNARY:
+            rewrite(static_cast<UnaryExpr&>(*node).right);
+            break;
+        case Kind::BINARY:
+            rewrite(static_cast<BinaryExpr&>(*node).left);
+            rewrite(static_cast<BinaryExpr&>(*node).right);
+            break;
+        case Kind::ASSIGN:
+            rewrite(static_cast<AssignExpr&>(*node).value);
+            break;
+        case Kind::CALL:
+            for (auto& argument : static_cast<CallExpr&>(*node).arguments) rewrite(argument);
+            break;
+        default:
+            break;
+    }
+
+    if (const Def* def = find(defs_, node.get())) {
+        node = std::make_unique<TempStoreExpr>(std::move(node), def->slot);
+    }
+}
+
+void CommonSubexpressionEliminator::rewrite(Stmt* node) {
+    if (auto* expression = dynamic_cast<ExpressionStmt*>(node)) {
+        rewrite(expression->expression);
+    } else if (auto* print = dynamic_cast<PrintStmt*>(node)) {
+        rewrite(print->expression);
+    } else if (auto* let = dynamic_cast<LetStmt*>(node)) {
+        rewrite(let->initializer);
+    } else if (auto* block = dynamic_cast<BlockStmt*>(node)) {
+        for (auto& statement : block->statements) {
+            rewrite(statement.get());
+        }
+    } else if (auto* branch = dynamic_cast<IfStmt*>(node)) {
+        rewrite(branch->condition);
+        rewrite(branch->then_branch.get());
+        rewrite(branch->else_branch.get());
+    } else if (auto* loop = dynamic_cast<WhileStmt*>(node)) {
+        rewrite(loop->condition);
+        rewrite(loop->body.get());
+    }
+}
+
+std::size_t eliminate_common_subexpressions(std::vector<StmtPtr>& program) {
+    return CommonSubexpressionEliminator().run(program);
+}
+
+std::string to_string(const DeadStore& store) {
+    switch (store.kind) {
+        case DeadStore::Kind::UNUSED_BINDING:
+            return "unused binding '" + store.name + "'";
+        case DeadStore::Kind::DEAD_INITIALIZER:
+            return "dead initializer of '" + store.name + "'";
+        case DeadStore::Kind::DEAD_ASSIGNMENT:
+            return "dead assignment to '" + store.name + "'";
+    }
+    return "dead store";
+}
+
+std::size_t DeadStoreEliminator::run(std::vector<StmtPtr>& program) {
+    removed_.clear();
+
+    // Locals only live inside blocks, so most top-level statements have
+    // nothing to remove.
+    bool scoped = std::any_of(program.begin(), program.end(), [](const StmtPtr& statement) {
+        return dynamic_cast<const BlockStmt*>(statement.get()) || dynamic_cast<const IfStmt*>(statement.get()) ||
+               dynamic_cast<const WhileStmt*>(statement.get());
+    });
+    if (!scoped) return 0;
+
+    scopes_.clear();
+    bindings_.clear();
+    names_.clear();
+    reads_.clear();
+    dead_.clear();
+
+    for (const auto& statement : program) {
+        resolve(statement.get());
+    }
+    if (names_.empty()) return 0;
+
+    Live out(names_.size(), false);
+    recording_ = true;
+    for (auto it = program.rbegin(); it != program.rend(); ++it) {
+        live(it->get(), out);
+    }
+
+    rewrite(program);
+    return removed_.size();
+}
+
+void DeadStoreEliminator::resolve(const Expr* node) {
+    if (!node) return;
+
+    auto local = [this](const std::string& name) {
+        for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); ++scope) {
+            auto it = scope->find(name);
+            if (it != scope->end()) return it->second;
+        }
+        return static_cast<std::uint32_t>(-1);
+    };
+
+    switch (kind_of(*node)) {
+        case Kind::VARIABLE: {
+            std::uint32_t binding = local(static_cast<const VariableExpr*>(node)->name);
+            if (binding != static_cast<std::uint32_t>(-1)) {
+                bindings_.emplace(node, binding);
+                ++reads_[binding];
+            }
+            break;
+        }
+        case Kind::UNARY:
+            resolve(static_cast<const UnaryExpr*>(node)->right.get());
+            break;
+        case Kind::BINARY:
+            resolve(static_cast<const BinaryExpr*>(node)->left.get());
+            resolve(static_cast<const BinaryExpr*>(node)->right.get());
+            break;
+        case Kind::ASSIGN: {
+            auto* assign = static_cast<const AssignExpr*>(node);
+            resolve(assign->value.get());
+            std::uint32_t binding = local(assign->name);
+            if (binding != static_cast<std::uint32_t>(-1)) bindings_.emplace(node, binding);
+            break;
+        }
+        case Kind::CALL:
+            for (const auto& argument : static_cast<const CallExpr*>(node)->arguments) resolve(argument.get());
+            break;
+        default:
+            break;
+    }
+}
+
+void DeadStoreEliminator::resolve(const Stmt* node) {
+    if (auto* expression = dynamic_cast<const ExpressionStmt*>(node)) {
+        resolve(expression->expression.get());
+    } else if (auto* print = dynamic_cast<const PrintStmt*>(node)) {
+        resolve(print->expression.get());
+    } else if (auto* let = dynamic_cast<const LetStmt*>(node)) {
+        resolve(let->initializer.get());
+        if (!scopes_.empty()) {
+            auto binding = static_cast<std::uint32_t>(names_.size());
+            names_.push_back(let->name);
+            reads_.push_back(0);
+            scopes_.back()[let->name] = binding;
+            bindings_.emplace(node, binding);
+        }
+    } else if (auto* block = dynamic_cast<const BlockStmt*>(node)) {
+        scopes_.emplace_back();
+        for (const auto& statement : block->statements) {
+            resolve(statement.get());
+        }
+        scopes_.pop_back();
+    } else if (auto* branch = dynamic_cast<const IfStmt*>(node)) {
+        resolve(branch->condition.get());
+        resolve(branch->then_branch.get());
+        resolve(branch->else_branch.get());
+    } else if (auto* loop = dynamic_cast<const WhileStmt*>(node)) {
+        resolve(loop->condition.get());
+        resolve(loop->body.get());
+    }
+}
+
+// Turns `out`, the bindings live after `node`, into those live before it,
+// in reverse evaluation order. Stores to bindings that are not live are
+// noted while recording_ is set.
+void DeadStoreEliminator::live(const Expr* node, Live& out) {
+    if (!node) return;
+
+    switch (kind_of(*node)) {
+        case Kind::VARIABLE: {
+            auto it = bindings_.find(node);
+            if (it != bindings_.end()) out[it->second] = true;
+            break;
+        }
+        case Kind::UNARY:
+            live(static_cast<const UnaryExpr*>(node)->right.get(), out);
+            break;
+        case Kind::BINARY:
+            live(static_cast<const BinaryExpr*>(node)->right.get(), out);
+            live(static_cast<const BinaryExpr*>(node)->left.get(), out);
+            break;
+        case Kind::ASSIGN: {
+            auto it = bindings_.find(node);
+            if (it != bindings_.end()) {
+                if (recording_ && !out[it->second]) dead_.insert(node);
+                out[it->second] = false;
+            }
+            live(static_cast<const AssignExpr*>(node)->value.get(), out);
+            break;
+        }
+        case Kind::CALL: {
+            const auto& arguments = static_cast<const CallExpr*>(node)->arguments;
+            for (auto it = arguments.rbegin(); it != arguments.rend(); ++it) live(it->get(), out);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void DeadStoreEliminator::live(const Stmt* node, Live& out) {
+    if (auto* expression = dynamic_cast<const ExpressionStmt*>(node)) {
+        live(expression->expression.get(), out);
+    } else if (auto* print = dynamic_cast<const PrintStmt*>(node)) {
+        live(print->expression.get(), out);
+    } else if (auto* let = dynamic_cast<const LetStmt*>(node)) {
+        auto it = bindings_.find(node);
+        if (it != bindings_.end()) {
+            if (recording_ && !out[it->second]) dead_.insert(node);
+            out[it->second] = false;
+        }
+        live(let->initializer.get(), out);
+    } else if (auto* block = dynamic_cast<const BlockStmt*>(node)) {
+        for (auto it = block->statements.rbegin(); it != block->statements.rend(); ++it) {
+            live(it->get(), out);
+        }
+    } else if (auto* branch = dynamic_cast<const IfStmt*>(node)) {
+        Live otherwise = out;
+        live(branch->then_branch.get(), out);
+        live(branch->else_branch.get(), otherwise);
+        for (std::size_t i = 0; i < out.size(); ++i) {
+            out[i] = out[i] || otherwise[i];
+        }
+        live(branch->condition.get(), out);
+    } else if (auto* loop = dynamic_cast<const WhileStmt*>(node)) {
+        // Iterate to the fixed point at the loop header without recording,
+        // then make one recording pass with the final sets.
+        bool recording = recording_;
+        recording_ = false;
+        Live header = out;
+        live(loop->condition.get(), header);
+        while (true) {
+            Live next = header;
+            live(loop->body.get(), next);
+            for (std::size_t i = 0; i < next.size(); ++i) {
+                next[i] = next[i] || out[i];
+            }
+            live(loop->condition.get(), next);
+            if (next == header) break;
+            header = std::move(next);
+        }
+        recording_ = recording;
+
+        Live body = header;
+        live(loop->body.get(), body);
+        for (std::size_t i = 0; i < body.size(); ++i) {
+            out[i] = out[i] || body[i];
+        }
+        live(loop->condition.get(), out);
+    }
+}
+
+bool DeadStoreEliminator::dead(const void* node) const {
+    return dead_.count(node) != 0;
+}
+
+void DeadStoreEliminator::rewrite(ExprPtr& node) {
+    if (!node) return;
+
+    switch (kind_of(*node)) {
+        case Kind::UNARY:
+            rewrite(static_cast<UnaryExpr&>(*node).right);
+            break;
+        case Kind::BINARY:
+            rewrite(static_cast<BinaryExpr&>(*node).left);
+            rewrite(static_cast<BinaryExpr&>(*node).right);
+            break;
+        case Kind::ASSIGN: {
+            auto& assign = static_cast<AssignExpr&>(*node);
+            rewrite(assign.value);
+            if (dead(&assign)) {
+                removed_.push_back(DeadStore{DeadStore::Kind::DEAD_ASSIGNMENT, assign.name});
+                node = std::move(assign.value);
+            }
+            break;
+        }
+        case Kind::CALL:
+            for (auto& argument : static_cast<CallExpr&>(*node).arguments) rewrite(argument);
+            break;
+        default:
+            break;
+    }
+}
+
+void DeadStoreEliminator::rewrite(StmtPtr& node) {
+    if (auto* expression = dynamic_cast<ExpressionStmt*>(node.get())) {
+        rewrite(expression->expression);
+    } else if (auto* print = dynamic_cast<PrintStmt*>(node.get())) {
+        rewrite(print->expression);
+    } else if (auto* let = dynamic_cast<LetStmt*>(node.get())) {
+        rewrite(let->initializer);
+    } else if (auto* block = dynamic_cast<BlockStmt*>(node.get())) {
+        rewrite(block->statements);
+    } else if (auto* branch = dynamic_cast<IfStmt*>(node.get())) {
+        rewrite(branch->condition);
+        rewrite(branch->then_branch);
+        if (branch->else_branch) rewrite(branch->else_branch);
+    } else if (auto* loop = dynamic_cast<WhileStmt*>(node.get())) {
+        rewrite(loop->condition);
+        rewrite(loop->body);
+    }
+}
+
+void DeadStoreEliminator::rewrite(std::vector<StmtPtr>& statements) {
+    auto is_local = [this](const Expr* expr) { return bindings_.count(expr) != 0; };
+
+    std::vector<StmtPtr> kept;
+    kept.reserve(statements.size());
+    for (auto& statement : statements) {
+        auto* expression = dynamic_cast<ExpressionStmt*>(statement.get());
+        bool assignment = expression && dynamic_cast<AssignExpr*>(expression->expression.get());
+        rewrite(statement);
+
+        if (auto* let = dynamic_cast<LetStmt*>(statement.get())) {
+            auto it = bindings_.find(let);
+            if (it != bindings_.end() && reads_[it->second] == 0) {
+                removed_.push_back(DeadStore{DeadStore::Kind::UNUSED_BINDING, let->name});
+                if (let->initializer && !is_safe(*let->initializer, is_local)) {
+                    kept.push_back(std::make_unique<ExpressionStmt>(std::move(let->initializer)));
+                }
+                continue;
+            }
+            if (let->initializer && dead(let) && is_safe(*let->initializer, is_local)) {
+                removed_.push_back(DeadStore{DeadStore::Kind::DEAD_INITIALIZER, let->name});
+                let->initializer.reset();
+            }
+        } else if (assignment && !dynamic_cast<AssignExpr*>(expression->expression.get()) &&
+                   is_safe(*expression->expression, is_local)) {
+            // All that is left of a dead assignment statement.
+            continue;
+        }
+        kept.push_back(std::move(statement));
+    }
+    statements = std::move(kept);
+}
+
+std::size_t eliminate_dead_stores(std::vector<StmtPtr>& program) {
+    return DeadStoreEliminator().run(program);
+}
+
+namespace {
+
+// The operand `node` stands for, if it is a local or a literal.
+bool fused_operand(const Expr& node, FusedOperand& operand) {
+    switch (kind_of(node)) {
+        case Kind::VARIABLE: {
+            std::uint32_t slot = static_cast<const VariableExpr&>(node).slot;
+            if (slot == no_frame_slot) return false;
+            operand = FusedOperand{slot, Value{}};
+            return true;
+        }
+        case Kind::LITERAL:
+            operand = FusedOperand{no_frame_slot, static_cast<const LiteralExpr&>(node).value};
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool is_comparison(BinaryOp op) {
+    return op == BinaryOp::GREATER || op == BinaryOp::GREATER_EQUAL || op == BinaryOp::LESS ||
+           op == BinaryOp::LESS_EQUAL || op == BinaryOp::EQUAL || op == BinaryOp::NOT_EQUAL;
+}
+
+// The `x = x + y` or `x = x - y` that `node` consists of, if any.
+const FusedAssignExpr* additive_update(const Stmt* node) {
+    auto* statement = dynamic_cast<const ExpressionStmt*>(node);
+    auto* update = statement ? dynamic_cast<const FusedAssignExpr*>(statement->expression.get()) : nullptr;
+    if (!update || (update->op != BinaryOp::ADD && update->op != BinaryOp::SUBTRACT)) return nullptr;
+    return update;
+}
+
+// Whether `loop` has the shape of a CountedLoopStmt; if so, fills in its
+// stride and steps.
+bool counted_loop(const FusedWhileStmt& loop, double& stride, std::vector<CountedLoopStmt::Step>& steps) {
+    const FusedBinaryExpr& condition = *loop.condition;
+    bool upward = condition.op == BinaryOp::LESS || condition.op == BinaryOp::LESS_EQUAL;
+    bool downward = condition.op == BinaryOp::GREATER || condition.op == BinaryOp::GREATER_EQUAL;
+    if ((!upward && !downward) || condition.left.slot == no_frame_slot) return false;
+
+    std::vector<const FusedAssignExpr*> updates;
+    if (auto* block = dynamic_cast<const BlockStmt*>(loop.body.get())) {
+        for (const auto& statement : block->statements) {
+            updates.push_back(additive_update(statement.get()));
+            if (!updates.back()) return false;
+        }
+    } else {
+        updates.push_back(additive_update(loop.body.get()));
+        if (!updates.back()) return false;
+    }
+    auto assignments = [&](std::uint32_t slot) {
+        return std::count_if(updates.begin(), updates.end(), [&](auto* update) { return update->slot == slot; });
+    };
+
+    std::uint32_t counter = condition.left.slot;
+    std::size_t counter_update = updates.size();
+    for (std::size_t i = 0; i < updates.size(); ++i) {
+        if (assignments(updates[i]->slot) != 1) return false;
+        if (updates[i]->slot != counter) continue;
+        const double* amount = std::get_if<double>(&updates[i]->right.constant);
+        if (updates[i]->right.slot != no_frame_slot || !amount || *amount == 0 || std::trunc(*amount) != *amount ||
+            std::fabs(*amount) > 0x1p53) {
+            return false;
+        }
+        stride = updates[i]->op == BinaryOp::ADD ? *amount : -*amount;
+        counter_update = i;
+    }
+    if (counter_update == updates.size() || (stride > 0) != upward) return false;
+    if (condition.right.slot != no_frame_slot && assignments(condition.right.slot) != 0) return false;
+
+    for (std::size_t i = 0; i < updates.size(); ++i) {
+        if (i == counter_update) continue;
+        std::uint32_t amount = updates[i]->right.slot;
+        if (amount != no_frame_slot && amount != counter && assignments(amount) != 0) return false;
+        steps.push_back(CountedLoopStmt::Step{updates[i]->slot, updates[i]->op, updates[i]->right,
+                                              amount == counter && i > counter_update});
+    }
+    return true;
+}
+
+} // namespace
+
+std::size_t SuperinstructionFuser::run(std::vector<StmtPtr>& program) {
+    fused_ = 0;
+    for (auto& statement : program) {
+        // Only blocks, branches and loops can hold locals.
+        Stmt* node = statement.get();
+        if (dynamic_cast<BlockStmt*>(node) || dynamic_cast<IfStmt*>(node) || dynamic_cast<WhileStmt*>(node)) {
+            fuse(statement);
+        }
+    }
+    return fused_;
+}
+
+void SuperinstructionFuser::fuse(ExprPtr& node) {
+    if (!node) return;
+
+    switch (kind_of(*node)) {
+        case Kind::UNARY:
+            fuse(static_cast<UnaryExpr&>(*node).right);
+            break;
+        case Kind::BINARY: {
+            auto& binary = static_cast<BinaryExpr&>(*node);
+            FusedOperand left;
+            FusedOperand right;
+            if (fused_operand(*binary.left, left) && fused_operand(*binary.right, right) &&
+                (left.slot != no_frame_slot || right.slot != no_frame_slot)) {
+                node = std::make_unique<FusedBinaryExpr>(to_binary_op(binary.op.type), std::move(left),
+                                                         std::move(right));
+                fused_ += 2;
+                return;
+            }
+            fuse(binary.left);
+            fuse(binary.right);
+            break;
+        }
+        case Kind::ASSIGN: {
+            auto& assign = static_cast<AssignExpr&>(*node);
+            if (assign.slot != no_frame_slot && kind_of(*assign.value) == Kind::BINARY) {
+                auto& binary = static_cast<BinaryExpr&>(*assign.value);
+                BinaryOp op = to_binary_op(binary.op.type);
+                FusedOperand target;
+                FusedOperand right;
+                bool arithmetic = op == BinaryOp::ADD || op == BinaryOp::SUBTRACT || op == BinaryOp::MULTIPLY ||
+                                  op == BinaryOp::DIVIDE;
+                if (arithmetic && fused_operand(*binary.left, target) && target.slot == assign.slot &&
+                    fused_operand(*binary.right, right)) {
+                    node = std::make_unique<FusedAssignExpr>(assign.slot, op, std::move(right));
+                    fused_ += 3;
+                    return;
+                }
+            }
+            fuse(assign.value);
+            break;
+        }
+        case Kind::CALL:
+            for (auto& argument : static_cast<CallExpr&>(*node).arguments) fuse(argument);
+            break;
+        case Kind::OTHER:
+            if (auto* store = dynamic_cast<TempStoreExpr*>(node.get())) fuse(store->value);
+            break;
+        default:
+            break;
+    }
+}
+
+void SuperinstructionFuser::fuse(StmtPtr& node) {
+    if (auto* expression = dynamic_cast<ExpressionStmt*>(node.get())) {
+        fuse(expression->expression);
+    } else if (auto* print = dynamic_cast<PrintStmt*>(node.get())) {
+        fuse(print->expression);
+    } else if (auto* let = dynamic_cast<LetStmt*>(node.get())) {
+        fuse(let->initializer);
+    } else if (auto* block = dynamic_cast<BlockStmt*>(node.get())) {
+        for (auto& statement : block->statements) {
+            fuse(statement);
+        }
+    } else if (auto* branch = dynamic_cast<IfStmt*>(node.get())) {
+        fuse(branch->condition);
+        if (branch->then_branch) fuse(branch->then_branch);
+        if (branch->else_branch) fuse(branch->else_branch);
+    } else if (auto* loop = dynamic_cast<WhileStmt*>(node.get())) {
+        fuse(loop->condition);
+        fuse(loop->body);
+        auto* condition = dynamic_cast<FusedBinaryExpr*>(loop->condition.get());
+        if (condition && is_comparison(condition->op)) {
+            std::unique_ptr<FusedBinaryExpr> test(static_cast<FusedBinaryExpr*>(loop->condition.release()));
+            auto fused = std::make_unique<FusedWhileStmt>(std::move(test), std::move(loop->body));
+            ++fused_;
+            double stride = 0;
+            std::vector<CountedLoopStmt::Step> steps;
+            if (counted_loop(*fused, stride, steps)) {
+                node = std::make_unique<CountedLoopStmt>(std::move(fused), stride, std::move(steps));
+            } else {
+                node = std::move(fused);
+            }
+        }
+    }
+}
+
+} // namespace tl
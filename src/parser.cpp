@@ -1,51 +1,133 @@
 #include "tl/parser.hpp"
 
-#include <stdexcept>
+#include <array>
+#include <future>
+#include <iterator>
 
 namespace tl {
 
+std::string to_string(const Diagnostic& diagnostic) {
+    return "line " + std::to_string(diagnostic.line) + ", column " + std::to_string(diagnostic.column) +
+           ": " + diagnostic.message;
+}
+
 Parser::Parser(std::vector<Token> tokens)
-    : tokens_(std::move(tokens)), current_(0) {}
+    : tokens_(tokens), current_(0), lexer_(nullptr), panic_(false) {}
+
+Parser::Parser(TokenBuffer tokens)
+    : tokens_(std::move(tokens)), current_(0), lexer_(nullptr), panic_(false) {}
+
+Parser::Parser(Lexer& lexer)
+    : current_(0), lexer_(&lexer), panic_(false) {
+    tokens_.append(lexer_->next_token());
+}
 
 std::vector<StmtPtr> Parser::parse() {
     std::vector<StmtPtr> statements;
-    while (!is_at_end()) {
-        statements.push_back(declaration());
+    while (has_next()) {
+        statements.push_back(next());
     }
     return statements;
 }
 
-StmtPtr Parser::declaration() {
-    try {
-        if (match({TokenType::LET})) {
-            return let_declaration();
+const std::vector<Diagnostic>& Parser::diagnostics() const {
+    return diagnostics_;
+}
+
+std::vector<StmtPtr> Parser::parse_parallel(ThreadPool& pool, std::size_t chunk_tokens) {
+    if (lexer_ || tokens_.size() - current_ <= chunk_tokens) {
+        return parse();
+    }
+
+    // The last range keeps the END_OF_FILE token and any unfinished tail.
+    std::vector<std::pair<std::size_t, std::size_t>> ranges;
+    std::size_t begin = current_;
+    for (std::size_t boundary : statement_boundaries(tokens_)) {
+        if (boundary > begin && boundary - begin >= chunk_tokens) {
+            ranges.emplace_back(begin, boundary);
+            begin = boundary;
         }
-        return statement();
-    } catch (const ParseError&) {
-        synchronize();
-        return nullptr;
     }
+    ranges.emplace_back(begin, tokens_.size());
+
+    struct Chunk {
+        std::vector<StmtPtr> statements;
+        bool clean;
+    };
+    std::vector<std::future<Chunk>> pending;
+    pending.reserve(ranges.size());
+    for (auto [first, last] : ranges) {
+        pending.push_back(pool.submit([this, first = first, last = last] {
+            TokenBuffer slice = tokens_.slice(first, last);
+            if (last != tokens_.size()) {
+                slice.push(TokenType::END_OF_FILE, slice.text().size(), 0, tokens_.line(last - 1), 0);
+            }
+            Parser parser(std::move(slice));
+            std::vector<StmtPtr> statements = parser.parse();
+            return Chunk{std::move(statements), parser.diagnostics_.empty()};
+        }));
+    }
+
+    std::vector<StmtPtr> statements;
+    bool clean = true;
+    for (auto& future : pending) {
+        Chunk chunk = future.get();
+        clean = clean && chunk.clean;
+        std::move(chunk.statements.begin(), chunk.statements.end(), std::back_inserter(statements));
+    }
+    if (!clean) {
+        return parse();
+    }
+    current_ = tokens_.size() - 1;
+    return statements;
+}
+
+bool Parser::has_next() const {
+    return !is_at_end();
+}
+
+StmtPtr Parser::next() {
+    if (lexer_ && current_ > 1) {
+        // Keep previous() valid; everything before it is already parsed.
+        tokens_.discard(current_ - 1);
+        current_ = 1;
+    }
+    return declaration();
+}
+
+StmtPtr Parser::declaration() {
+    std::size_t start = current_;
+    StmtPtr stmt = match(TokenType::LET) ? let_declaration() : statement();
+    if (!panic_) return stmt;
+
+    // Nothing is recorded in panic mode, so the error that started it is the
+    // last one recorded.
+    std::size_t diagnostic = diagnostics_.size() - 1;
+    if (current_ == start) advance();
+    synchronize();
+    panic_ = false;
+    return std::make_unique<ErrorStmt>(diagnostic);
 }
 
 StmtPtr Parser::let_declaration() {
-    const Token& name = consume(TokenType::IDENTIFIER, "Expected variable name after 'let'.");
+    std::string name(tokens_.lexeme(consume(TokenType::IDENTIFIER, "Expected variable name after 'let'.")));
     consume(TokenType::EQUAL, "Expected '=' after variable name.");
     ExprPtr initializer = expression();
     consume(TokenType::SEMICOLON, "Expected ';' after variable declaration.");
-    return std::make_unique<LetStmt>(name.lexeme, std::move(initializer));
+    return std::make_unique<LetStmt>(std::move(name), std::move(initializer));
 }
 
 StmtPtr Parser::statement() {
-    if (match({TokenType::PRINT})) {
+    if (match(TokenType::PRINT)) {
         return print_statement();
     }
-    if (match({TokenType::LEFT_BRACE})) {
+    if (match(TokenType::LEFT_BRACE)) {
         return block_statement();
     }
-    if (match({TokenType::IF})) {
+    if (match(TokenType::IF)) {
         return if_statement();
     }
-    if (match({TokenType::WHILE})) {
+    if (match(TokenType::WHILE)) {
         return while_statement();
     }
     return expression_statement();
@@ -64,6 +146,8 @@ StmtPtr Parser::expression_statement() {
 }
 
 StmtPtr Parser::block_statement() {
+    // Each declaration recovers from its own errors, so the block parses on
+    // after one.
     std::vector<StmtPtr> statements;
     while (!check(TokenType::RIGHT_BRACE) && !is_at_end()) {
         statements.push_back(declaration());
@@ -79,7 +163,7 @@ StmtPtr Parser::if_statement() {
 
     StmtPtr then_branch = statement();
     StmtPtr else_branch = nullptr;
-    if (match({TokenType::ELSE})) {
+    if (match(TokenType::ELSE)) {
         else_branch = statement();
     }
     return std::make_unique<IfStmt>(std::move(condition), std::move(then_branch), std::move(else_branch));
@@ -93,182 +177,194 @@ StmtPtr Parser::while_statement() {
     return std::make_unique<WhileStmt>(std::move(condition), std::move(body));
 }
 
-ExprPtr Parser::expression() {
-    return assignment();
-}
-
-ExprPtr Parser::assignment() {
-    ExprPtr expr = or_expression();
-
-    if (match({TokenType::EQUAL})) {
-        const Token& equals = previous();
-        ExprPtr value = assignment();
-
-        if (auto* var_expr = dynamic_cast<VariableExpr*>(expr.get())) {
-            std::string name = var_expr->name;
-            return std::make_unique<AssignExpr>(name, std::move(value));
-        }
-
-        throw ParseError("Invalid assignment target at line " + std::to_string(equals.line));
-    }
-
-    return expr;
-}
-
-ExprPtr Parser::or_expression() {
-    ExprPtr expr = and_expression();
-
-    while (match({TokenType::OR})) {
-        Token op = previous();
-        ExprPtr right = and_expression();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
-    }
-
-    return expr;
-}
-
-ExprPtr Parser::and_expression() {
-    ExprPtr expr = equality();
-
-    while (match({TokenType::AND})) {
-        Token op = previous();
-        ExprPtr right = equality();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
-    }
-
-    return expr;
-}
-
-ExprPtr Parser::equality() {
-    ExprPtr expr = comparison();
-
-    while (match({TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL})) {
-        Token op = previous();
-        ExprPtr right = comparison();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
-    }
-
-    return expr;
+namespace {
+
+// Binding power of every token in infix position; NONE ends an expression.
+constexpr std::array<Precedence, static_cast<std::size_t>(TokenType::END_OF_FILE) + 1> infix_table = [] {
+    std::array<Precedence, static_cast<std::size_t>(TokenType::END_OF_FILE) + 1> table{};
+    auto set = [&table](TokenType type, Precedence precedence) {
+        table[static_cast<std::size_t>(type)] = precedence;
+    };
+    set(TokenType::EQUAL, Precedence::ASSIGNMENT);
+    set(TokenType::OR, Precedence::OR);
+    set(TokenType::AND, Precedence::AND);
+    set(TokenType::BANG_EQUAL, Precedence::EQUALITY);
+    set(TokenType::EQUAL_EQUAL, Precedence::EQUALITY);
+    set(TokenType::GREATER, Precedence::COMPARISON);
+    set(TokenType::GREATER_EQUAL, Precedence::COMPARISON);
+    set(TokenType::LESS, Precedence::COMPARISON);
+    set(TokenType::LESS_EQUAL, Precedence::COMPARISON);
+    set(TokenType::PLUS, Precedence::TERM);
+    set(TokenType::MINUS, Precedence::TERM);
+    set(TokenType::STAR, Precedence::FACTOR);
+    set(TokenType::SLASH, Precedence::FACTOR);
+    return table;
+}();
+
+Precedence infix_precedence(TokenType type) {
+    return infix_table[static_cast<std::size_t>(type)];
 }
 
-ExprPtr Parser::comparison() {
-    ExprPtr expr = term();
-
-    while (match({TokenType::GREATER, TokenType::GREATER_EQUAL, TokenType::LESS, TokenType::LESS_EQUAL})) {
-        Token op = previous();
-        ExprPtr right = term();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
-    }
-
-    return expr;
+Precedence next_precedence(Precedence precedence) {
+    return static_cast<Precedence>(static_cast<int>(precedence) + 1);
 }
 
-ExprPtr Parser::term() {
-    ExprPtr expr = factor();
-
-    while (match({TokenType::PLUS, TokenType::MINUS})) {
-        Token op = previous();
-        ExprPtr right = factor();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
-    }
+} // namespace
 
-    return expr;
+ExprPtr Parser::expression() {
+    return parse_precedence(Precedence::ASSIGNMENT);
 }
 
-ExprPtr Parser::factor() {
-    ExprPtr expr = unary();
+// Precedence climbing: parse one operand, then keep folding in infix
+// operators that bind at least as tightly as `minimum`. Binary operators
+// are left-associative, assignment is right-associative.
+ExprPtr Parser::parse_precedence(Precedence minimum) {
+    ExprPtr expr = prefix();
+
+    while (true) {
+        Precedence precedence = infix_precedence(peek());
+        if (precedence == Precedence::NONE || precedence < minimum) break;
+        std::size_t op = advance();
+
+        if (precedence == Precedence::ASSIGNMENT) {
+            ExprPtr value = parse_precedence(Precedence::ASSIGNMENT);
+            if (auto* var_expr = dynamic_cast<VariableExpr*>(expr.get())) {
+                return std::make_unique<AssignExpr>(std::move(var_expr->name), std::move(value));
+            }
+            // Reported without entering panic mode: the parser is not lost.
+            bool panic = panic_;
+            std::size_t diagnostic = error_at(op, "Invalid assignment target.");
+            panic_ = panic;
+            return std::make_unique<ErrorExpr>(diagnostic);
+        }
 
-    while (match({TokenType::STAR, TokenType::SLASH})) {
-        Token op = previous();
-        ExprPtr right = unary();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+        ExprPtr right = parse_precedence(next_precedence(precedence));
+        expr = std::make_unique<BinaryExpr>(std::move(expr), tokens_.token(op), std::move(right));
     }
 
     return expr;
 }
 
-ExprPtr Parser::unary() {
-    if (match({TokenType::BANG, TokenType::MINUS})) {
-        Token op = previous();
-        ExprPtr right = unary();
-        return std::make_unique<UnaryExpr>(op, std::move(right));
+ExprPtr Parser::prefix() {
+    switch (peek()) {
+        case TokenType::BANG:
+        case TokenType::MINUS: {
+            Token op = tokens_.token(advance());
+            ExprPtr right = parse_precedence(Precedence::UNARY);
+            return std::make_unique<UnaryExpr>(std::move(op), std::move(right));
+        }
+        case TokenType::FALSE:
+            advance();
+            return std::make_unique<LiteralExpr>(Value{false});
+        case TokenType::TRUE:
+            advance();
+            return std::make_unique<LiteralExpr>(Value{true});
+        case TokenType::NIL:
+            advance();
+            return std::make_unique<LiteralExpr>(Value{});
+        case TokenType::NUMBER:
+            return std::make_unique<LiteralExpr>(Value{tokens_.number(advance())});
+        case TokenType::STRING:
+            return std::make_unique<LiteralExpr>(Value{std::string(tokens_.string_value(advance()))});
+        case TokenType::IDENTIFIER: {
+            std::size_t name = advance();
+            if (check(TokenType::LEFT_PAREN)) return call(name);
+            return std::make_unique<VariableExpr>(std::string(tokens_.lexeme(name)));
+        }
+        case TokenType::LEFT_PAREN: {
+            advance();
+            ExprPtr expr = expression();
+            consume(TokenType::RIGHT_PAREN, "Expected ')' after expression.");
+            return expr;
+        }
+        default:
+            break;
     }
 
-    return primary();
+    return std::make_unique<ErrorExpr>(error_at(current_, "Expected expression."));
 }
 
-ExprPtr Parser::primary() {
-    if (match({TokenType::FALSE})) return std::make_unique<LiteralExpr>(Value{false});
-    if (match({TokenType::TRUE})) return std::make_unique<LiteralExpr>(Value{true});
-    if (match({TokenType::NIL})) return std::make_unique<LiteralExpr>(Value{});
-
-    if (match({TokenType::NUMBER})) {
-        double value = std::get<double>(previous().literal);
-        return std::make_unique<LiteralExpr>(Value{value});
-    }
-
-    if (match({TokenType::STRING})) {
-        std::string value = std::get<std::string>(previous().literal);
-        return std::make_unique<LiteralExpr>(Value{value});
+// The arguments of a call of the builtin named by token `name`, whose
+// '(' is next.
+ExprPtr Parser::call(std::size_t name) {
+    advance();
+    std::vector<ExprPtr> arguments;
+    if (!check(TokenType::RIGHT_PAREN)) {
+        do {
+            arguments.push_back(expression());
+        } while (match(TokenType::COMMA));
     }
+    consume(TokenType::RIGHT_PAREN, "Expected ')' after arguments.");
 
-    if (match({TokenType::IDENTIFIER})) {
-        return std::make_unique<VariableExpr>(previous().lexeme);
+    Builtin builtin;
+    if (!find_builtin(tokens_.lexeme(name), builtin)) {
+        return std::make_unique<ErrorExpr>(error_at(name, "Unknown function."));
     }
-
-    if (match({TokenType::LEFT_PAREN})) {
-        ExprPtr expr = expression();
-        consume(TokenType::RIGHT_PAREN, "Expected ')' after expression.");
-        return expr;
+    const BuiltinInfo& info = builtin_info(builtin);
+    if (arguments.size() < info.min_arguments || arguments.size() > info.max_arguments) {
+        return std::make_unique<ErrorExpr>(error_at(name, "Wrong number of arguments."));
     }
-
-    throw ParseError("Expected expression at line " + std::to_string(peek().line));
+    return std::make_unique<CallExpr>(builtin, std::move(arguments));
 }
 
-const Token& Parser::peek() const {
-    return tokens_[current_];
+TokenType Parser::peek() const {
+    return tokens_.type(current_);
 }
 
-const Token& Parser::previous() const {
-    return tokens_[current_ - 1];
+std::size_t Parser::previous() const {
+    return current_ - 1;
 }
 
 bool Parser::is_at_end() const {
-    return peek().type == TokenType::END_OF_FILE;
+    return peek() == TokenType::END_OF_FILE;
 }
 
-const Token& Parser::advance() {
-    if (!is_at_end()) current_++;
+std::size_t Parser::advance() {
+    if (!is_at_end()) {
+        current_++;
+        if (lexer_ && current_ == tokens_.size()) {
+            tokens_.append(lexer_->next_token());
+        }
+    }
     return previous();
 }
 
 bool Parser::check(TokenType type) const {
     if (is_at_end()) return false;
-    return peek().type == type;
+    return peek() == type;
 }
 
-bool Parser::match(std::initializer_list<TokenType> types) {
-    for (TokenType type : types) {
-        if (check(type)) {
-            advance();
-            return true;
-        }
-    }
-    return false;
+bool Parser::match(TokenType type) {
+    if (!check(type)) return false;
+    advance();
+    return true;
 }
 
-const Token& Parser::consume(TokenType type, const std::string& message) {
+// On a mismatch the offending token is returned unconsumed.
+std::size_t Parser::consume(TokenType type, const char* message) {
     if (check(type)) return advance();
-    throw ParseError(message + " (line " + std::to_string(peek().line) + ")");
+    error_at(current_, message);
+    return current_;
 }
 
-void Parser::synchronize() {
-    advance();
+// Records an error at `token` unless already in panic mode, then enters it.
+// Returns the index of the diagnostic describing the current error.
+std::size_t Parser::error_at(std::size_t token, const char* message) {
+    if (!panic_) {
+        panic_ = true;
+        diagnostics_.push_back(Diagnostic{message, tokens_.line(token), tokens_.column(token),
+                                          static_cast<int>(tokens_.lexeme(token).size())});
+    }
+    return diagnostics_.size() - 1;
+}
 
+// Skips to the likely start of the next statement. The failed statement
+// may already have consumed its terminating ';'.
+void Parser::synchronize() {
     while (!is_at_end()) {
-        if (previous().type == TokenType::SEMICOLON) return;
+        if (tokens_.type(previous()) == TokenType::SEMICOLON) return;
 
-        switch (peek().type) {
+        switch (peek()) {
             case TokenType::LET:
             case TokenType::PRINT:
                 return;
@@ -280,5 +376,45 @@ void Parser::synchronize() {
     }
 }
 
-} // namespace tl
+namespace {
+
+template <typename TypeAt>
+std::vector<std::size_t> find_boundaries(std::size_t size, TypeAt type_at) {
+    std::vector<std::size_t> boundaries;
+    int depth = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+        switch (type_at(i)) {
+            case TokenType::LEFT_PAREN:
+            case TokenType::LEFT_BRACE:
+                depth++;
+                continue;
+            case TokenType::RIGHT_PAREN:
+                depth--;
+                continue;
+            case TokenType::RIGHT_BRACE:
+                depth--;
+                break;
+            case TokenType::SEMICOLON:
+                break;
+            default:
+                continue;
+        }
+        if (depth > 0) continue;
+        depth = 0;
+        if (i + 1 < size && type_at(i + 1) == TokenType::ELSE) continue;
+        boundaries.push_back(i + 1);
+    }
+    return boundaries;
+}
 
+} // namespace
+
+std::vector<std::size_t> statement_boundaries(const std::vector<Token>& tokens) {
+    return find_boundaries(tokens.size(), [&tokens](std::size_t i) { return tokens[i].type; });
+}
+
+std::vector<std::size_t> statement_boundaries(const TokenBuffer& tokens) {
+    return find_boundaries(tokens.size(), [&tokens](std::size_t i) { return tokens.type(i); });
+}
+
+} // namespace tl
@@ -0,0 +1,396 @@
+#include "tl/partial_eval.hpp"
+
+#include "tl/ops.hpp"
+
+#include <cmath>
+
+namespace tl {
+
+namespace {
+
+bool has_assignment(const Expr* node) {
+    if (dynamic_cast<const AssignExpr*>(node)) return true;
+    if (auto* unary = dynamic_cast<const UnaryExpr*>(node)) return has_assignment(unary->right.get());
+    if (auto* binary = dynamic_cast<const BinaryExpr*>(node)) {
+        return has_assignment(binary->left.get()) || has_assignment(binary->right.get());
+    }
+    if (auto* call = dynamic_cast<const CallExpr*>(node)) {
+        for (const auto& argument : call->arguments) {
+            if (has_assignment(argument.get())) return true;
+        }
+    }
+    return false;
+}
+
+// Every name a `let` or an assignment in `node` may bind.
+void assigned(const Expr* node, std::unordered_set<std::string>& names) {
+    if (auto* assign = dynamic_cast<const AssignExpr*>(node)) {
+        names.insert(assign->name);
+        assigned(assign->value.get(), names);
+    } else if (auto* unary = dynamic_cast<const UnaryExpr*>(node)) {
+        assigned(unary->right.get(), names);
+    } else if (auto* binary = dynamic_cast<const BinaryExpr*>(node)) {
+        assigned(binary->left.get(), names);
+        assigned(binary->right.get(), names);
+    } else if (auto* call = dynamic_cast<const CallExpr*>(node)) {
+        for (const auto& argument : call->arguments) assigned(argument.get(), names);
+    }
+}
+
+void assigned(const Stmt* node, std::unordered_set<std::string>& names) {
+    if (auto* expression = dynamic_cast<const ExpressionStmt*>(node)) {
+        assigned(expression->expression.get(), names);
+    } else if (auto* print = dynamic_cast<const PrintStmt*>(node)) {
+        assigned(print->expression.get(), names);
+    } else if (auto* let = dynamic_cast<const LetStmt*>(node)) {
+        names.insert(let->name);
+        assigned(let->initializer.get(), names);
+    } else if (auto* block = dynamic_cast<const BlockStmt*>(node)) {
+        for (const auto& statement : block->statements) assigned(statement.get(), names);
+    } else if (auto* branch = dynamic_cast<const IfStmt*>(node)) {
+        assigned(branch->condition.get(), names);
+        assigned(branch->then_branch.get(), names);
+        assigned(branch->else_branch.get(), names);
+    } else if (auto* loop = dynamic_cast<const WhileStmt*>(node)) {
+        assigned(loop->condition.get(), names);
+        assigned(loop->body.get(), names);
+    }
+}
+
+std::size_t size(const Stmt* node) {
+    if (auto* block = dynamic_cast<const BlockStmt*>(node)) {
+        std::size_t total = 1;
+        for (const auto& statement : block->statements) total += size(statement.get());
+        return total;
+    }
+    if (auto* branch = dynamic_cast<const IfStmt*>(node)) {
+        return 1 + (branch->then_branch ? size(branch->then_branch.get()) : 0) +
+               (branch->else_branch ? size(branch->else_branch.get()) : 0);
+    }
+    if (auto* loop = dynamic_cast<const WhileStmt*>(node)) return 1 + size(loop->body.get());
+    return 1;
+}
+
+std::size_t literal_bytes(const Expr* node) {
+    if (auto* literal = dynamic_cast<const LiteralExpr*>(node)) {
+        auto* text = std::get_if<std::string>(&literal->value);
+        return text ? text->size() : 0;
+    }
+    if (auto* unary = dynamic_cast<const UnaryExpr*>(node)) return literal_bytes(unary->right.get());
+    if (auto* binary = dynamic_cast<const BinaryExpr*>(node)) {
+        return literal_bytes(binary->left.get()) + literal_bytes(binary->right.get());
+    }
+    if (auto* assign = dynamic_cast<const AssignExpr*>(node)) return literal_bytes(assign->value.get());
+    if (auto* call = dynamic_cast<const CallExpr*>(node)) {
+        std::size_t total = 0;
+        for (const auto& argument : call->arguments) total += literal_bytes(argument.get());
+        return total;
+    }
+    return 0;
+}
+
+std::size_t literal_bytes(const Stmt* node) {
+    if (auto* expression = dynamic_cast<const ExpressionStmt*>(node)) {
+        return literal_bytes(expression->expression.get());
+    }
+    if (auto* print = dynamic_cast<const PrintStmt*>(node)) return literal_bytes(print->expression.get());
+    if (auto* let = dynamic_cast<const LetStmt*>(node)) return literal_bytes(let->initializer.get());
+    if (auto* block = dynamic_cast<const BlockStmt*>(node)) {
+        std::size_t total = 0;
+        for (const auto& statement : block->statements) total += literal_bytes(statement.get());
+        return total;
+    }
+    if (auto* branch = dynamic_cast<const IfStmt*>(node)) {
+        return literal_bytes(branch->condition.get()) + literal_bytes(branch->then_branch.get()) +
+               literal_bytes(branch->else_branch.get());
+    }
+    if (auto* loop = dynamic_cast<const WhileStmt*>(node)) {
+        return literal_bytes(loop->condition.get()) + literal_bytes(loop->body.get());
+    }
+    return 0;
+}
+
+const Value* constant(const ExprPtr& node) {
+    auto* literal = dynamic_cast<const LiteralExpr*>(node.get());
+    return literal ? &literal->value : nullptr;
+}
+
+// Residual programs are printed as source, which has no literal for
+// infinities or NaN; those stay computed at run time.
+bool representable(const Value& value) {
+    const double* number = std::get_if<double>(&value);
+    return !number || std::isfinite(*number);
+}
+
+// One statement for a branch or loop body. Bodies are statements, never a
+// bare `let`, so neither is their residual and a block changes no scoping.
+StmtPtr single(std::vector<StmtPtr> statements) {
+    if (statements.size() == 1) return std::move(statements[0]);
+    return std::make_unique<BlockStmt>(std::move(statements));
+}
+
+} // namespace
+
+void PartialEvaluator::define(const std::string& name, Value value) {
+    defines_[name] = value;
+    scopes_.front()[name] = std::move(value);
+}
+
+void PartialEvaluator::reset() {
+    scopes_.assign(1, Scope{});
+    conditional_ = 0;
+    fails_ = false;
+}
+
+void PartialEvaluator::run(std::vector<StmtPtr>& program, std::size_t first) {
+    std::vector<StmtPtr> residual;
+    for (std::size_t i = first; i < program.size(); ++i) {
+        if (fails_) {
+            residual.push_back(std::move(program[i]));
+        } else {
+            specialize(program[i].get(), residual);
+        }
+    }
+    program.resize(first);
+    for (auto& statement : residual) {
+        program.push_back(std::move(statement));
+    }
+}
+
+// The value of an operator on known operands, unless it is left to run
+// time: when it fails, has no literal, or makes too long a string.
+std::optional<Value> PartialEvaluator::fold(TokenType op, const Value& operand) {
+    try {
+        Value folded = apply_unary(to_unary_op(op), operand);
+        if (representable(folded)) return folded;
+    } catch (const RuntimeError&) {
+        if (conditional_ == 0) fails_ = true;
+    }
+    return std::nullopt;
+}
+
+std::optional<Value> PartialEvaluator::fold(TokenType op, const Value& left, const Value& right) {
+    auto* a = std::get_if<std::string>(&left);
+    auto* b = std::get_if<std::string>(&right);
+    if (op == TokenType::PLUS && a && b && a->size() + b->size() > max_literal_bytes) return std::nullopt;
+    try {
+        Value folded = apply_binary(to_binary_op(op), left, right);
+        if (representable(folded)) return folded;
+    } catch (const RuntimeError&) {
+        if (conditional_ == 0) fails_ = true;
+    }
+    return std::nullopt;
+}
+
+std::optional<Value> PartialEvaluator::lookup(const std::string& name) const {
+    if (fails_) return std::nullopt;
+    for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); ++scope) {
+        auto it = scope->find(name);
+        if (it != scope->end()) return it->second;
+    }
+    return std::nullopt;
+}
+
+void PartialEvaluator::assign(const std::string& name, std::optional<Value> value) {
+    for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); ++scope) {
+        auto it = scope->find(name);
+        if (it != scope->end()) {
+            it->second = std::move(value);
+            return;
+        }
+    }
+    scopes_.front()[name] = std::move(value);
+}
+
+void PartialEvaluator::forget(const std::unordered_set<std::string>& names) {
+    for (auto& scope : scopes_) {
+        for (const auto& name : names) {
+            auto it = scope.find(name);
+            if (it != scope.end()) it->second.reset();
+        }
+    }
+}
+
+// Keeps only the values `other`, the state at the end of another path,
+// agrees on.
+void PartialEvaluator::merge(const std::vector<Scope>& other) {
+    for (std::size_t i = 0; i < scopes_.size(); ++i) {
+        for (auto& [name, value] : scopes_[i]) {
+            auto it = other[i].find(name);
+            if (!value || it == other[i].end() || !it->second || !values_equal(*value, *it->second)) {
+                value.reset();
+            }
+        }
+    }
+}
+
+ExprPtr PartialEvaluator::specialize(const Expr* node) {
+    if (auto* literal = dynamic_cast<const LiteralExpr*>(node)) {
+        return std::make_unique<LiteralExpr>(literal->value);
+    }
+    if (auto* variable = dynamic_cast<const VariableExpr*>(node)) {
+        if (auto value = lookup(variable->name)) return std::make_unique<LiteralExpr>(*value);
+        return std::make_unique<VariableExpr>(variable->name);
+    }
+    if (auto* unary = dynamic_cast<const UnaryExpr*>(node)) {
+        ExprPtr right = specialize(unary->right.get());
+        const Value* operand = constant(right);
+        if (operand && !fails_) {
+            if (auto folded = fold(unary->op.type, *operand)) {
+                return std::make_unique<LiteralExpr>(std::move(*folded));
+            }
+        }
+        return std::make_unique<UnaryExpr>(unary->op, std::move(right));
+    }
+    if (auto* binary = dynamic_cast<const BinaryExpr*>(node)) {
+        ExprPtr left = specialize(binary->left.get());
+        ExprPtr right = specialize(binary->right.get());
+        const Value* a = constant(left);
+        const Value* b = constant(right);
+        if (a && b && !fails_) {
+            if (auto folded = fold(binary->op.type, *a, *b)) {
+                return std::make_unique<LiteralExpr>(std::move(*folded));
+            }
+        }
+        return std::make_unique<BinaryExpr>(std::move(left), binary->op, std::move(right));
+    }
+    if (auto* store = dynamic_cast<const AssignExpr*>(node)) {
+        ExprPtr value = specialize(store->value.get());
+        const Value* known = constant(value);
+        assign(store->name, known ? std::optional<Value>(*known) : std::nullopt);
+        return std::make_unique<AssignExpr>(store->name, std::move(value));
+    }
+    if (auto* call = dynamic_cast<const CallExpr*>(node)) {
+        std::vector<ExprPtr> arguments;
+        for (const auto& argument : call->arguments) arguments.push_back(specialize(argument.get()));
+        return std::make_unique<CallExpr>(call->builtin, std::move(arguments));
+    }
+    if (auto* error = dynamic_cast<const ErrorExpr*>(node)) {
+        return std::make_unique<ErrorExpr>(error->diagnostic);
+    }
+    throw RuntimeError("Partial evaluation runs before other passes.");
+}
+
+void PartialEvaluator::specialize(const Stmt* node, std::vector<StmtPtr>& out) {
+    if (auto* expression = dynamic_cast<const ExpressionStmt*>(node)) {
+        ExprPtr residual = specialize(expression->expression.get());
+        if (!constant(residual)) out.push_back(std::make_unique<ExpressionStmt>(std::move(residual)));
+    } else if (auto* print = dynamic_cast<const PrintStmt*>(node)) {
+        out.push_back(std::make_unique<PrintStmt>(specialize(print->expression.get())));
+    } else if (auto* let = dynamic_cast<const LetStmt*>(node)) {
+        ExprPtr initializer;
+        auto define = defines_.find(let->name);
+        if (scopes_.size() == 1 && define != defines_.end() && !fails_) {
+            initializer = std::make_unique<LiteralExpr>(define->second);
+        } else if (let->initializer) {
+            initializer = specialize(let->initializer.get());
+        } else {
+            initializer = std::make_unique<LiteralExpr>(Value{});
+        }
+        const Value* known = constant(initializer);
+        scopes_.back()[let->name] = known ? std::optional<Value>(*known) : std::nullopt;
+        out.push_back(std::make_unique<LetStmt>(let->name, std::move(initializer)));
+    } else if (auto* block = dynamic_cast<const BlockStmt*>(node)) {
+        std::vector<StmtPtr> statements;
+        scopes_.emplace_back();
+        for (const auto& statement : block->statements) {
+            specialize(statement.get(), statements);
+        }
+        scopes_.pop_back();
+        bool binds = false;
+        for (const auto& statement : statements) {
+            binds |= dynamic_cast<const LetStmt*>(statement.get()) != nullptr;
+        }
+        if (binds) {
+            out.push_back(std::make_unique<BlockStmt>(std::move(statements)));
+        } else {
+            // Without a `let` of its own the block scopes nothing.
+            for (auto& statement : statements) out.push_back(std::move(statement));
+        }
+    } else if (auto* branch = dynamic_cast<const IfStmt*>(node)) {
+        ExprPtr condition = specialize(branch->condition.get());
+        const Value* known = constant(condition);
+        if (known && !fails_) {
+            const Stmt* taken = is_truthy(*known) ? branch->then_branch.get() : branch->else_branch.get();
+            if (taken) specialize(taken, out);
+            return;
+        }
+        std::vector<Scope> entry = scopes_;
+        ++conditional_;
+        std::vector<StmtPtr> then_branch;
+        if (branch->then_branch) specialize(branch->then_branch.get(), then_branch);
+        std::swap(entry, scopes_);
+        std::vector<StmtPtr> else_branch;
+        if (branch->else_branch) specialize(branch->else_branch.get(), else_branch);
+        --conditional_;
+        merge(entry);
+        StmtPtr otherwise = else_branch.empty() ? nullptr : single(std::move(else_branch));
+        out.push_back(std::make_unique<IfStmt>(std::move(condition), single(std::move(then_branch)),
+                                               std::move(otherwise)));
+    } else if (auto* loop = dynamic_cast<const WhileStmt*>(node)) {
+        if (!unroll(*loop, out)) specialize_loop(*loop, out);
+    } else if (auto* error = dynamic_cast<const ErrorStmt*>(node)) {
+        out.push_back(std::make_unique<ErrorStmt>(error->diagnostic));
+    } else {
+        throw RuntimeError("Partial evaluation runs before other passes.");
+    }
+}
+
+// A loop left in the residual program: nothing it may assign is known at
+// its head, on any iteration, or after it.
+void PartialEvaluator::specialize_loop(const WhileStmt& loop, std::vector<StmtPtr>& out) {
+    std::unordered_set<std::string> names;
+    assigned(loop.condition.get(), names);
+    assigned(loop.body.get(), names);
+    forget(names);
+
+    std::vector<Scope> head = scopes_;
+    ExprPtr condition = specialize(loop.condition.get());
+    const Value* known = constant(condition);
+    if (known && !is_truthy(*known)) return;
+    std::vector<StmtPtr> body;
+    ++conditional_;
+    specialize(loop.body.get(), body);
+    --conditional_;
+    scopes_ = std::move(head);
+    out.push_back(std::make_unique<WhileStmt>(std::move(condition), single(std::move(body))));
+}
+
+// Runs the loop at specialization time while its condition is known,
+// emitting each iteration's residual body. Fails, changing nothing, if the
+// condition becomes unknown or the residual code outgrows max_unrolled or
+// max_unrolled_bytes. An iteration that fails is followed by the loop as
+// written.
+bool PartialEvaluator::unroll(const WhileStmt& loop, std::vector<StmtPtr>& out) {
+    if (fails_ || has_assignment(loop.condition.get())) return false;
+
+    std::vector<Scope> entry = scopes_;
+    std::vector<StmtPtr> iterations;
+    std::size_t total = 0;
+    std::size_t bytes = 0;
+    for (std::size_t count = 0; count <= max_unrolled; ++count) {
+        ExprPtr condition = specialize(loop.condition.get());
+        const Value* known = constant(condition);
+        if (!known) break;
+        if (!is_truthy(*known)) {
+            for (auto& statement : iterations) out.push_back(std::move(statement));
+            return true;
+        }
+        std::size_t first = iterations.size();
+        specialize(loop.body.get(), iterations);
+        if (fails_) {
+            for (auto& statement : iterations) out.push_back(std::move(statement));
+            specialize_loop(loop, out);
+            return true;
+        }
+        for (std::size_t i = first; i < iterations.size(); ++i) {
+            total += size(iterations[i].get());
+            bytes += literal_bytes(iterations[i].get());
+        }
+        if (total > max_unrolled || bytes > max_unrolled_bytes) break;
+    }
+    scopes_ = std::move(entry);
+    return false;
+}
+
+} // namespace tl
@@ -0,0 +1,404 @@
+#include "tl/reg.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+
+namespace tl {
+
+namespace {
+
+// While compiling, operands are tagged with the kind of register they name;
+// physical numbers are only known once temporaries are allocated.
+constexpr std::uint32_t kind_mask = 3u << 30;
+constexpr std::uint32_t local_kind = 0;
+constexpr std::uint32_t temp_kind = 1u << 30;
+constexpr std::uint32_t constant_kind = 2u << 30;
+constexpr std::uint32_t no_target = ~0u;
+
+// Which of an instruction's fields are registers it writes and reads.
+struct Roles {
+    bool writes_a;
+    bool reads_a;
+    bool reads_b;
+    bool reads_c;
+};
+
+Roles roles(RegOpcode opcode) {
+    switch (opcode) {
+        case RegOpcode::MOVE:
+        case RegOpcode::NEGATE:
+        case RegOpcode::NOT:
+            return {true, false, true, false};
+        case RegOpcode::LOAD_GLOBAL:
+        case RegOpcode::CALL:
+            return {true, false, false, false};
+        case RegOpcode::CALL_ARGUMENT:
+            return {true, false, true, false};
+        case RegOpcode::STORE_GLOBAL:
+        case RegOpcode::DEFINE_GLOBAL:
+            return {false, false, true, false};
+        case RegOpcode::PRINT:
+        case RegOpcode::JUMP_IF_FALSE:
+            return {false, true, false, false};
+        case RegOpcode::JUMP:
+        case RegOpcode::RETURN:
+            return {false, false, false, false};
+        default:
+            return {true, false, true, true};
+    }
+}
+
+bool has_assignment(const Expr* node) {
+    if (dynamic_cast<const AssignExpr*>(node)) return true;
+    if (auto* unary = dynamic_cast<const UnaryExpr*>(node)) return has_assignment(unary->right.get());
+    if (auto* binary = dynamic_cast<const BinaryExpr*>(node)) {
+        return has_assignment(binary->left.get()) || has_assignment(binary->right.get());
+    }
+    if (auto* store = dynamic_cast<const TempStoreExpr*>(node)) return has_assignment(store->value.get());
+    if (auto* call = dynamic_cast<const CallExpr*>(node)) {
+        for (const auto& argument : call->arguments) {
+            if (has_assignment(argument.get())) return true;
+        }
+    }
+    return false;
+}
+
+class RegCompiler {
+public:
+    explicit RegCompiler(std::uint32_t frame_size) : frame_size_(frame_size) {}
+
+    RegProgram finish(const std::vector<StmtPtr>& program) {
+        for (const auto& statement : program) {
+            stmt(statement.get());
+        }
+        emit(RegOpcode::RETURN);
+        allocate();
+        return std::move(program_);
+    }
+
+private:
+    RegProgram program_;
+    std::uint32_t frame_size_;
+    std::unordered_map<std::string, std::uint32_t> global_names_;
+    // Register holding each common subexpression's value, by TempStoreExpr slot.
+    std::vector<std::uint32_t> cse_registers_;
+
+    // Live interval of every temporary, in instruction positions.
+    std::vector<std::size_t> starts_;
+    std::vector<std::size_t> ends_;
+    // [first, last] instruction of every loop, inner loops first.
+    std::vector<std::pair<std::size_t, std::size_t>> loops_;
+
+    std::size_t emit(RegOpcode opcode, std::uint32_t a = 0, std::uint32_t b = 0, std::uint32_t c = 0) {
+        program_.instructions.push_back(RegInstruction{opcode, a, b, c});
+        return program_.instructions.size() - 1;
+    }
+
+    std::uint32_t temp() {
+        starts_.push_back(0);
+        ends_.push_back(0);
+        return temp_kind | static_cast<std::uint32_t>(starts_.size() - 1);
+    }
+
+    std::uint32_t constant(Value value) {
+        program_.constants.push_back(std::move(value));
+        return constant_kind | static_cast<std::uint32_t>(program_.constants.size() - 1);
+    }
+
+    std::uint32_t global(const std::string& name) {
+        auto [it, inserted] = global_names_.emplace(name, static_cast<std::uint32_t>(program_.globals.size()));
+        if (inserted) program_.globals.push_back(name);
+        return it->second;
+    }
+
+    // The register to compute into: `target` if the caller has one.
+    std::uint32_t destination(std::uint32_t target) {
+        return target != no_target ? target : temp();
+    }
+
+    // Makes `value` the result in `target`, if the caller has one.
+    std::uint32_t into(std::uint32_t target, std::uint32_t value) {
+        if (target == no_target || target == value) return value;
+        emit(RegOpcode::MOVE, target, value);
+        return target;
+    }
+
+    std::uint32_t expr(const Expr* node, std::uint32_t target = no_target) {
+        if (auto* literal = dynamic_cast<const LiteralExpr*>(node)) {
+            return into(target, constant(literal->value));
+        }
+        if (auto* variable = dynamic_cast<const VariableExpr*>(node)) {
+            if (variable->slot != no_frame_slot) return into(target, local_kind | variable->slot);
+            std::uint32_t result = destination(target);
+            emit(RegOpcode::LOAD_GLOBAL, result, global(variable->name));
+            return result;
+        }
+        if (auto* unary = dynamic_cast<const UnaryExpr*>(node)) {
+            std::uint32_t right = expr(unary->right.get());
+            std::uint32_t result = destination(target);
+            emit(to_unary_op(unary->op.type) == UnaryOp::NEGATE ? RegOpcode::NEGATE : RegOpcode::NOT, result, right);
+            return result;
+        }
+        if (auto* binary = dynamic_cast<const BinaryExpr*>(node)) {
+            std::uint32_t left = expr(binary->left.get());
+            // A local operand is read in place, so it must not change before
+            // the operator runs.
+            if ((left & kind_mask) == local_kind && has_assignment(binary->right.get())) {
+                std::uint32_t copy = temp();
+                emit(RegOpcode::MOVE, copy, left);
+                left = copy;
+            }
+            std::uint32_t right = expr(binary->right.get());
+            std::uint32_t result = destination(target);
+            auto op = static_cast<std::uint8_t>(to_binary_op(binary->op.type));
+            emit(static_cast<RegOpcode>(static_cast<std::uint8_t>(RegOpcode::ADD) + op), result, left, right);
+            return result;
+        }
+        if (auto* assign = dynamic_cast<const AssignExpr*>(node)) {
+            if (assign->slot != no_frame_slot) {
+                std::uint32_t local = local_kind | assign->slot;
+                into(local, expr(assign->value.get(), local));
+                return into(target, local);
+            }
+            std::uint32_t value = expr(assign->value.get());
+            emit(RegOpcode::STORE_GLOBAL, global(assign->name), value);
+            return into(target, value);
+        }
+        if (auto* call = dynamic_cast<const CallExpr*>(node)) {
+            static_assert(max_builtin_arguments == 1, "CALL_ARGUMENT passes a single argument");
+            auto builtin = static_cast<std::uint32_t>(call->builtin);
+            std::uint32_t argument = call->arguments.empty() ? 0 : expr(call->arguments[0].get());
+            std::uint32_t result = destination(target);
+            if (call->arguments.empty()) {
+                emit(RegOpcode::CALL, result, builtin);
+            } else {
+                emit(RegOpcode::CALL_ARGUMENT, result, argument, builtin);
+            }
+            return result;
+        }
+        if (auto* store = dynamic_cast<const TempStoreExpr*>(node)) {
+            // Its own register: loads expect the value as of the store.
+            std::uint32_t value = expr(store->value.get(), temp());
+            if (store->slot >= cse_registers_.size()) cse_registers_.resize(store->slot + 1);
+            cse_registers_[store->slot] = value;
+            return into(target, value);
+        }
+        if (auto* load = dynamic_cast<const TempLoadExpr*>(node)) {
+            return into(target, cse_registers_[load->slot]);
+        }
+        throw RuntimeError("Cannot evaluate an expression with syntax errors.");
+    }
+
+    void patch(std::size_t jump, std::size_t target) {
+        RegInstruction& instruction = program_.instructions[jump];
+        (instruction.opcode == RegOpcode::JUMP ? instruction.a : instruction.b) = static_cast<std::uint32_t>(target);
+    }
+
+    void stmt(const Stmt* node) {
+        if (!node) return;
+
+        if (auto* expression = dynamic_cast<const ExpressionStmt*>(node)) {
+            expr(expression->expression.get());
+        } else if (auto* print = dynamic_cast<const PrintStmt*>(node)) {
+            emit(RegOpcode::PRINT, expr(print->expression.get()));
+        } else if (auto* let = dynamic_cast<const LetStmt*>(node)) {
+            if (let->slot != no_frame_slot) {
+                std::uint32_t local = local_kind | let->slot;
+                into(local, let->initializer ? expr(let->initializer.get(), local) : constant(Value{}));
+            } else {
+                std::uint32_t value = let->initializer ? expr(let->initializer.get()) : constant(Value{});
+                emit(RegOpcode::DEFINE_GLOBAL, global(let->name), value);
+            }
+        } else if (auto* block = dynamic_cast<const BlockStmt*>(node)) {
+            for (const auto& statement : block->statements) {
+                stmt(statement.get());
+            }
+        } else if (auto* branch = dynamic_cast<const IfStmt*>(node)) {
+            std::size_t skip_then = emit(RegOpcode::JUMP_IF_FALSE, expr(branch->condition.get()));
+            stmt(branch->then_branch.get());
+            if (branch->else_branch) {
+                std::size_t skip_else = emit(RegOpcode::JUMP);
+                patch(skip_then, program_.instructions.size());
+                stmt(branch->else_branch.get());
+                patch(skip_else, program_.instructions.size());
+            } else {
+                patch(skip_then, program_.instructions.size());
+            }
+        } else if (auto* loop = dynamic_cast<const WhileStmt*>(node)) {
+            std::size_t start = program_.instructions.size();
+            std::size_t exit = emit(RegOpcode::JUMP_IF_FALSE, expr(loop->condition.get()));
+            stmt(loop->body.get());
+            std::size_t back = emit(RegOpcode::JUMP, static_cast<std::uint32_t>(start));
+            patch(exit, program_.instructions.size());
+            loops_.emplace_back(start, back);
+        } else {
+            throw RuntimeError("Cannot execute a statement with syntax errors.");
+        }
+    }
+
+    // Linear-scan allocation of temporaries to registers, then rewriting of
+    // every operand to its physical register.
+    void allocate() {
+        auto& instructions = program_.instructions;
+        for (std::size_t position = 0; position < instructions.size(); ++position) {
+            const RegInstruction& instruction = instructions[position];
+            Roles role = roles(instruction.opcode);
+            auto use = [&](std::uint32_t operand) {
+                if ((operand & kind_mask) == temp_kind) ends_[operand & ~kind_mask] = position;
+            };
+            if (role.reads_a) use(instruction.a);
+            if (role.reads_b) use(instruction.b);
+            if (role.reads_c) use(instruction.c);
+            if (role.writes_a && (instruction.a & kind_mask) == temp_kind) {
+                std::uint32_t id = instruction.a & ~kind_mask;
+                starts_[id] = position;
+                ends_[id] = std::max(ends_[id], position);
+            }
+        }
+        // A temporary live into a loop from outside stays live for all of it.
+        for (auto [first, last] : loops_) {
+            for (std::size_t id = 0; id < starts_.size(); ++id) {
+                if (starts_[id] < first && ends_[id] >= first && ends_[id] < last) ends_[id] = last;
+            }
+        }
+
+        std::vector<std::uint32_t> order(starts_.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+                         [this](std::uint32_t a, std::uint32_t b) { return starts_[a] < starts_[b]; });
+
+        std::vector<std::uint32_t> physical(starts_.size());
+        std::vector<std::uint32_t> active;
+        std::vector<std::uint32_t> free;
+        std::uint32_t count = 0;
+        for (std::uint32_t id : order) {
+            // An instruction reads its operands before writing its result,
+            // so a register can be reused by the instruction that last reads it.
+            auto expired = std::partition(active.begin(), active.end(),
+                                          [&](std::uint32_t other) { return ends_[other] > starts_[id]; });
+            for (auto it = expired; it != active.end(); ++it) free.push_back(physical[*it]);
+            active.erase(expired, active.end());
+
+            if (free.empty()) {
+                physical[id] = frame_size_ + count++;
+            } else {
+                physical[id] = free.back();
+                free.pop_back();
+            }
+            active.push_back(id);
+        }
+
+        program_.constant_base = frame_size_ + count;
+        program_.register_count = program_.constant_base + static_cast<std::uint32_t>(program_.constants.size());
+        program_.global_caches.resize(program_.globals.size());
+
+        auto place = [&](std::uint32_t& operand) {
+            std::uint32_t index = operand & ~kind_mask;
+            switch (operand & kind_mask) {
+                case temp_kind: operand = physical[index]; break;
+                case constant_kind: operand = program_.constant_base + index; break;
+                default: break;
+            }
+        };
+        for (RegInstruction& instruction : instructions) {
+            Roles role = roles(instruction.opcode);
+            if (role.writes_a || role.reads_a) place(instruction.a);
+            if (role.reads_b) place(instruction.b);
+            if (role.reads_c) place(instruction.c);
+        }
+    }
+};
+
+} // namespace
+
+RegProgram compile_registers(const std::vector<StmtPtr>& program, std::uint32_t frame_size) {
+    return RegCompiler(frame_size).finish(program);
+}
+
+namespace {
+
+const char* opcode_name(RegOpcode opcode) {
+    switch (opcode) {
+        case RegOpcode::MOVE: return "move";
+        case RegOpcode::NEGATE: return "neg";
+        case RegOpcode::NOT: return "not";
+        case RegOpcode::ADD: return "add";
+        case RegOpcode::SUBTRACT: return "sub";
+        case RegOpcode::MULTIPLY: return "mul";
+        case RegOpcode::DIVIDE: return "div";
+        case RegOpcode::GREATER: return "gt";
+        case RegOpcode::GREATER_EQUAL: return "ge";
+        case RegOpcode::LESS: return "lt";
+        case RegOpcode::LESS_EQUAL: return "le";
+        case RegOpcode::EQUAL: return "eq";
+        case RegOpcode::NOT_EQUAL: return "ne";
+        case RegOpcode::AND: return "and";
+        case RegOpcode::OR: return "or";
+        case RegOpcode::LOAD_GLOBAL: return "load_global";
+        case RegOpcode::STORE_GLOBAL: return "store_global";
+        case RegOpcode::DEFINE_GLOBAL: return "define_global";
+        case RegOpcode::PRINT: return "print";
+        case RegOpcode::CALL:
+        case RegOpcode::CALL_ARGUMENT: return "call";
+        case RegOpcode::JUMP: return "jump";
+        case RegOpcode::JUMP_IF_FALSE: return "jump_if_false";
+        case RegOpcode::RETURN: return "return";
+    }
+    return "?";
+}
+
+} // namespace
+
+std::string to_string(const RegProgram& program) {
+    std::ostringstream out;
+    // Constants print as their values.
+    auto reg = [&](std::uint32_t index) {
+        if (index < program.constant_base) return "r" + std::to_string(index);
+        const Value& value = program.constants[index - program.constant_base];
+        if (auto* text = std::get_if<std::string>(&value)) return '"' + *text + '"';
+        return to_string(value);
+    };
+
+    for (std::size_t position = 0; position < program.instructions.size(); ++position) {
+        const RegInstruction& instruction = program.instructions[position];
+        out << "  " << position << ": " << opcode_name(instruction.opcode);
+        switch (instruction.opcode) {
+            case RegOpcode::LOAD_GLOBAL:
+                out << " " << reg(instruction.a) << ", " << program.globals[instruction.b];
+                break;
+            case RegOpcode::STORE_GLOBAL:
+            case RegOpcode::DEFINE_GLOBAL:
+                out << " " << program.globals[instruction.a] << ", " << reg(instruction.b);
+                break;
+            case RegOpcode::PRINT:
+                out << " " << reg(instruction.a);
+                break;
+            case RegOpcode::CALL:
+                out << " " << reg(instruction.a) << ", " << builtin_info(static_cast<Builtin>(instruction.b)).name;
+                break;
+            case RegOpcode::CALL_ARGUMENT:
+                out << " " << reg(instruction.a) << ", " << builtin_info(static_cast<Builtin>(instruction.c)).name
+                    << ", " << reg(instruction.b);
+                break;
+            case RegOpcode::JUMP:
+                out << " " << instruction.a;
+                break;
+            case RegOpcode::JUMP_IF_FALSE:
+                out << " " << reg(instruction.a) << ", " << instruction.b;
+                break;
+            case RegOpcode::RETURN:
+                break;
+            default: {
+                Roles role = roles(instruction.opcode);
+                out << " " << reg(instruction.a) << ", " << reg(instruction.b);
+                if (role.reads_c) out << ", " << reg(instruction.c);
+                break;
+            }
+        }
+        out << "\n";
+    }
+    return out.str();
+}
+
+} // namespace tl
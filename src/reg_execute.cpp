@@ -0,0 +1,131 @@
+#include "tl/reg.hpp"
+
+#include "tl/jit.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+namespace tl {
+
+namespace {
+
+Value* find_global(RegProgram& program, std::unordered_map<std::string, Value>& globals,
+                   std::uint64_t globals_version, std::uint32_t index) {
+    GlobalCache& cache = program.global_caches[index];
+    if (cache.version != globals_version) {
+        auto it = globals.find(program.globals[index]);
+        cache.value = it != globals.end() ? &it->second : nullptr;
+        cache.version = globals_version;
+    }
+    if (!cache.value) {
+        throw RuntimeError("Undefined variable '" + program.globals[index] + "'.");
+    }
+    return cache.value;
+}
+
+} // namespace
+
+void execute(RegProgram& program, std::vector<Value>& registers,
+             std::unordered_map<std::string, Value>& globals, std::uint64_t& globals_version, bool jit) {
+    if (registers.size() < program.register_count) {
+        registers.resize(program.register_count);
+    }
+    std::copy(program.constants.begin(), program.constants.end(), registers.begin() + program.constant_base);
+
+    Value* r = registers.data();
+    const RegInstruction* code = program.instructions.data();
+    std::unique_ptr<TraceJit> tracer;
+    if (jit && jit_supported()) tracer = std::make_unique<TraceJit>(program);
+
+    for (std::size_t pc = 0;;) {
+        if (tracer && tracer->recording()) tracer->record(static_cast<std::uint32_t>(pc), r, globals);
+        const RegInstruction& instruction = code[pc++];
+        const double* left = nullptr;
+        const double* right = nullptr;
+        // Numbers go straight through; anything else, including division by
+        // zero, takes apply_binary for its result or error.
+        auto numbers = [&]() {
+            left = std::get_if<double>(&r[instruction.b]);
+            right = std::get_if<double>(&r[instruction.c]);
+            return left && right;
+        };
+        auto slow = [&]() {
+            auto op = static_cast<std::uint8_t>(instruction.opcode) - static_cast<std::uint8_t>(RegOpcode::ADD);
+            r[instruction.a] = apply_binary(static_cast<BinaryOp>(op), r[instruction.b], r[instruction.c]);
+        };
+
+        switch (instruction.opcode) {
+            case RegOpcode::MOVE:
+                r[instruction.a] = r[instruction.b];
+                break;
+            case RegOpcode::NEGATE:
+                r[instruction.a] = apply_unary(UnaryOp::NEGATE, r[instruction.b]);
+                break;
+            case RegOpcode::NOT:
+                r[instruction.a] = !is_truthy(r[instruction.b]);
+                break;
+            case RegOpcode::ADD:
+                if (numbers()) r[instruction.a] = *left + *right; else slow();
+                break;
+            case RegOpcode::SUBTRACT:
+                if (numbers()) r[instruction.a] = *left - *right; else slow();
+                break;
+            case RegOpcode::MULTIPLY:
+                if (numbers()) r[instruction.a] = *left * *right; else slow();
+                break;
+            case RegOpcode::DIVIDE:
+                if (numbers() && *right != 0.0) r[instruction.a] = *left / *right; else slow();
+                break;
+            case RegOpcode::GREATER:
+                if (numbers()) r[instruction.a] = *left > *right; else slow();
+                break;
+            case RegOpcode::GREATER_EQUAL:
+                if (numbers()) r[instruction.a] = *left >= *right; else slow();
+                break;
+            case RegOpcode::LESS:
+                if (numbers()) r[instruction.a] = *left < *right; else slow();
+                break;
+            case RegOpcode::LESS_EQUAL:
+                if (numbers()) r[instruction.a] = *left <= *right; else slow();
+                break;
+            case RegOpcode::EQUAL:
+            case RegOpcode::NOT_EQUAL:
+            case RegOpcode::AND:
+            case RegOpcode::OR:
+                slow();
+                break;
+            case RegOpcode::LOAD_GLOBAL:
+                r[instruction.a] = *find_global(program, globals, globals_version, instruction.b);
+                break;
+            case RegOpcode::STORE_GLOBAL:
+                *find_global(program, globals, globals_version, instruction.a) = r[instruction.b];
+                break;
+            case RegOpcode::DEFINE_GLOBAL: {
+                auto [it, inserted] = globals.try_emplace(program.globals[instruction.a]);
+                if (inserted) ++globals_version;
+                it->second = r[instruction.b];
+                break;
+            }
+            case RegOpcode::PRINT:
+                write_value(std::cout, r[instruction.a]) << '\n';
+                break;
+            case RegOpcode::CALL:
+                r[instruction.a] = call_builtin(static_cast<Builtin>(instruction.b), nullptr, 0);
+                break;
+            case RegOpcode::CALL_ARGUMENT:
+                r[instruction.a] = call_builtin(static_cast<Builtin>(instruction.c), &r[instruction.b], 1);
+                break;
+            case RegOpcode::JUMP:
+                pc = tracer && instruction.a < pc ? tracer->back_edge(instruction.a, r) : instruction.a;
+                break;
+            case RegOpcode::JUMP_IF_FALSE:
+                if (!is_truthy(r[instruction.a])) pc = instruction.b;
+                break;
+            case RegOpcode::RETURN:
+                return;
+        }
+    }
+}
+
+} // namespace tl
@@ -0,0 +1,77 @@
+#include "tl/resolver.hpp"
+
+#include <algorithm>
+
+namespace tl {
+
+std::uint32_t Resolver::run(std::vector<StmtPtr>& program) {
+    scopes_.clear();
+    next_slot_ = 0;
+    frame_size_ = 0;
+    for (auto& statement : program) {
+        // Outside blocks every name is global, which is what nodes start as.
+        Stmt* node = statement.get();
+        if (dynamic_cast<BlockStmt*>(node) || dynamic_cast<IfStmt*>(node) || dynamic_cast<WhileStmt*>(node)) {
+            resolve(node);
+        }
+    }
+    return frame_size_;
+}
+
+std::uint32_t Resolver::lookup(const std::string& name) const {
+    for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); ++scope) {
+        auto it = scope->find(name);
+        if (it != scope->end()) return it->second;
+    }
+    return no_frame_slot;
+}
+
+void Resolver::resolve(Expr* node) {
+    if (auto* variable = dynamic_cast<VariableExpr*>(node)) {
+        variable->slot = lookup(variable->name);
+    } else if (auto* unary = dynamic_cast<UnaryExpr*>(node)) {
+        resolve(unary->right.get());
+    } else if (auto* binary = dynamic_cast<BinaryExpr*>(node)) {
+        resolve(binary->left.get());
+        resolve(binary->right.get());
+    } else if (auto* assign = dynamic_cast<AssignExpr*>(node)) {
+        resolve(assign->value.get());
+        assign->slot = lookup(assign->name);
+    } else if (auto* call = dynamic_cast<CallExpr*>(node)) {
+        for (auto& argument : call->arguments) resolve(argument.get());
+    } else if (auto* store = dynamic_cast<TempStoreExpr*>(node)) {
+        resolve(store->value.get());
+    }
+}
+
+void Resolver::resolve(Stmt* node) {
+    if (auto* expression = dynamic_cast<ExpressionStmt*>(node)) {
+        resolve(expression->expression.get());
+    } else if (auto* print = dynamic_cast<PrintStmt*>(node)) {
+        resolve(print->expression.get());
+    } else if (auto* let = dynamic_cast<LetStmt*>(node)) {
+        resolve(let->initializer.get());
+        if (!scopes_.empty()) {
+            let->slot = next_slot_++;
+            frame_size_ = std::max(frame_size_, next_slot_);
+            scopes_.back()[let->name] = let->slot;
+        }
+    } else if (auto* block = dynamic_cast<BlockStmt*>(node)) {
+        std::uint32_t first_slot = next_slot_;
+        scopes_.emplace_back();
+        for (auto& statement : block->statements) {
+            resolve(statement.get());
+        }
+        scopes_.pop_back();
+        next_slot_ = first_slot;
+    } else if (auto* branch = dynamic_cast<IfStmt*>(node)) {
+        resolve(branch->condition.get());
+        resolve(branch->then_branch.get());
+        resolve(branch->else_branch.get());
+    } else if (auto* loop = dynamic_cast<WhileStmt*>(node)) {
+        resolve(loop->condition.get());
+        resolve(loop->body.get());
+    }
+}
+
+} // namespace tl
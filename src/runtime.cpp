@@ -0,0 +1,33 @@
+#include "tl/runtime.hpp"
+
+#include <iostream>
+
+namespace tl {
+
+void Global::undefined() const {
+    throw RuntimeError("Undefined variable '" + std::string(name_) + "'.");
+}
+
+void print(const Value& value) {
+    // Flushed before errors are reported and at exit, so there is no need
+    // to flush every line.
+    write_value(std::cout, value) << '\n';
+}
+
+int run_compiled(void (*program)()) {
+    try {
+        program();
+        std::cout.flush();
+        return 0;
+    } catch (const RuntimeError& error) {
+        std::cout.flush();
+        std::cerr << "[runtime error] " << error.what() << std::endl;
+        return 1;
+    } catch (const std::exception& error) {
+        std::cout.flush();
+        std::cerr << "[error] " << error.what() << std::endl;
+        return 1;
+    }
+}
+
+} // namespace tl
@@ -0,0 +1,224 @@
+#include "tl/token_buffer.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace tl {
+
+TokenBuffer::TokenBuffer(const std::vector<Token>& tokens) {
+    types_.reserve(tokens.size());
+    offsets_.reserve(tokens.size());
+    lengths_.reserve(tokens.size());
+    for (const auto& token : tokens) {
+        append(token);
+    }
+}
+
+std::size_t TokenBuffer::size() const {
+    return types_.size();
+}
+
+bool TokenBuffer::empty() const {
+    return types_.empty();
+}
+
+TokenType TokenBuffer::type(std::size_t index) const {
+    return static_cast<TokenType>(types_[index]);
+}
+
+std::string_view TokenBuffer::lexeme(std::size_t index) const {
+    return std::string_view(text_).substr(offsets_[index], lengths_[index]);
+}
+
+const TokenBuffer::LineRun& TokenBuffer::run(std::size_t index) const {
+    auto it = std::upper_bound(lines_.begin(), lines_.end(), index,
+                               [](std::size_t value, const LineRun& entry) {
+                                   return value < entry.first_token;
+                               });
+    return *std::prev(it);
+}
+
+int TokenBuffer::line(std::size_t index) const {
+    return run(index).line;
+}
+
+int TokenBuffer::column(std::size_t index) const {
+    return static_cast<int>(offsets_[index] - run(index).line_start);
+}
+
+double TokenBuffer::number(std::size_t index) const {
+    auto it = std::lower_bound(number_tokens_.begin(), number_tokens_.end(), index);
+    return numbers_[static_cast<std::size_t>(it - number_tokens_.begin())];
+}
+
+std::string_view TokenBuffer::string_value(std::size_t index) const {
+    std::string_view text = lexeme(index);
+    return text.substr(1, text.size() - 2);
+}
+
+Token TokenBuffer::token(std::size_t index) const {
+    Literal literal;
+    if (type(index) == TokenType::NUMBER) {
+        literal = number(index);
+    } else if (type(index) == TokenType::STRING) {
+        literal = std::string(string_value(index));
+    }
+    return Token(type(index), std::string(lexeme(index)), std::move(literal), line(index), column(index));
+}
+
+void TokenBuffer::push(TokenType type, std::size_t offset, std::size_t length, int line, int column,
+                       double number) {
+    constexpr auto limit = std::numeric_limits<std::uint32_t>::max();
+    if (offset > limit || length > limit - offset || size() >= limit) {
+        throw std::length_error("Source too large for a token buffer.");
+    }
+
+    auto index = static_cast<std::uint32_t>(size());
+    std::int64_t line_start = static_cast<std::int64_t>(offset) - column;
+    if (lines_.empty() || lines_.back().line != line || lines_.back().line_start != line_start) {
+        lines_.push_back(LineRun{index, line, line_start});
+    }
+    if (type == TokenType::NUMBER) {
+        number_tokens_.push_back(index);
+        numbers_.push_back(number);
+    }
+    types_.push_back(static_cast<std::uint8_t>(type));
+    offsets_.push_back(static_cast<std::uint32_t>(offset));
+    lengths_.push_back(static_cast<std::uint32_t>(length));
+}
+
+void TokenBuffer::append(const Token& token) {
+    std::size_t offset = text_.size();
+    text_ += token.lexeme;
+    double value = token.type == TokenType::NUMBER ? std::get<double>(token.literal) : 0.0;
+    push(token.type, offset, text_.size() - offset, token.line, token.column, value);
+}
+
+void TokenBuffer::splice(const TokenBuffer& part, std::size_t offset, int lines) {
+    if (part.empty()) return;
+    constexpr auto limit = std::numeric_limits<std::uint32_t>::max();
+    std::size_t text_end = static_cast<std::size_t>(part.offsets_.back()) + part.lengths_.back();
+    if (offset > limit - text_end || part.size() >= limit - size()) {
+        throw std::length_error("Source too large for a token buffer.");
+    }
+
+    auto base = static_cast<std::uint32_t>(size());
+    auto shift = static_cast<std::uint32_t>(offset);
+    types_.insert(types_.end(), part.types_.begin(), part.types_.end());
+    lengths_.insert(lengths_.end(), part.lengths_.begin(), part.lengths_.end());
+    offsets_.reserve(offsets_.size() + part.size());
+    for (std::uint32_t value : part.offsets_) {
+        offsets_.push_back(value + shift);
+    }
+    for (const LineRun& entry : part.lines_) {
+        LineRun moved{entry.first_token + base, entry.line + lines,
+                      entry.line_start + static_cast<std::int64_t>(offset)};
+        if (!lines_.empty() && lines_.back().line == moved.line && lines_.back().line_start == moved.line_start) {
+            continue;
+        }
+        lines_.push_back(moved);
+    }
+    for (std::uint32_t index : part.number_tokens_) {
+        number_tokens_.push_back(index + base);
+    }
+    numbers_.insert(numbers_.end(), part.numbers_.begin(), part.numbers_.end());
+}
+
+void TokenBuffer::discard(std::size_t count) {
+    if (count == 0) return;
+    count = std::min(count, size());
+    auto shift = static_cast<std::uint32_t>(count);
+
+    // Text is only reclaimed up to the first surviving lexeme.
+    std::uint32_t text_shift = count < size() ? offsets_[count] : static_cast<std::uint32_t>(text_.size());
+    text_.erase(0, text_shift);
+
+    auto drop = [count](auto& items) {
+        items.erase(items.begin(), items.begin() + static_cast<std::ptrdiff_t>(count));
+    };
+    drop(types_);
+    drop(offsets_);
+    drop(lengths_);
+    for (auto& offset : offsets_) {
+        offset -= text_shift;
+    }
+
+    auto run = std::upper_bound(lines_.begin(), lines_.end(), shift,
+                                [](std::uint32_t value, const LineRun& entry) {
+                                    return value < entry.first_token;
+                                });
+    lines_.erase(lines_.begin(), std::prev(run));
+    for (auto& entry : lines_) {
+        entry.first_token = entry.first_token > shift ? entry.first_token - shift : 0;
+        entry.line_start -= text_shift;
+    }
+
+    auto numbers = std::lower_bound(number_tokens_.begin(), number_tokens_.end(), shift);
+    std::ptrdiff_t dropped = numbers - number_tokens_.begin();
+    number_tokens_.erase(number_tokens_.begin(), numbers);
+    numbers_.erase(numbers_.begin(), numbers_.begin() + dropped);
+    for (auto& token : number_tokens_) {
+        token -= shift;
+    }
+}
+
+TokenBuffer TokenBuffer::slice(std::size_t begin, std::size_t end) const {
+    TokenBuffer out;
+    if (begin >= end) return out;
+
+    std::uint32_t text_begin = offsets_[begin];
+    std::uint32_t text_end = offsets_[end - 1] + lengths_[end - 1];
+    out.text_ = text_.substr(text_begin, text_end - text_begin);
+
+    auto first = static_cast<std::ptrdiff_t>(begin);
+    auto last = static_cast<std::ptrdiff_t>(end);
+    out.types_.assign(types_.begin() + first, types_.begin() + last);
+    out.lengths_.assign(lengths_.begin() + first, lengths_.begin() + last);
+    out.offsets_.reserve(end - begin);
+    for (std::size_t i = begin; i < end; ++i) {
+        out.offsets_.push_back(offsets_[i] - text_begin);
+    }
+
+    auto shift = static_cast<std::uint32_t>(begin);
+    auto run = std::prev(std::upper_bound(lines_.begin(), lines_.end(), shift,
+                                          [](std::uint32_t value, const LineRun& entry) {
+                                              return value < entry.first_token;
+                                          }));
+    for (; run != lines_.end() && run->first_token < end; ++run) {
+        out.lines_.push_back(LineRun{run->first_token > shift ? run->first_token - shift : 0, run->line,
+                                     run->line_start - text_begin});
+    }
+
+    auto numbers_begin = std::lower_bound(number_tokens_.begin(), number_tokens_.end(), shift);
+    auto numbers_end = std::lower_bound(numbers_begin, number_tokens_.end(), static_cast<std::uint32_t>(end));
+    for (auto it = numbers_begin; it != numbers_end; ++it) {
+        out.number_tokens_.push_back(*it - shift);
+        out.numbers_.push_back(numbers_[static_cast<std::size_t>(it - number_tokens_.begin())]);
+    }
+    return out;
+}
+
+void TokenBuffer::shrink_to_fit() {
+    types_.shrink_to_fit();
+    offsets_.shrink_to_fit();
+    lengths_.shrink_to_fit();
+    lines_.shrink_to_fit();
+    number_tokens_.shrink_to_fit();
+    numbers_.shrink_to_fit();
+}
+
+const std::string& TokenBuffer::text() const {
+    return text_;
+}
+
+std::size_t TokenBuffer::memory_usage() const {
+    return types_.capacity() * sizeof(std::uint8_t) +
+           offsets_.capacity() * sizeof(std::uint32_t) +
+           lengths_.capacity() * sizeof(std::uint32_t) +
+           lines_.capacity() * sizeof(LineRun) +
+           number_tokens_.capacity() * sizeof(std::uint32_t) +
+           numbers_.capacity() * sizeof(double);
+}
+
+} // namespace tl
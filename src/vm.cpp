@@ -1,23 +1,222 @@
 #include "tl/vm.hpp"
 
+#include "tl/ops.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
 
 namespace tl {
 
-VM::VM() = default;
+namespace {
+
+constexpr std::size_t ssa_batch_size = 256;
+
+// Integers up to this magnitude, and every sum of them that stays within
+// it, are exact doubles.
+constexpr std::int64_t exact_limit = std::int64_t{1} << 53;
+
+bool exact_integer(const Value& value, std::int64_t& out) {
+    const double* number = std::get_if<double>(&value);
+    if (!number || !(std::fabs(*number) <= static_cast<double>(exact_limit)) || std::trunc(*number) != *number ||
+        (*number == 0 && std::signbit(*number))) {
+        return false;
+    }
+    out = static_cast<std::int64_t>(*number);
+    return true;
+}
+
+// Whether the parser left an error node anywhere in `node`.
+bool has_syntax_error(const Expr* node) {
+    if (!node) return false;
+    if (dynamic_cast<const ErrorExpr*>(node)) return true;
+    if (auto* unary = dynamic_cast<const UnaryExpr*>(node)) return has_syntax_error(unary->right.get());
+    if (auto* binary = dynamic_cast<const BinaryExpr*>(node)) {
+        return has_syntax_error(binary->left.get()) || has_syntax_error(binary->right.get());
+    }
+    if (auto* assign = dynamic_cast<const AssignExpr*>(node)) return has_syntax_error(assign->value.get());
+    if (auto* call = dynamic_cast<const CallExpr*>(node)) {
+        for (const auto& argument : call->arguments) {
+            if (has_syntax_error(argument.get())) return true;
+        }
+    }
+    return false;
+}
+
+bool has_syntax_error(const Stmt* node) {
+    if (!node) return false;
+    if (dynamic_cast<const ErrorStmt*>(node)) return true;
+    if (auto* expression = dynamic_cast<const ExpressionStmt*>(node)) {
+        return has_syntax_error(expression->expression.get());
+    }
+    if (auto* print = dynamic_cast<const PrintStmt*>(node)) return has_syntax_error(print->expression.get());
+    if (auto* let = dynamic_cast<const LetStmt*>(node)) return has_syntax_error(let->initializer.get());
+    if (auto* block = dynamic_cast<const BlockStmt*>(node)) {
+        for (const auto& statement : block->statements) {
+            if (has_syntax_error(statement.get())) return true;
+        }
+        return false;
+    }
+    if (auto* branch = dynamic_cast<const IfStmt*>(node)) {
+        return has_syntax_error(branch->condition.get()) || has_syntax_error(branch->then_branch.get()) ||
+               has_syntax_error(branch->else_branch.get());
+    }
+    if (auto* loop = dynamic_cast<const WhileStmt*>(node)) {
+        return has_syntax_error(loop->condition.get()) || has_syntax_error(loop->body.get());
+    }
+    return false;
+}
+
+void report(const std::vector<Diagnostic>& diagnostics) {
+    for (const auto& diagnostic : diagnostics) {
+        std::cerr << "[compile error] " << to_string(diagnostic) << std::endl;
+    }
+}
+
+} // namespace
+
+VM::VM(Tier tier)
+    : tier_(tier), passes_(default_pipeline()) {}
+
+VM::~VM() {
+    set_async_output(false);
+}
+
+void VM::set_ir_dump(std::ostream* out) {
+    ir_dump_ = out;
+}
+
+void VM::set_dead_store_report(std::ostream* out) {
+    dead_store_report_ = out;
+}
+
+void VM::set_type_report(std::ostream* out) {
+    type_report_ = out;
+}
+
+void VM::set_superinstructions(bool enabled) {
+    superinstructions_ = enabled;
+}
+
+void VM::set_jit(bool enabled) {
+    jit_ = enabled;
+}
+
+void VM::set_async_output(bool enabled) {
+    if (enabled == static_cast<bool>(async_output_)) return;
+    if (enabled) {
+        async_output_ = std::make_unique<AsyncOutputBuffer>(std::cout.rdbuf());
+        std::cout.rdbuf(async_output_.get());
+    } else {
+        std::cout.rdbuf(async_output_->sink());
+        async_output_.reset();
+    }
+}
+
+void VM::define(const std::string& name, Value value) {
+    auto [global_it, inserted] = globals_.try_emplace(name);
+    if (inserted) ++globals_version_;
+    global_it->second = value;
+    partial_evaluator_.define(name, std::move(value));
+    specialize_ = true;
+}
+
+const PassManager& VM::passes() const {
+    return passes_;
+}
 
 InterpretResult VM::interpret(const std::string& source) {
     try {
         Lexer lexer(source);
-        auto tokens = lexer.tokenize();
-        Parser parser(std::move(tokens));
+        Parser parser(lexer.tokenize_compact());
         auto statements = parser.parse();
+        if (!parser.diagnostics().empty()) {
+            report(parser.diagnostics());
+            return InterpretResult::COMPILE_ERROR;
+        }
+        if (specialize_) {
+            partial_evaluator_.run(statements);
+        }
+        if (tier_ == Tier::SSA) {
+            execute_ssa(statements);
+            return InterpretResult::OK;
+        }
+        remove_dead_stores(statements);
+        eliminate_common_subexpressions(statements);
 
         execute(statements);
         return InterpretResult::OK;
-    } catch (const ParseError& error) {
-        std::cerr << "[compile error] " << error.what() << std::endl;
-        return InterpretResult::COMPILE_ERROR;
+    } catch (const RuntimeError& error) {
+        // What the partial evaluator assumed about the failed statement's
+        // stores may not have happened.
+        partial_evaluator_.reset();
+        std::cerr << "[runtime error] " << error.what() << std::endl;
+        return InterpretResult::RUNTIME_ERROR;
+    } catch (const std::exception& error) {
+        std::cerr << "[error] " << error.what() << std::endl;
+        return InterpretResult::RUNTIME_ERROR;
+    }
+}
+
+InterpretResult VM::interpret(std::istream& input) {
+    Lexer lexer(input);
+    return interpret_streaming(lexer);
+}
+
+InterpretResult VM::interpret_streaming(Lexer& lexer) {
+    try {
+        Parser parser(lexer);
+        std::vector<StmtPtr> statements;
+        while (parser.has_next()) {
+            StmtPtr statement = parser.next();
+            if (!parser.diagnostics().empty()) {
+                // Stop executing, but parse on so every error is reported.
+                execute_ssa(statements);
+                while (parser.has_next()) parser.next();
+                report(parser.diagnostics());
+                return InterpretResult::COMPILE_ERROR;
+            }
+            run(statements, std::move(statement));
+        }
+        execute_ssa(statements);
+        return InterpretResult::OK;
+    } catch (const RuntimeError& error) {
+        std::cerr << "[runtime error] " << error.what() << std::endl;
+        return InterpretResult::RUNTIME_ERROR;
+    } catch (const std::exception& error) {
+        std::cerr << "[error] " << error.what() << std::endl;
+        return InterpretResult::RUNTIME_ERROR;
+    }
+}
+
+InterpretResult VM::interpret_parallel(std::string source) {
+    try {
+        ThreadPool pool;
+        TokenBuffer tokens;
+        Lexer lexer(std::move(source));
+        try {
+            tokens = lexer.tokenize_parallel(pool);
+        } catch (const std::runtime_error&) {
+            // Streamed, the statements before the bad token still run.
+            Lexer streaming(lexer.release_source());
+            return interpret_streaming(streaming);
+        }
+        Parser parser(std::move(tokens));
+        std::vector<StmtPtr> statements;
+        for (StmtPtr& statement : parser.parse_parallel(pool)) {
+            // Every diagnostic leaves an error node in its statement. As
+            // when streaming, the statements before the first such one run.
+            if (has_syntax_error(statement.get())) {
+                execute_ssa(statements);
+                report(parser.diagnostics());
+                return InterpretResult::COMPILE_ERROR;
+            }
+            run(statements, std::move(statement));
+        }
+        execute_ssa(statements);
+        return InterpretResult::OK;
     } catch (const RuntimeError& error) {
         std::cerr << "[runtime error] " << error.what() << std::endl;
         return InterpretResult::RUNTIME_ERROR;
@@ -27,21 +226,36 @@ InterpretResult VM::interpret(const std::string& source) {
     }
 }
 
+// Specializes and runs the next top-level statement. The SSA tier compiles
+// statements in batches, which amortizes the pass pipeline and lets it
+// optimize across statements, so it only queues it in `statements`.
+void VM::run(std::vector<StmtPtr>& statements, StmtPtr statement) {
+    statements.push_back(std::move(statement));
+    if (specialize_) {
+        partial_evaluator_.run(statements, statements.size() - 1);
+    }
+    if (tier_ != Tier::SSA) {
+        remove_dead_stores(statements);
+        cse_.run(statements);
+        execute(statements);
+        statements.clear();
+    } else if (statements.size() >= ssa_batch_size) {
+        execute_ssa(statements);
+        statements.clear();
+    }
+}
+
 Value VM::visit_literal_expr(LiteralExpr& expr) {
     return expr.value;
 }
 
 Value VM::visit_variable_expr(VariableExpr& expr) {
-    for (auto scope_it = scopes_.rbegin(); scope_it != scopes_.rend(); ++scope_it) {
-        auto it = scope_it->find(expr.name);
-        if (it != scope_it->end()) {
-            return it->second;
-        }
+    if (expr.slot != no_frame_slot) {
+        return frame_[expr.slot];
     }
 
-    auto global_it = globals_.find(expr.name);
-    if (global_it != globals_.end()) {
-        return global_it->second;
+    if (Value* global = find_global(expr.name, expr.global)) {
+        return *global;
     }
 
     throw RuntimeError("Undefined variable '" + expr.name + "'.");
@@ -49,127 +263,103 @@ Value VM::visit_variable_expr(VariableExpr& expr) {
 
 Value VM::visit_unary_expr(UnaryExpr& expr) {
     Value right = evaluate(*expr.right);
-
-    switch (expr.op.type) {
-        case TokenType::BANG:
-            return Value{!is_truthy(right)};
-        case TokenType::MINUS:
-            if (!std::holds_alternative<double>(right)) {
-                throw RuntimeError("Operand must be a number.");
-            }
-            return Value{-std::get<double>(right)};
-        default:
-            break;
-    }
-
-    throw RuntimeError("Unknown unary operator.");
+    return apply_unary(to_unary_op(expr.op.type), right);
 }
 
 Value VM::visit_binary_expr(BinaryExpr& expr) {
     Value left = evaluate(*expr.left);
     Value right = evaluate(*expr.right);
-
-    switch (expr.op.type) {
-        case TokenType::PLUS:
-            if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
-                return Value{std::get<double>(left) + std::get<double>(right)};
-            }
-            if (std::holds_alternative<std::string>(left) && std::holds_alternative<std::string>(right)) {
-                return Value{std::get<std::string>(left) + std::get<std::string>(right)};
-            }
-            throw RuntimeError("Operands must be two numbers or two strings.");
-        case TokenType::MINUS:
-            if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
-                return Value{std::get<double>(left) - std::get<double>(right)};
-            }
-            throw RuntimeError("Operands must be numbers.");
-        case TokenType::STAR:
-            if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
-                return Value{std::get<double>(left) * std::get<double>(right)};
-            }
-            throw RuntimeError("Operands must be numbers.");
-        case TokenType::SLASH:
-            if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
-                double divisor = std::get<double>(right);
-                if (divisor == 0.0) {
-                    throw RuntimeError("Division by zero.");
-                }
-                return Value{std::get<double>(left) / divisor};
-            }
-            throw RuntimeError("Operands must be numbers.");
-        case TokenType::GREATER:
-            if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
-                return Value{std::get<double>(left) > std::get<double>(right)};
-            }
-            throw RuntimeError("Operands must be numbers.");
-        case TokenType::GREATER_EQUAL:
-            if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
-                return Value{std::get<double>(left) >= std::get<double>(right)};
-            }
-            throw RuntimeError("Operands must be numbers.");
-        case TokenType::LESS:
-            if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
-                return Value{std::get<double>(left) < std::get<double>(right)};
-            }
-            throw RuntimeError("Operands must be numbers.");
-        case TokenType::LESS_EQUAL:
-            if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
-                return Value{std::get<double>(left) <= std::get<double>(right)};
-            }
-            throw RuntimeError("Operands must be numbers.");
-        case TokenType::BANG_EQUAL:
-            return Value{!values_equal(left, right)};
-        case TokenType::EQUAL_EQUAL:
-            return Value{values_equal(left, right)};
-        case TokenType::AND:
-            return Value{is_truthy(left) && is_truthy(right)};
-        case TokenType::OR:
-            return Value{is_truthy(left) || is_truthy(right)};
-        default:
-            break;
-    }
-
-    throw RuntimeError("Unknown operator.");
+    return apply_binary(to_binary_op(expr.op.type), left, right);
 }
 
 Value VM::visit_assign_expr(AssignExpr& expr) {
     Value value = evaluate(*expr.value);
 
-    for (auto scope_it = scopes_.rbegin(); scope_it != scopes_.rend(); ++scope_it) {
-        auto it = scope_it->find(expr.name);
-        if (it != scope_it->end()) {
-            it->second = value;
-            return value;
-        }
+    if (expr.slot != no_frame_slot) {
+        frame_[expr.slot] = value;
+        return value;
     }
 
-    auto global_it = globals_.find(expr.name);
-    if (global_it != globals_.end()) {
-        global_it->second = value;
+    if (Value* global = find_global(expr.name, expr.global)) {
+        *global = value;
         return value;
     }
 
     throw RuntimeError("Undefined variable '" + expr.name + "'.");
 }
 
+Value VM::visit_call_expr(CallExpr& expr) {
+    Value arguments[max_builtin_arguments];
+    for (std::size_t i = 0; i < expr.arguments.size(); ++i) {
+        arguments[i] = evaluate(*expr.arguments[i]);
+    }
+    return call_builtin(expr.builtin, arguments, expr.arguments.size());
+}
+
+Value VM::visit_temp_store_expr(TempStoreExpr& expr) {
+    Value value = evaluate(*expr.value);
+    if (expr.slot >= temps_.size()) {
+        temps_.resize(expr.slot + 1);
+    }
+    temps_[expr.slot] = value;
+    return value;
+}
+
+Value VM::visit_temp_load_expr(TempLoadExpr& expr) {
+    return temps_[expr.slot];
+}
+
+Value VM::visit_fused_binary_expr(FusedBinaryExpr& expr) {
+    return apply_binary(expr.op, operand(expr.left), operand(expr.right));
+}
+
+Value VM::visit_fused_assign_expr(FusedAssignExpr& expr) {
+    Value& target = frame_[expr.slot];
+    const Value& right = operand(expr.right);
+    double* number = std::get_if<double>(&target);
+    const double* amount = std::get_if<double>(&right);
+    if (number && amount && expr.op != BinaryOp::DIVIDE) {
+        switch (expr.op) {
+            case BinaryOp::ADD: *number += *amount; break;
+            case BinaryOp::SUBTRACT: *number -= *amount; break;
+            default: *number *= *amount; break;
+        }
+    } else {
+        target = apply_binary(expr.op, target, right);
+    }
+    return target;
+}
+
+Value VM::visit_error_expr(ErrorExpr&) {
+    throw RuntimeError("Cannot evaluate an expression with syntax errors.");
+}
+
 void VM::visit_expression_stmt(ExpressionStmt& stmt) {
     evaluate(*stmt.expression);
 }
 
 void VM::visit_print_stmt(PrintStmt& stmt) {
     Value value = evaluate(*stmt.expression);
-    std::cout << to_string(value) << std::endl;
+    // Not flushed: std::cerr is tied to std::cout, so errors still come
+    // after the output before them.
+    write_value(std::cout, value) << '\n';
 }
 
 void VM::visit_let_stmt(LetStmt& stmt) {
     Value value = stmt.initializer ? evaluate(*stmt.initializer) : Value{};
-    define(stmt.name, value);
+    if (stmt.slot != no_frame_slot) {
+        frame_[stmt.slot] = std::move(value);
+    } else {
+        auto [global_it, inserted] = globals_.try_emplace(stmt.name);
+        if (inserted) ++globals_version_;
+        global_it->second = std::move(value);
+    }
 }
 
 void VM::visit_block_stmt(BlockStmt& stmt) {
-    scopes_.emplace_back();
-    execute_block(stmt.statements);
-    scopes_.pop_back();
+    for (const auto& statement : stmt.statements) {
+        statement->accept(*this);
+    }
 }
 
 void VM::visit_if_stmt(IfStmt& stmt) {
@@ -188,51 +378,154 @@ void VM::visit_while_stmt(WhileStmt& stmt) {
     }
 }
 
-void VM::execute(const std::vector<StmtPtr>& statements) {
-    for (const auto& stmt : statements) {
-        if (!stmt) continue;
-        stmt->accept(*this);
+void VM::visit_fused_while_stmt(FusedWhileStmt& stmt) {
+    const FusedBinaryExpr& condition = *stmt.condition;
+    while (true) {
+        const Value& left = operand(condition.left);
+        const Value& right = operand(condition.right);
+        const double* a = std::get_if<double>(&left);
+        const double* b = std::get_if<double>(&right);
+        bool taken;
+        if (a && b) {
+            switch (condition.op) {
+                case BinaryOp::GREATER: taken = *a > *b; break;
+                case BinaryOp::GREATER_EQUAL: taken = *a >= *b; break;
+                case BinaryOp::LESS: taken = *a < *b; break;
+                case BinaryOp::LESS_EQUAL: taken = *a <= *b; break;
+                case BinaryOp::EQUAL: taken = *a == *b; break;
+                default: taken = *a != *b; break;
+            }
+        } else {
+            taken = is_truthy(apply_binary(condition.op, left, right));
+        }
+        if (!taken) break;
+        stmt.body->accept(*this);
     }
 }
 
-void VM::execute_block(const std::vector<StmtPtr>& statements) {
-    for (const auto& stmt : statements) {
-        if (!stmt) continue;
-        stmt->accept(*this);
-    }
+void VM::visit_counted_loop_stmt(CountedLoopStmt& stmt) {
+    if (!run_counted_loop(stmt)) visit_fused_while_stmt(*stmt.loop);
 }
 
-void VM::define(const std::string& name, const Value& value) {
-    current_scope()[name] = value;
+void VM::visit_error_stmt(ErrorStmt&) {
+    throw RuntimeError("Cannot execute a statement with syntax errors.");
 }
 
-void VM::assign(const std::string& name, const Value& value) {
-    for (auto scope_it = scopes_.rbegin(); scope_it != scopes_.rend(); ++scope_it) {
-        auto it = scope_it->find(name);
-        if (it != scope_it->end()) {
-            it->second = value;
-            return;
+void VM::execute(std::vector<StmtPtr>& statements) {
+    std::uint32_t frame_size = resolver_.run(statements);
+    if (frame_.size() < frame_size) {
+        frame_.resize(frame_size);
+    }
+    if (tier_ == Tier::REGISTER) {
+        RegProgram program = compile_registers(statements, frame_size);
+        if (ir_dump_) {
+            *ir_dump_ << to_string(program);
         }
+        tl::execute(program, frame_, globals_, globals_version_, jit_);
+        return;
+    }
+    if (superinstructions_) {
+        fuser_.run(statements);
     }
 
-    auto global_it = globals_.find(name);
-    if (global_it != globals_.end()) {
-        global_it->second = value;
-        return;
+    for (const auto& stmt : statements) {
+        if (!stmt) continue;
+        stmt->accept(*this);
+    }
+}
+
+void VM::execute_ssa(std::vector<StmtPtr>& statements) {
+    if (statements.empty()) return;
+    remove_dead_stores(statements);
+    IrFunction function = lower_to_ir(statements, globals_);
+    passes_.run(function);
+    if (ir_dump_) {
+        *ir_dump_ << to_string(function);
+    }
+    if (type_report_) {
+        *type_report_ << explain_types(function);
     }
+    std::size_t defined = globals_.size();
+    tl::execute(function, globals_);
+    if (globals_.size() != defined) ++globals_version_;
+}
 
-    throw RuntimeError("Undefined variable '" + name + "'.");
+void VM::remove_dead_stores(std::vector<StmtPtr>& statements) {
+    if (dead_stores_.run(statements) == 0 || !dead_store_report_) return;
+    for (const auto& store : dead_stores_.removed()) {
+        *dead_store_report_ << "[dead store] " << to_string(store) << "\n";
+    }
 }
 
 Value VM::evaluate(Expr& expr) {
     return expr.accept(*this);
 }
 
-std::unordered_map<std::string, Value>& VM::current_scope() {
-    if (scopes_.empty()) {
-        return globals_;
+const Value& VM::operand(const FusedOperand& operand) const {
+    return operand.slot != no_frame_slot ? frame_[operand.slot] : operand.constant;
+}
+
+// Applies every iteration of `stmt` at once, unless a value is not an
+// integer or a result would not be exact; then it changes nothing.
+bool VM::run_counted_loop(const CountedLoopStmt& stmt) {
+    const FusedBinaryExpr& condition = *stmt.loop->condition;
+    std::int64_t counter;
+    std::int64_t limit;
+    if (!exact_integer(frame_[condition.left.slot], counter) || !exact_integer(operand(condition.right), limit)) {
+        return false;
+    }
+    auto stride = static_cast<std::int64_t>(stmt.stride);
+    std::int64_t distance = stride > 0 ? limit - counter : counter - limit;
+    std::int64_t step = stride > 0 ? stride : -stride;
+    std::int64_t trips;
+    if (condition.op == BinaryOp::LESS_EQUAL || condition.op == BinaryOp::GREATER_EQUAL) {
+        trips = distance < 0 ? 0 : distance / step + 1;
+    } else {
+        trips = distance <= 0 ? 0 : (distance - 1) / step + 1;
+    }
+    if (trips == 0) return true;
+    std::int64_t end = counter + trips * stride;
+    if (end > exact_limit || end < -exact_limit) return false;
+
+    // What the step leaves its local at, if every partial sum is exact.
+    auto result = [&](const CountedLoopStmt::Step& s, double& out) {
+        std::int64_t start;
+        if (!exact_integer(frame_[s.slot], start)) return false;
+        std::int64_t bound = (exact_limit - std::llabs(start)) / trips;
+        std::int64_t total;
+        if (s.amount.slot == condition.left.slot) {
+            std::int64_t first = counter + (s.after_counter ? stride : 0);
+            std::int64_t last = first + (trips - 1) * stride;
+            if (std::max(std::llabs(first), std::llabs(last)) > bound) return false;
+            total = trips * (first + last) / 2;
+        } else {
+            std::int64_t amount;
+            if (!exact_integer(operand(s.amount), amount) || std::llabs(amount) > bound) return false;
+            total = trips * amount;
+        }
+        out = static_cast<double>(s.op == BinaryOp::ADD ? start + total : start - total);
+        return true;
+    };
+
+    double value;
+    for (const auto& s : stmt.steps) {
+        if (!result(s, value)) return false;
+    }
+    for (const auto& s : stmt.steps) {
+        result(s, value);
+        frame_[s.slot] = value;
+    }
+    frame_[condition.left.slot] = static_cast<double>(end);
+    return true;
+}
+
+Value* VM::find_global(const std::string& name, GlobalCache& cache) {
+    if (cache.version != globals_version_) {
+        auto global_it = globals_.find(name);
+        cache.value = global_it != globals_.end() ? &global_it->second : nullptr;
+        cache.version = globals_version_;
     }
-    return scopes_.back();
+    return cache.value;
 }
 
 } // namespace tl
@@ -0,0 +1,15 @@
+# Runs SCRIPT with the interpreter TL and runs PROGRAM, which tlc compiled
+# from it. Fails unless both print the same and exit with the same status.
+execute_process(COMMAND ${TL} ${SCRIPT}
+                OUTPUT_VARIABLE expected_output ERROR_VARIABLE expected_error RESULT_VARIABLE expected_status)
+execute_process(COMMAND ${PROGRAM}
+                OUTPUT_VARIABLE output ERROR_VARIABLE error RESULT_VARIABLE status)
+if(NOT output STREQUAL expected_output)
+    message(FATAL_ERROR "stdout differs from tl.\ntl:\n${expected_output}\ncompiled:\n${output}")
+endif()
+if(NOT error STREQUAL expected_error)
+    message(FATAL_ERROR "stderr differs from tl.\ntl:\n${expected_error}\ncompiled:\n${error}")
+endif()
+if(NOT status STREQUAL expected_status)
+    message(FATAL_ERROR "Exit status ${status} differs from tl's ${expected_status}.")
+endif()
@@ -0,0 +1,76 @@
+#include "tl/document.hpp"
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+// Applies random edits to a Document and checks after each one that it
+// matches a Document built from scratch from the same text.
+
+namespace {
+
+const char* const fragments[] = {
+    "let ", "x", "y1", " = ", "1", "2.5", ";", ";\n", "\n", " ", "{", "}", "(", ")", "\"", "\"s\"",
+    "print ", "if ", "else ", "while ", "+", " * ", "==", "!", "// note\n", "\tprint x;\n", "@",
+};
+
+std::string describe(const tl::Token& token) {
+    std::string literal;
+    if (auto* number = std::get_if<double>(&token.literal)) literal = std::to_string(*number);
+    if (auto* text = std::get_if<std::string>(&token.literal)) literal = "\"" + *text + "\"";
+    return tl::token_type_to_string(token.type) + " '" + token.lexeme + "' " + literal + " at " +
+           std::to_string(token.line) + ":" + std::to_string(token.column);
+}
+
+// What a statement should look like from outside, one line per fact.
+std::vector<std::string> describe(const tl::Document& document) {
+    std::vector<std::string> lines;
+    lines.push_back("error: " + document.error());
+    for (std::size_t i = 0; i < document.statement_count(); ++i) {
+        lines.push_back("statement " + std::to_string(i) + " at " + std::to_string(document.statement_offset(i)) +
+                        ", line " + std::to_string(document.statement_line(i)));
+        for (const auto& token : document.tokens(i)) lines.push_back("  " + describe(token));
+        for (const auto& diagnostic : document.diagnostics(i)) lines.push_back("  " + tl::to_string(diagnostic));
+        if (document.diagnostics(i).empty()) lines.push_back("  " + tl::to_source(document.statements(i)));
+    }
+    return lines;
+}
+
+std::string random_text(std::mt19937& random, std::size_t pieces) {
+    std::string text;
+    std::uniform_int_distribution<std::size_t> pick(0, std::size(fragments) - 1);
+    for (std::size_t i = 0; i < pieces; ++i) text += fragments[pick(random)];
+    return text;
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 random(20260418);
+    int failures = 0;
+    for (int sequence = 0; sequence < 1000 && failures == 0; ++sequence) {
+        tl::Document document(random_text(random, random() % 12));
+        for (int step = 0; step < 12; ++step) {
+            std::size_t offset = random() % (document.size() + 1);
+            std::size_t length = random() % (document.size() - offset + 1) % 6;
+            std::string replacement = random_text(random, random() % 3);
+            std::string before = document.text();
+            document.edit(offset, length, replacement);
+
+            auto got = describe(document);
+            auto expected = describe(tl::Document(document.text()));
+            if (got == expected) continue;
+            std::fprintf(stderr, "edit(%zu, %zu, \"%s\") of \"%s\" differs from a fresh parse:\n", offset, length,
+                         replacement.c_str(), before.c_str());
+            for (std::size_t i = 0; i < got.size() || i < expected.size(); ++i) {
+                std::string a = i < got.size() ? got[i] : "";
+                std::string b = i < expected.size() ? expected[i] : "";
+                std::fprintf(stderr, "%c %-50s | %s\n", a == b ? ' ' : '!', a.c_str(), b.c_str());
+            }
+            ++failures;
+            break;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
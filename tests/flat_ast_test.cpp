@@ -0,0 +1,129 @@
+#include "tl/flat_ast.hpp"
+#include "tl/lexer.hpp"
+#include "tl/parser.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Round-trips programs through the flat form and its binary encoding, and
+// feeds deserialize() damaged input, which it must reject.
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (ok) return;
+    std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+    ++failures;
+}
+
+std::vector<tl::StmtPtr> parse(const std::string& source) {
+    tl::Parser parser(tl::Lexer(source).tokenize_compact());
+    auto program = parser.parse();
+    if (!parser.diagnostics().empty()) throw std::runtime_error("test program does not parse: " + source);
+    return program;
+}
+
+bool rejects(std::string_view bytes) {
+    try {
+        tl::deserialize(bytes);
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+void round_trip(const std::string& source) {
+    auto program = parse(source);
+    tl::FlatAst flat = tl::flatten(program);
+    std::string expected = tl::to_source(program);
+    check(tl::to_source(tl::unflatten(flat)) == expected, "unflatten(flatten(p)) reproduces p:\n" + source);
+
+    std::string bytes = tl::serialize(flat);
+    tl::FlatAst copy = tl::deserialize(bytes);
+    check(tl::serialize(copy) == bytes && copy.node_count() == flat.node_count(),
+          "deserialize(serialize(f)) gives back f:\n" + source);
+    check(tl::to_source(tl::unflatten(copy)) == expected, "deserialized program matches p:\n" + source);
+
+    for (std::size_t size = 0; size < bytes.size(); ++size) {
+        if (!rejects(std::string_view(bytes).substr(0, size))) {
+            check(false, "truncated to " + std::to_string(size) + " bytes is rejected:\n" + source);
+            break;
+        }
+    }
+    check(rejects(bytes + '\0'), "trailing data is rejected:\n" + source);
+
+    // A damaged byte must be either rejected or still describe a program
+    // that unflattens.
+    std::mt19937 random(static_cast<unsigned>(bytes.size()));
+    for (int i = 0; i < 2000; ++i) {
+        std::string damaged = bytes;
+        damaged[random() % damaged.size()] ^= static_cast<char>(1u << (random() % 8));
+        try {
+            tl::to_source(tl::unflatten(tl::deserialize(damaged)));
+        } catch (const std::runtime_error&) {
+        } catch (const std::exception& error) {
+            check(false, std::string("damaged input fails cleanly, not with ") + error.what());
+            break;
+        }
+    }
+}
+
+std::string read(const char* path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    round_trip("print 1;");
+    round_trip("let x = nil; let y = x; print x == y;");
+    round_trip("let s = \"a\" + \"b\"; print s != \"ab\" or !true and false;");
+    round_trip("let a = 2; let b = -a; print (a + b) * (a + b) / (a + b) - 1.5;");
+    round_trip("{ let i = 0; while (i < 3) { i = i + 1; if (i >= 2) print i; else { print -i; } } }");
+    round_trip("let line = readline(); let all = lines(\"in.txt\"); print readfile(\"in.txt\"); x = y = 3;");
+    for (int i = 1; i < argc; ++i) round_trip(read(argv[i]));
+
+    std::string bytes = tl::serialize(tl::flatten(parse("print -1;")));
+    std::string bad_magic = bytes;
+    bad_magic[0] = 'X';
+    check(rejects(bad_magic), "bad magic is rejected");
+    std::string bad_version = bytes;
+    bad_version[4] = 99;
+    check(rejects(bad_version), "unknown version is rejected");
+
+    // -(-(...)) whose operand is itself.
+    tl::FlatAst cyclic;
+    cyclic.unaries.push_back(tl::FlatUnary{tl::ExprRef(tl::ExprKind::UNARY, 0), tl::UnaryOp::NEGATE});
+    cyclic.print_stmts.push_back(tl::ExprRef(tl::ExprKind::UNARY, 0));
+    cyclic.program.push_back(tl::StmtRef(tl::StmtKind::PRINT, 0));
+    check(rejects(tl::serialize(cyclic)), "an expression cycle is rejected");
+
+    // A block that contains itself.
+    tl::FlatAst nested;
+    nested.blocks.push_back(tl::FlatBlock{0, 1});
+    nested.block_items.push_back(tl::StmtRef(tl::StmtKind::BLOCK, 0));
+    nested.program.push_back(tl::StmtRef(tl::StmtKind::BLOCK, 0));
+    check(rejects(tl::serialize(nested)), "a statement cycle is rejected");
+
+    tl::FlatAst dangling;
+    dangling.print_stmts.push_back(tl::ExprRef(tl::ExprKind::LITERAL, 0));
+    dangling.program.push_back(tl::StmtRef(tl::StmtKind::PRINT, 0));
+    check(rejects(tl::serialize(dangling)), "a reference past its pool is rejected");
+
+    tl::FlatAst unnamed;
+    unnamed.variables.push_back(0);
+    check(rejects(tl::serialize(unnamed)), "a name index past the names is rejected");
+
+    return failures == 0 ? 0 : 1;
+}